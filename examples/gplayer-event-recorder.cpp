@@ -0,0 +1,57 @@
+
+#include <iostream>
+#include <thread>
+
+#include "gplayer.h"
+
+using namespace GPlayer;
+
+int main(int argc, char* argv[])
+{
+    int ret = 0;
+
+    GPPreRollOptions options;
+    options.directory = argc > 1 ? argv[1] : ".";
+    options.prefix = "event";
+    options.pre_roll = 10;
+    options.post_roll = 20;
+
+    std::shared_ptr<GPCameraV4l2> v4l2 = std::make_shared<GPCameraV4l2>();
+    std::shared_ptr<GPPreRollSink> recorder =
+        std::make_shared<GPPreRollSink>(options);
+
+    std::shared_ptr<GPPipeline> pipeline = std::make_shared<GPPipeline>();
+    pipeline->AddMany(v4l2, recorder);
+
+    v4l2->LoadConfiguration("camera-v4l2.json");
+
+    v4l2->Link(recorder);
+
+    ret = pipeline->Run();
+
+    // Every line on stdin stands in for an event, e.g. a motion detector
+    std::thread events([recorder]() {
+        std::string line;
+        while (std::getline(std::cin, line)) {
+            recorder->Trigger();
+        }
+    });
+    events.detach();
+
+    for (;;) {
+        GPMessage msg;
+        if (!pipeline->GetMessage(&msg)) {
+            continue;
+        }
+
+        if (msg.type == GPMessageType::ERROR) {
+            break;
+        }
+        else if (msg.type == GPMessageType::STATE_CHANGED) {
+        }
+        else {
+        }
+    };
+
+    return ret;
+}
@@ -13,6 +13,18 @@ int main(int argc, char* argv[])
         std::make_shared<GPDisplayEGLSink>();
     std::shared_ptr<GPFileSrc> h264fileSrc = std::make_shared<GPFileSrc>(
         std::string("sample_outdoor_car_1080p_10fps.h264"));
+    // Further files given on the command line play back to back; with
+    // --loop the whole list loops without restarting the decoder
+    bool loop = false;
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]) == "--loop") {
+            loop = true;
+        }
+        else {
+            h264fileSrc->Enqueue(argv[i]);
+        }
+    }
+    h264fileSrc->SetLoop(loop);
     std::shared_ptr<GPFileSink> h264file =
         std::make_shared<GPFileSink>(std::string("try001.h264"));
 
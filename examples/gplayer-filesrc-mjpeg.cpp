@@ -0,0 +1,45 @@
+
+#include "gplayer.h"
+
+using namespace GPlayer;
+
+int main(int argc, char* argv[])
+{
+    int ret = 0;
+
+    std::shared_ptr<GPFileSrc> mjpegfileSrc =
+        std::make_shared<GPFileSrc>(std::string("try001.mjpeg"));
+    std::shared_ptr<GPMjpegDemuxer> mjpegdemuxer =
+        std::make_shared<GPMjpegDemuxer>();
+    std::shared_ptr<GPNvJpegDecoder> nvjpegdecoder =
+        std::make_shared<GPNvJpegDecoder>();
+    std::shared_ptr<GPDisplayEGLSink> egl =
+        std::make_shared<GPDisplayEGLSink>();
+    egl->Initialize(30, false);
+
+    std::shared_ptr<GPPipeline> pipeline = std::make_shared<GPPipeline>();
+    pipeline->AddMany(mjpegfileSrc, mjpegdemuxer, nvjpegdecoder, egl);
+
+    mjpegfileSrc->Link(mjpegdemuxer);
+    mjpegdemuxer->Link(nvjpegdecoder);
+    nvjpegdecoder->Link(egl);
+
+    ret = pipeline->Run();
+
+    for (;;) {
+        GPMessage msg;
+        if (!pipeline->GetMessage(&msg)) {
+            continue;
+        }
+
+        if (msg.type == GPMessageType::ERROR) {
+            break;
+        }
+        else if (msg.type == GPMessageType::STATE_CHANGED) {
+        }
+        else {
+        }
+    };
+
+    return ret;
+}
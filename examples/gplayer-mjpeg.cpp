@@ -18,6 +18,7 @@ int main(int argc, char* argv[])
     pipeline->AddMany(v4l2, mjpegfile, nvjpegdecoder, egl);
 
     v4l2->LoadConfiguration("camera-v4l2.json");
+    pipeline->LoadThreadPolicies("threads.json");
     v4l2->LinkMany(egl, mjpegfile, nvjpegdecoder);
 
     ret = pipeline->Run();
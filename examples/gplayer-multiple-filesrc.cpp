@@ -22,7 +22,7 @@ int main(int argc, char* argv[])
         for (uint32_t j = 0; j < row; j++) {
             std::shared_ptr<GPFileSrc> h264fileSrc =
                 std::make_shared<GPFileSrc>(
-                    std::string("sample_outdoor_car_1080p_10fps.h264"));
+                    std::string("sample_outdoor_car_1080p_10fps.h264"), true);
             std::shared_ptr<GPNvVideoDecoder> nvvideodecoder =
                 std::make_shared<GPNvVideoDecoder>();
             std::shared_ptr<GPDisplayEGLSink> egl =
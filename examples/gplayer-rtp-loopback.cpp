@@ -0,0 +1,224 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gp_rtp_depayloader.h"
+#include "gp_rtp_payloader.h"
+#include "gp_udp_src.h"
+
+using namespace GPlayer;
+
+// Sends synthetic H.264/H.265 access units through GPRtpPayloader to a
+// GPRtpDepayloader, or with "udpsrc" to a GPUdpSrc and its jitter buffer,
+// over loopback UDP and checks that every access unit comes back byte for
+// byte with its PTS.
+//
+// gplayer-rtp-loopback [h264|h265] [Mbit/s] [seconds] [udpsrc]
+
+static const int kFps = 60;
+static const int kGopLength = 30;
+
+static uint64_t Hash(uint64_t value)
+{
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccdULL;
+    value ^= value >> 33;
+    value *= 0xc4ceb9fe1a85ec53ULL;
+    return value ^ (value >> 33);
+}
+
+static int64_t GetPts(uint64_t index)
+{
+    return index * 1000000 / kFps;
+}
+
+static void AppendNalu(std::vector<uint8_t>& au,
+                       GPVideoCodec codec,
+                       int type,
+                       size_t length,
+                       uint64_t seed)
+{
+    static const uint8_t start_code[] = {0, 0, 0, 1};
+    au.insert(au.end(), start_code, start_code + sizeof(start_code));
+    if (codec == GPVideoCodec::H264) {
+        au.push_back(0x60 | type);
+    }
+    else {
+        au.push_back(type << 1);
+        au.push_back(1);
+    }
+    // first_mb_in_slice / first_slice_segment_in_pic_flag set
+    au.push_back(0x80);
+
+    // No zero bytes, so no start code can show up in the payload
+    uint64_t state = Hash(seed);
+    for (size_t i = 0; i < length; i++) {
+        if (i % 8 == 0) {
+            state = Hash(state + i);
+        }
+        au.push_back(uint8_t(state >> (i % 8 * 8)) | 1);
+    }
+}
+
+// Access unit index of a stream of about bitrate bits per second; every
+// kGopLength-th one is a keyframe four times the size of the others
+static void MakeAccessUnit(std::vector<uint8_t>& au,
+                           GPVideoCodec codec,
+                           uint64_t index,
+                           double bitrate)
+{
+    au.clear();
+    size_t average = bitrate / 8 / kFps;
+    size_t frame_size = average * kGopLength / (kGopLength + 3);
+    bool keyframe = index % kGopLength == 0;
+
+    if (codec == GPVideoCodec::H264) {
+        if (keyframe) {
+            AppendNalu(au, codec, 7, 20, index);
+            AppendNalu(au, codec, 8, 4, index + 1);
+            AppendNalu(au, codec, 5, frame_size * 4, index + 2);
+        }
+        else {
+            size_t size = frame_size / 2 + Hash(index) % frame_size;
+            AppendNalu(au, codec, 1, size, index);
+        }
+    }
+    else {
+        if (keyframe) {
+            AppendNalu(au, codec, 32, 24, index);
+            AppendNalu(au, codec, 33, 40, index + 1);
+            AppendNalu(au, codec, 34, 6, index + 2);
+            AppendNalu(au, codec, 19, frame_size * 4, index + 3);
+        }
+        else {
+            size_t size = frame_size / 2 + Hash(index) % frame_size;
+            AppendNalu(au, codec, 1, size, index);
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    GPRtpOptions options;
+    options.codec = argc > 1 && std::string(argv[1]) == "h265"
+                        ? GPVideoCodec::H265
+                        : GPVideoCodec::H264;
+    double bitrate = (argc > 2 ? atof(argv[2]) : 200) * 1000000;
+    double seconds = argc > 3 ? atof(argv[3]) : 5;
+    options.port = 15004;
+    options.reorder_depth = 256;
+    options.socket_buffer_size = 32 << 20;
+
+    bool use_udp_src = argc > 4 && std::string(argv[4]) == "udpsrc";
+    GPUdpSrcOptions udp_options;
+    udp_options.codec = options.codec;
+    udp_options.address = options.host;
+    udp_options.port = options.port;
+    udp_options.socket_buffer_size = options.socket_buffer_size;
+
+    std::shared_ptr<GPRtpDepayloader> depayloader;
+    std::shared_ptr<GPUdpSrc> udp_src;
+    if (use_udp_src) {
+        udp_src = std::make_shared<GPUdpSrc>(udp_options);
+    }
+    else {
+        depayloader = std::make_shared<GPRtpDepayloader>(options);
+    }
+    auto payloader = std::make_shared<GPRtpPayloader>(options);
+
+    std::atomic<uint64_t> received{0};
+    std::atomic<uint64_t> mismatches{0};
+    std::atomic<uint64_t> keyframes{0};
+    std::vector<uint8_t> expected;
+    auto check = [&](GPBuffer& buffer, bool keyframe) {
+        uint64_t index = (buffer.GetPts() + GetPts(1) / 2) / GetPts(1);
+        MakeAccessUnit(expected, options.codec, index, bitrate);
+        if (expected.size() != buffer.GetLength() ||
+            memcmp(expected.data(), buffer.GetData(), expected.size()) != 0 ||
+            keyframe != (index % kGopLength == 0)) {
+            mismatches++;
+        }
+        keyframes += keyframe;
+        received++;
+    };
+    if (use_udp_src) {
+        udp_src->SetAccessUnitCallback(check);
+    }
+    else {
+        depayloader->SetAccessUnitCallback(check);
+    }
+    std::thread receiver([&]() {
+        if (use_udp_src) {
+            udp_src->Proc();
+        }
+        else {
+            depayloader->Proc();
+        }
+    });
+
+    uint64_t count = seconds * kFps;
+    std::vector<uint8_t> au;
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < count; i++) {
+        MakeAccessUnit(au, options.codec, i, bitrate);
+        GPBuffer buffer(au.data(), au.size());
+        buffer.SetPts(GetPts(i));
+        GPData data(&buffer);
+
+        std::this_thread::sleep_until(start +
+                                      std::chrono::microseconds(GetPts(i)));
+        payloader->Process(&data);
+    }
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    if (use_udp_src) {
+        udp_src->Stop();
+    }
+    else {
+        depayloader->Stop();
+    }
+    receiver.join();
+
+    GPRtpPayloaderStats sent = payloader->GetStats();
+    GPRtpStats stats =
+        use_udp_src ? udp_src->GetRtpStats() : depayloader->GetStats();
+    printf("sent     %llu access units, %llu packets, %.1f MB in %.2f s, "
+           "%.1f Mbit/s, %llu send errors\n",
+           (unsigned long long)sent.access_units,
+           (unsigned long long)sent.packets, sent.bytes / 1e6,
+           elapsed.count(), sent.bytes * 8 / elapsed.count() / 1e6,
+           (unsigned long long)sent.send_errors);
+    printf("received %llu access units (%llu keyframes), %llu packets, "
+           "%llu mismatches\n",
+           (unsigned long long)received.load(),
+           (unsigned long long)keyframes.load(),
+           (unsigned long long)stats.packets,
+           (unsigned long long)mismatches.load());
+    printf("lost %llu, reordered %llu, discarded %llu, broken %llu\n",
+           (unsigned long long)stats.lost, (unsigned long long)stats.reordered,
+           (unsigned long long)stats.discarded,
+           (unsigned long long)stats.broken_access_units);
+
+    if (use_udp_src) {
+        GPJitterStats jitter = udp_src->GetJitterStats();
+        printf("jitter buffer: late %llu, lost %llu, jitter %lld us, target "
+               "%lld us, added latency %lld us average, %lld us max\n",
+               (unsigned long long)jitter.late,
+               (unsigned long long)jitter.lost, (long long)jitter.jitter_us,
+               (long long)jitter.target_delay_us,
+               (long long)jitter.average_delay_us,
+               (long long)jitter.max_delay_us);
+    }
+
+    bool ok = received == count && mismatches == 0;
+    printf("%s\n", ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
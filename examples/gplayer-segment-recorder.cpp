@@ -0,0 +1,44 @@
+
+#include "gplayer.h"
+
+using namespace GPlayer;
+
+int main(int argc, char* argv[])
+{
+    int ret = 0;
+
+    GPSegmentOptions options;
+    options.directory = argc > 1 ? argv[1] : ".";
+    options.prefix = "camera";
+    options.max_duration = 5 * 60;
+
+    std::shared_ptr<GPCameraV4l2> v4l2 = std::make_shared<GPCameraV4l2>();
+    std::shared_ptr<GPSegmentSink> recorder =
+        std::make_shared<GPSegmentSink>(options);
+
+    std::shared_ptr<GPPipeline> pipeline = std::make_shared<GPPipeline>();
+    pipeline->AddMany(v4l2, recorder);
+
+    v4l2->LoadConfiguration("camera-v4l2.json");
+
+    v4l2->Link(recorder);
+
+    ret = pipeline->Run();
+
+    for (;;) {
+        GPMessage msg;
+        if (!pipeline->GetMessage(&msg)) {
+            continue;
+        }
+
+        if (msg.type == GPMessageType::ERROR) {
+            break;
+        }
+        else if (msg.type == GPMessageType::STATE_CHANGED) {
+        }
+        else {
+        }
+    };
+
+    return ret;
+}
@@ -0,0 +1,262 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gp_bitstream.h"
+#include "gplayer.h"
+
+using namespace GPlayer;
+
+// Plays an H.264 file over loopback TCP, pulled by GPSocketClient or, with
+// "server", pushed to a GPSocketServer that gives the stream a branch of its
+// own. The file is sent access unit by access unit at its frame rate, in
+// writes of random size, so NAL units straddle what is received at a time;
+// the byte and frame counts on the receiving side are checked against what
+// was sent.
+//
+// gplayer-socket-loopback <file.h264> [annexb|length] [fps] [client|server]
+
+static const uint16_t kPort = 15554;
+
+static bool SendAll(int socket, const uint8_t* data, size_t length)
+{
+    while (length > 0) {
+        ssize_t sent = send(socket, data, length, MSG_NOSIGNAL);
+        if (sent <= 0) {
+            return false;
+        }
+        data += sent;
+        length -= sent;
+    }
+    return true;
+}
+
+// Serves the access units of stream to socket, each after its length when
+// framed, and returns the bytes sent
+static uint64_t Serve(int socket,
+                      const std::vector<uint8_t>& stream,
+                      const std::vector<GPAccessUnit>& access_units,
+                      bool framed,
+                      double fps)
+{
+    std::mt19937 random(1);
+    uint64_t sent = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < access_units.size(); i++) {
+        std::this_thread::sleep_until(
+            start + std::chrono::microseconds(int64_t(i * 1000000 / fps)));
+
+        const GPAccessUnit& au = access_units[i];
+        if (framed) {
+            uint8_t prefix[4] = {uint8_t(au.size >> 24), uint8_t(au.size >> 16),
+                                 uint8_t(au.size >> 8), uint8_t(au.size)};
+            if (!SendAll(socket, prefix, sizeof(prefix))) {
+                break;
+            }
+            sent += sizeof(prefix);
+        }
+
+        const uint8_t* data = stream.data() + au.offset;
+        size_t left = au.size;
+        while (left > 0) {
+            size_t piece = std::min<size_t>(left, 1 + random() % 16384);
+            if (!SendAll(socket, data, piece)) {
+                return sent;
+            }
+            data += piece;
+            left -= piece;
+            sent += piece;
+        }
+    }
+    return sent;
+}
+
+// GPSocketClient connects to a listener here and is served the stream.
+// The pipelines started are added to pipelines, for the caller to keep.
+static bool PullFromClient(const std::vector<uint8_t>& stream,
+                           const std::vector<GPAccessUnit>& access_units,
+                           bool framed,
+                           double fps,
+                           std::vector<std::shared_ptr<GPPipeline>>& pipelines)
+{
+    int listener = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int reuse = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(kPort);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(listener, (struct sockaddr*)&address, sizeof(address)) < 0 ||
+        listen(listener, 1) < 0) {
+        printf("Cannot listen on port %u: %s\n", kPort, strerror(errno));
+        return false;
+    }
+
+    GPSocketClientOptions options;
+    options.port = kPort;
+    options.framing =
+        framed ? GPStreamFraming::Length : GPStreamFraming::AnnexB;
+    std::shared_ptr<GPSocketClient> client =
+        std::make_shared<GPSocketClient>(options);
+    std::shared_ptr<GPNvVideoDecoder> nvvideodecoder =
+        std::make_shared<GPNvVideoDecoder>();
+    std::shared_ptr<GPDisplayEGLSink> egl =
+        std::make_shared<GPDisplayEGLSink>();
+    egl->Initialize(30, false, 0, 0, 640, 480);
+
+    std::shared_ptr<GPPipeline> pipeline = std::make_shared<GPPipeline>();
+    pipeline->AddMany(client, nvvideodecoder, egl);
+    client->Link(nvvideodecoder);
+    nvvideodecoder->Link(egl);
+    pipelines.push_back(pipeline);
+    pipeline->Run();
+
+    int connection = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+    close(listener);
+    if (connection < 0) {
+        printf("Cannot accept the client: %s\n", strerror(errno));
+        return false;
+    }
+    uint64_t sent = Serve(connection, stream, access_units, framed, fps);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    GPSocketClientStats stats = client->GetStats();
+    printf("sent     %zu access units, %llu bytes\n", access_units.size(),
+           (unsigned long long)sent);
+    printf("received %llu access units, %llu bytes, %llu connects\n",
+           (unsigned long long)stats.frames, (unsigned long long)stats.bytes,
+           (unsigned long long)stats.connects);
+    close(connection);
+
+    return stats.bytes == sent && stats.connects == 1 &&
+           (!framed || stats.frames == access_units.size());
+}
+
+// The stream is pushed to GPSocketServer, whose branch factory gives it a
+// decoder and a display of its own
+static bool PushToServer(const std::vector<uint8_t>& stream,
+                         const std::vector<GPAccessUnit>& access_units,
+                         bool framed,
+                         double fps,
+                         std::vector<std::shared_ptr<GPPipeline>>& pipelines)
+{
+    GPSocketServerOptions options;
+    options.address = "127.0.0.1";
+    options.port = kPort;
+    options.udp = false;
+    options.framing =
+        framed ? GPStreamFraming::Length : GPStreamFraming::AnnexB;
+    std::shared_ptr<GPSocketServer> server =
+        std::make_shared<GPSocketServer>(options);
+
+    std::shared_ptr<GPPipeline> pipeline = std::make_shared<GPPipeline>();
+    pipeline->Add(server);
+    pipelines.push_back(pipeline);
+    // Called on the server thread, once the connection below is accepted
+    server->SetBranchFactory([&](const GPIngestStream& ingest) {
+        std::shared_ptr<GPNvVideoDecoder> nvvideodecoder =
+            std::make_shared<GPNvVideoDecoder>();
+        std::shared_ptr<GPDisplayEGLSink> egl =
+            std::make_shared<GPDisplayEGLSink>();
+        egl->Initialize(30, false, 0, 0, 640, 480);
+
+        std::shared_ptr<GPPipeline> branch = std::make_shared<GPPipeline>();
+        branch->AddMany(nvvideodecoder, egl);
+        nvvideodecoder->Link(egl);
+        branch->Run();
+        pipelines.push_back(branch);
+        return nvvideodecoder;
+    });
+    std::mutex closed_mutex;
+    std::vector<GPIngestStreamStats> closed;
+    server->SetStreamClosedCallback([&](const GPIngestStreamStats& stats) {
+        std::lock_guard<std::mutex> lock(closed_mutex);
+        closed.push_back(stats);
+    });
+
+    pipeline->Run();
+
+    int connection = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(kPort);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(connection, (struct sockaddr*)&address, sizeof(address)) <
+        0) {
+        printf("Cannot connect to the server: %s\n", strerror(errno));
+        return false;
+    }
+    uint64_t sent = Serve(connection, stream, access_units, framed, fps);
+    // Ends the stream, which reports its stats on the way
+    close(connection);
+
+    for (int i = 0; i < 20; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        std::lock_guard<std::mutex> lock(closed_mutex);
+        if (!closed.empty()) {
+            break;
+        }
+    }
+    GPSocketServerStats stats = server->GetStats();
+    std::lock_guard<std::mutex> lock(closed_mutex);
+    uint64_t frames = closed.empty() ? 0 : closed[0].frames;
+    uint64_t bytes = closed.empty() ? 0 : closed[0].bytes;
+    printf("sent     %zu access units, %llu bytes\n", access_units.size(),
+           (unsigned long long)sent);
+    printf("received %llu access units, %llu bytes, %llu streams\n",
+           (unsigned long long)frames, (unsigned long long)bytes,
+           (unsigned long long)stats.tcp_streams);
+
+    return closed.size() == 1 && stats.tcp_streams == 1 && bytes == sent &&
+           (!framed || frames == access_units.size());
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2) {
+        printf("gplayer-socket-loopback <file.h264> [annexb|length] [fps] "
+               "[client|server]\n");
+        return 1;
+    }
+    bool framed = argc > 2 && std::string(argv[2]) == "length";
+    double fps = argc > 3 ? atof(argv[3]) : 30;
+    bool push = argc > 4 && std::string(argv[4]) == "server";
+
+    std::ifstream file(argv[1], std::ios::binary);
+    std::vector<uint8_t> stream((std::istreambuf_iterator<char>(file)),
+                                std::istreambuf_iterator<char>());
+    std::vector<GPAccessUnit> access_units;
+    GPAccessUnitParser parser(GPVideoCodec::H264);
+    auto collect = [&](const GPAccessUnit& au) {
+        access_units.push_back(au);
+    };
+    parser.Parse(stream.data(), stream.size(), 0, collect);
+    parser.Finish(stream.size(), collect);
+    if (access_units.empty()) {
+        printf("No access units in %s\n", argv[1]);
+        return 1;
+    }
+
+    // The decoder threads do not stop; the pipelines are left without
+    // joining them
+    std::vector<std::shared_ptr<GPPipeline>> pipelines;
+    bool ok =
+        push ? PushToServer(stream, access_units, framed, fps, pipelines)
+             : PullFromClient(stream, access_units, framed, fps, pipelines);
+    printf("%s\n", ok ? "ok" : "FAILED");
+
+    fflush(stdout);
+    std::_Exit(ok ? 0 : 1);
+}
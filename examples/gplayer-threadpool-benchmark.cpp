@@ -0,0 +1,217 @@
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+#include "gp_threadpool.h"
+
+using namespace GPlayer;
+
+// The previous GPThreadPool: one locked queue of copied std::functions
+class LegacyThreadPool {
+public:
+    LegacyThreadPool()
+    {
+        int num_threads = std::thread::hardware_concurrency();
+        for (int i = 0; i < num_threads; i++) {
+            threads_.emplace_back(&LegacyThreadPool::InfiniteLoopFunc, this);
+        }
+    }
+
+    ~LegacyThreadPool()
+    {
+        {
+            std::unique_lock<std::mutex> lock(lock_);
+            accept_functions_ = false;
+        }
+        thread_condition_.notify_all();
+        for (auto& thread : threads_) {
+            thread.join();
+        }
+    }
+
+    void Post(std::function<void()>& func)
+    {
+        {
+            std::unique_lock<std::mutex> lock(lock_);
+            function_queue_.push(func);
+        }
+        thread_condition_.notify_one();
+    }
+
+private:
+    void InfiniteLoopFunc()
+    {
+        std::function<void()> func;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(lock_);
+                thread_condition_.wait(lock, [this]() {
+                    return !function_queue_.empty() || !accept_functions_;
+                });
+                if (!accept_functions_ && function_queue_.empty()) {
+                    return;
+                }
+                func = function_queue_.front();
+                function_queue_.pop();
+            }
+            func();
+        }
+    }
+
+    std::vector<std::thread> threads_;
+    std::queue<std::function<void()>> function_queue_;
+    bool accept_functions_ = true;
+    std::mutex lock_;
+    std::condition_variable thread_condition_;
+};
+
+static const int kTasks = 1000000;
+static const int kFanOut = 1000;
+
+static void Work(std::atomic<int>& counter)
+{
+    // A small payload, as for a tile of a frame
+    volatile int sum = 0;
+    for (int i = 0; i < 64; i++) {
+        sum += i;
+    }
+    counter++;
+}
+
+static void WaitFor(std::atomic<int>& counter, int count)
+{
+    while (counter < count) {
+        std::this_thread::yield();
+    }
+}
+
+template <typename Func>
+static void Measure(const char* name, Func func)
+{
+    auto start = std::chrono::steady_clock::now();
+    func();
+    auto elapsed = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start);
+    printf("%-40s %10.1f ms\n", name, elapsed.count());
+}
+
+int main(int argc, char* argv[])
+{
+    printf("%d tasks, %u threads\n", kTasks,
+           std::thread::hardware_concurrency());
+
+    Measure("legacy: post from one thread", []() {
+        std::atomic<int> counter{0};
+        LegacyThreadPool pool;
+        for (int i = 0; i < kTasks; i++) {
+            std::function<void()> func = [&counter]() { Work(counter); };
+            pool.Post(func);
+        }
+        WaitFor(counter, kTasks);
+    });
+
+    Measure("work stealing: post from one thread", []() {
+        std::atomic<int> counter{0};
+        GPThreadPool pool;
+        for (int i = 0; i < kTasks; i++) {
+            pool.Post([&counter]() { Work(counter); });
+        }
+        WaitFor(counter, kTasks);
+    });
+
+    // Every task spawns more tasks, as recursive splitting does
+    Measure("legacy: post from tasks", []() {
+        std::atomic<int> counter{0};
+        LegacyThreadPool pool;
+        for (int i = 0; i < kTasks / kFanOut; i++) {
+            std::function<void()> spawn = [&counter, &pool]() {
+                for (int j = 0; j < kFanOut; j++) {
+                    std::function<void()> func = [&counter]() {
+                        Work(counter);
+                    };
+                    pool.Post(func);
+                }
+            };
+            pool.Post(spawn);
+        }
+        WaitFor(counter, kTasks);
+    });
+
+    Measure("work stealing: post from tasks", []() {
+        std::atomic<int> counter{0};
+        GPThreadPool pool;
+        for (int i = 0; i < kTasks / kFanOut; i++) {
+            pool.Post([&counter, &pool]() {
+                for (int j = 0; j < kFanOut; j++) {
+                    pool.Post([&counter]() { Work(counter); });
+                }
+            });
+        }
+        WaitFor(counter, kTasks);
+    });
+
+    Measure("work stealing: submit and wait", []() {
+        GPThreadPool pool;
+        std::vector<std::future<int>> futures;
+        futures.reserve(kTasks / 10);
+        for (int i = 0; i < kTasks / 10; i++) {
+            futures.push_back(pool.Submit([](int x) { return x * 2; }, i));
+        }
+        long long sum = 0;
+        for (auto& future : futures) {
+            sum += future.get();
+        }
+        if (sum != static_cast<long long>(kTasks / 10) * (kTasks / 10 - 1)) {
+            printf("wrong result %lld\n", sum);
+        }
+    });
+
+    // Realtime tasks posted behind a backlog of background work should not
+    // wait for it, even once the backlog is starved
+    bool ok = true;
+    Measure("priorities: realtime behind background", [&ok]() {
+        std::atomic<int> counter{0};
+        GPThreadPool pool;
+        for (int i = 0; i < kTasks; i++) {
+            pool.Post([&counter]() { Work(counter); },
+                      GPTaskPriority::Background);
+        }
+        for (int i = 0; i < kTasks / 100; i++) {
+            pool.Post([&counter]() { Work(counter); },
+                      GPTaskPriority::Realtime);
+        }
+        WaitFor(counter, kTasks + kTasks / 100);
+
+        const char* names[] = {"realtime", "interactive", "background"};
+        for (size_t i = 0; i < kTaskPriorityCount; i++) {
+            GPThreadPoolStats stats =
+                pool.GetStats(static_cast<GPTaskPriority>(i));
+            if (stats.tasks == 0) {
+                continue;
+            }
+            printf("  %-12s %8llu tasks, delay avg %8lld us, max %8lld us\n",
+                   names[i], static_cast<unsigned long long>(stats.tasks),
+                   static_cast<long long>(stats.total_delay.count() /
+                                          stats.tasks),
+                   static_cast<long long>(stats.max_delay.count()));
+        }
+
+        GPThreadPoolStats realtime = pool.GetStats(GPTaskPriority::Realtime);
+        GPThreadPoolStats background =
+            pool.GetStats(GPTaskPriority::Background);
+        if (realtime.total_delay / realtime.tasks >=
+            background.total_delay / background.tasks) {
+            printf("  FAILED: realtime waited longer than background\n");
+            ok = false;
+        }
+    });
+
+    return ok ? 0 : 1;
+}
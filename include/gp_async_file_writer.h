@@ -0,0 +1,115 @@
+#ifndef __GP_ASYNC_FILE_WRITER__
+#define __GP_ASYNC_FILE_WRITER__
+
+#include <sys/types.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef GP_HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+namespace GPlayer {
+
+enum class GPFileSyncPolicy {
+    None,      // leave write back to the kernel
+    Interval,  // fdatasync after every sync_interval_bytes
+    OnClose,   // fdatasync once when the file is closed
+};
+
+struct GPAsyncFileWriterOptions {
+    // Size of each staging buffer; rounded up to a multiple of 4096
+    size_t buffer_size = 4 * 1024 * 1024;
+    // Bytes handed to the kernel but not completed yet; Write() blocks only
+    // when this is exceeded
+    size_t max_inflight_bytes = 64 * 1024 * 1024;
+    bool direct_io = false;
+    bool use_io_uring = true;
+    GPFileSyncPolicy sync_policy = GPFileSyncPolicy::None;
+    size_t sync_interval_bytes = 64 * 1024 * 1024;
+};
+
+// Appends to a file without blocking the caller on storage. Writes are
+// gathered into large page-aligned staging buffers, and full buffers are
+// submitted through io_uring when built with liburing, or else to a writer
+// thread using pwrite.
+class GPAsyncFileWriter {
+public:
+    GPAsyncFileWriter(const GPAsyncFileWriterOptions& options = {});
+    ~GPAsyncFileWriter();
+    GPAsyncFileWriter(const GPAsyncFileWriter&) = delete;
+    GPAsyncFileWriter& operator=(const GPAsyncFileWriter&) = delete;
+
+    bool Open(const std::string& filepath);
+    bool IsOpen() const { return fd_ >= 0; }
+    // Reserves disk space without changing the file size; the unused part
+    // is released again by Close()
+    bool Preallocate(uint64_t size);
+    bool Write(const uint8_t* data, size_t length);
+    // Submits the buffered bytes; with O_DIRECT only whole blocks go out
+    // before Close().
+    void Flush();
+    // Waits for every write to complete, then syncs and closes the file
+    bool Close();
+
+    uint64_t GetBytesWritten() const { return bytes_written_; }
+    size_t GetInflightBytes() const { return inflight_bytes_; }
+    int GetError() const { return error_; }
+
+private:
+    struct Buffer {
+        uint8_t* data;
+        size_t length;
+        off_t offset;
+        size_t done;
+    };
+
+    Buffer* AcquireBuffer();
+    void ReleaseBuffer(Buffer* buffer);
+    void Submit(Buffer* buffer);
+    void Complete(Buffer* buffer, int error);
+    void WaitInflight(size_t limit);
+    void SetError(int error);
+    void WriterProc();
+#ifdef GP_HAVE_LIBURING
+    bool SetupRing();
+    void QueueWrite(Buffer* buffer);
+    void QueueSync();
+    void ReapProc();
+#endif
+
+private:
+    GPAsyncFileWriterOptions options_;
+    std::string filepath_;
+    int fd_ = -1;
+    off_t file_offset_ = 0;
+    off_t synced_offset_ = 0;
+    bool preallocated_ = false;
+    Buffer* current_ = nullptr;
+    std::atomic<uint64_t> bytes_written_{0};
+    std::atomic<size_t> inflight_bytes_{0};
+    std::atomic<int> error_{0};
+
+    std::mutex mutex_;
+    std::condition_variable inflight_condition_;
+    std::condition_variable queue_condition_;
+    std::vector<Buffer*> free_buffers_;
+    std::deque<Buffer*> queue_;
+    bool stop_ = false;
+    std::thread worker_;
+
+#ifdef GP_HAVE_LIBURING
+    struct io_uring ring_;
+    bool use_ring_ = false;
+    std::mutex ring_lock_;
+#endif
+};
+
+}  // namespace GPlayer
+
+#endif  // __GP_ASYNC_FILE_WRITER__
@@ -22,6 +22,11 @@ enum class BeaderType {
     NvVideoEncoder,
     NvVideoDecoder,
     NvJpegDecoder,
+    MjpegDemuxer,
+    RtpPayloader,
+    RtpDepayloader,
+    UdpSrc,
+    MediaServer,
 };
 
 class GPPipeline;
@@ -49,6 +54,10 @@ public:
     virtual bool Attach(const std::shared_ptr<GPPipeline>& pipeline) final;
     virtual bool HasProc() = 0;
     virtual int Proc();
+    // Names the calling thread and applies the pipeline's thread policy for
+    // it; every thread a beader runs calls this before its loop. The kernel
+    // keeps 15 characters of a thread name.
+    virtual void ApplyThreadPolicy(const std::string& thread_name) final;
     // virtual int OnMessage(
     //     const std::shared_ptr<std::pair<char*, size_t>>& message)
     // {
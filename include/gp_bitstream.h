@@ -0,0 +1,93 @@
+#ifndef __GP_BITSTREAM_H__
+#define __GP_BITSTREAM_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace GPlayer {
+
+#define JPEG_MARKER_PREFIX 0xFF
+#define JPEG_MARKER_SOI 0xD8
+#define JPEG_MARKER_EOI 0xD9
+#define JPEG_MARKER_SOS 0xDA
+
+// Returns the offset of the first 0xFF <marker> pair in [data, data + length),
+// or length if there is none. The scan is vectorized with NEON on aarch64 and
+// SSE2 on x86-64, with a scalar fallback elsewhere.
+size_t FindJpegMarker(const uint8_t* data, size_t length, uint8_t marker);
+
+// Returns the offset of the last 0xFF <marker> pair whose both bytes lie in
+// the trailing search_size bytes of [data, data + length), or length if there
+// is none. Used to trim the alignment padding behind an MJPEG frame.
+size_t RFindJpegMarker(const uint8_t* data,
+                       size_t length,
+                       uint8_t marker,
+                       size_t search_size);
+
+enum class GPVideoCodec { H264, H265 };
+
+// Returns the offset of the first Annex-B start code (00 00 01) in
+// [data, data + length), or length if there is none.
+size_t FindStartCode(const uint8_t* data, size_t length);
+
+// NAL unit header helpers; nalu points at the first byte after the start code
+int GetNaluType(GPVideoCodec codec, const uint8_t* nalu);
+bool IsVclNalu(GPVideoCodec codec, int type);
+bool IsKeyframeNalu(GPVideoCodec codec, int type);
+// True for NAL units that may only appear at the start of an access unit
+// (AUD, parameter sets, prefix SEI).
+bool IsAccessUnitPrefixNalu(GPVideoCodec codec, int type);
+// True when a VCL NAL unit is the first slice of a picture; needs the first
+// byte of the slice header.
+bool IsFirstSliceNalu(GPVideoCodec codec, const uint8_t* nalu);
+// True when the first picture in [data, data + length) is a keyframe; only
+// the NAL units up to the first slice are looked at.
+bool HasKeyframeNalu(GPVideoCodec codec, const uint8_t* data, size_t length);
+// True when the frame in [data, data + length) decodes on its own: every
+// MJPEG frame, told by its SOI marker, or an access unit that
+// HasKeyframeNalu() accepts.
+bool IsKeyframe(GPVideoCodec codec, const uint8_t* data, size_t length);
+// Frame rate from the timing info of the first parameter set in
+// [data, data + length) that has one: the SPS VUI for H.264, the VPS for
+// H.265. Returns 0 if there is none.
+double GetFrameRate(GPVideoCodec codec, const uint8_t* data, size_t length);
+
+struct GPAccessUnit {
+    uint64_t offset;  // of the first start code of the access unit
+    uint64_t size;
+    uint64_t index;
+    bool keyframe;
+};
+
+// Incrementally splits an H.264/H.265 Annex-B byte stream into access units.
+// Feed consecutive pieces of the stream with Parse(); each access unit is
+// reported once the start of the next one (or Finish()) has been seen.
+class GPAccessUnitParser {
+public:
+    using Callback = std::function<void(const GPAccessUnit&)>;
+
+    explicit GPAccessUnitParser(GPVideoCodec codec) : codec_(codec) {}
+    void Parse(const uint8_t* data,
+               size_t length,
+               uint64_t offset,
+               const Callback& callback);
+    void Finish(uint64_t end_offset, const Callback& callback);
+    void Reset();
+
+private:
+    void OnNalu(uint64_t offset, const uint8_t* nalu, const Callback& callback);
+
+private:
+    GPVideoCodec codec_;
+    std::vector<uint8_t> carry_;
+    uint64_t next_offset_ = 0;
+    GPAccessUnit current_ = {0, 0, 0, false};
+    bool started_ = false;
+    bool has_vcl_ = false;
+};
+
+}  // namespace GPlayer
+
+#endif  // __GP_BITSTREAM_H__
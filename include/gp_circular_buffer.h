@@ -1,7 +1,9 @@
 #ifndef __GP_CIRCULAR_BUFFER__
 #define __GP_CIRCULAR_BUFFER__
 
+#include <algorithm>
 #include <cstdio>
+#include <cstring>
 #include <memory>
 #include <mutex>
 
@@ -41,6 +43,26 @@ public:
         return to_put;
     }
 
+    // Returns the free space at the head that is contiguous in memory and
+    // its size through length, to be filled in place and published with
+    // commit(). Readers only see committed elements, so the space may be
+    // written without holding their lock; one writer at a time.
+    T* reserve(std::size_t* length)
+    {
+        *length = std::min(max_size_ - size(), max_size_ - head_);
+        return buf_.get() + head_;
+    }
+
+    // Publishes length elements written into the last reservation
+    void commit(std::size_t length)
+    {
+        if (length == 0) {
+            return;
+        }
+        head_ = (head_ + length) % max_size_;
+        full_ = head_ == tail_;
+    }
+
     T get()
     {
         if (empty()) {
@@ -101,18 +123,19 @@ public:
         return to_drop;
     }
 
-    std::size_t snap(T* block, std::size_t length)
+    // Copies up to length elements from offset on without taking them
+    std::size_t snap(T* block, std::size_t length, std::size_t offset = 0)
     {
-        size_t to_snap = std::min(size(), length);
-        size_t to_snap1 = std::min(max_size_ - tail_, to_snap);
-        size_t to_snap2 = to_snap - to_snap1;
-
-        if (empty()) {
+        if (offset >= size()) {
             return 0;
         }
 
-        // Read data and advance the tail
-        std::memcpy(block, buf_.get() + tail_, to_snap1 * sizeof(T));
+        size_t start = (tail_ + offset) % max_size_;
+        size_t to_snap = std::min(size() - offset, length);
+        size_t to_snap1 = std::min(max_size_ - start, to_snap);
+        size_t to_snap2 = to_snap - to_snap1;
+
+        std::memcpy(block, buf_.get() + start, to_snap1 * sizeof(T));
         if (to_snap2 > 0) {
             std::memcpy(block + to_snap1, buf_.get(), to_snap2 * sizeof(T));
         }
@@ -30,11 +30,15 @@ public:
     {
         std::shared_ptr<GPBuffer> newClone =
             std::make_shared<GPBuffer>(data_, length_, true);
+        newClone->pts_ = pts_;
         return newClone;
     }
 
     uint8_t* GetData() const { return data_; }
     uint32_t GetLength() const { return length_; }
+    // Presentation time in microseconds, -1 when unknown
+    int64_t GetPts() const { return pts_; }
+    void SetPts(int64_t pts) { pts_ = pts; }
 
 private:
     GPBuffer();
@@ -43,6 +47,7 @@ private:
     uint8_t* data_;
     uint32_t length_;
     bool cloned_;
+    int64_t pts_ = -1;
 };
 
 class GPEGLImage {
@@ -0,0 +1,80 @@
+#ifndef __GP_FILE_CACHE__
+#define __GP_FILE_CACHE__
+
+#include <sys/types.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gp_bitstream.h"
+
+namespace GPlayer {
+
+// A read-only mapping of a whole file, shared by every GPFileSrc reading the
+// same file. The NAL unit and access unit tables are parsed once and only as
+// far as the readers got, so opening a long recording costs nothing up
+// front; readers keep only their own position.
+class GPMappedFile {
+public:
+    ~GPMappedFile();
+    GPMappedFile(const GPMappedFile&) = delete;
+    GPMappedFile& operator=(const GPMappedFile&) = delete;
+
+    const std::string& GetPath() const { return filepath_; }
+    const uint8_t* GetData() const { return data_; }
+    uint64_t GetSize() const { return size_; }
+    int64_t GetMtime() const { return mtime_; }
+    // The NAL unit starting at or after position, from its start code
+    // (00 00 01) up to the next one; false past the last one
+    bool FindNalUnit(uint64_t position, uint64_t* begin, uint64_t* end);
+    // The access unit starting at or after position; false past the last one
+    bool FindAccessUnit(GPVideoCodec codec,
+                        uint64_t position,
+                        GPAccessUnit* access_unit);
+    // Every access unit of the file, parsing the rest of it first
+    const std::vector<GPAccessUnit>& GetAccessUnits(GPVideoCodec codec);
+
+private:
+    struct AccessUnitTable {
+        std::unique_ptr<GPAccessUnitParser> parser;
+        // Bytes of the file parsed so far
+        uint64_t parsed = 0;
+        std::vector<GPAccessUnit> access_units;
+    };
+
+    friend class GPFileCache;
+    GPMappedFile() = default;
+    // Parses the next piece of the file; false once all of it is parsed
+    bool ParseAccessUnits(GPVideoCodec codec, AccessUnitTable& table);
+
+private:
+    std::string filepath_;
+    const uint8_t* data_ = nullptr;
+    uint64_t size_ = 0;
+    int64_t mtime_ = 0;
+
+    std::mutex mutex_;
+    // Offsets of the start codes found before nal_scanned_
+    std::vector<uint64_t> nal_units_;
+    uint64_t nal_scanned_ = 0;
+    AccessUnitTable access_units_[2];
+};
+
+// Hands out one GPMappedFile per file. A file is unmapped when its last
+// reader lets go of it, and mapped again if it changed on disk since.
+class GPFileCache {
+public:
+    static std::shared_ptr<GPMappedFile> Open(const std::string& filepath);
+
+private:
+    static std::mutex mutex_;
+    static std::map<std::pair<dev_t, ino_t>, std::weak_ptr<GPMappedFile>>
+        files_;
+};
+
+}  // namespace GPlayer
+
+#endif  // __GP_FILE_CACHE__
@@ -0,0 +1,129 @@
+#ifndef __GP_FILE_IO_SERVICE__
+#define __GP_FILE_IO_SERVICE__
+
+#include <sys/types.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <ios>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef GP_HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+namespace GPlayer {
+
+class GPFileIOService;
+
+struct GPFileIOOptions {
+    // Size of each read and of each chunk of the read-ahead ring
+    size_t chunk_size = 512 * 1024;
+    // Chunks kept read ahead of the consumer
+    size_t window = 4;
+};
+
+// A file read through the GPFileIOService. The service keeps a window of
+// chunks ahead of the read position filled, so Read() only copies from
+// memory unless the consumer outruns the storage.
+class GPFileIOStream {
+public:
+    ~GPFileIOStream();
+    GPFileIOStream(const GPFileIOStream&) = delete;
+    GPFileIOStream& operator=(const GPFileIOStream&) = delete;
+
+    // Returns the number of bytes read, 0 at the end of the file or -1 on a
+    // read error
+    std::streamsize Read(char* buffer, std::streamsize count);
+    // Waits for the reads in flight, then restarts the read-ahead at offset
+    void Seek(uint64_t offset);
+    uint64_t Tell() const { return position_; }
+    uint64_t GetSize() const { return size_; }
+    const std::string& GetPath() const { return filepath_; }
+
+private:
+    friend class GPFileIOService;
+
+    struct Chunk {
+        GPFileIOStream* stream;
+        uint8_t* data;
+        uint64_t offset;
+        size_t length;
+        size_t filled;
+        size_t consumed;
+        bool ready;
+    };
+
+    GPFileIOStream() = default;
+
+private:
+    std::shared_ptr<GPFileIOService> service_;
+    std::string filepath_;
+    int fd_ = -1;
+    uint64_t size_ = 0;
+    std::atomic<uint64_t> position_{0};
+
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    // Ring of chunks; count_ of them starting at head_ are read or in flight
+    std::vector<Chunk> chunks_;
+    std::vector<uint8_t> memory_;
+    size_t head_ = 0;
+    size_t count_ = 0;
+    size_t inflight_ = 0;
+    uint64_t next_offset_ = 0;
+    int error_ = 0;
+    bool closing_ = false;
+    bool queued_ = false;
+};
+
+// One I/O thread serving the reads of every GPFileIOStream. Reads are
+// submitted in batches through io_uring when built with liburing; otherwise
+// each stream's free chunks are filled with a single preadv.
+class GPFileIOService : public std::enable_shared_from_this<GPFileIOService> {
+public:
+    static std::shared_ptr<GPFileIOService> GetInstance();
+    ~GPFileIOService();
+
+    std::unique_ptr<GPFileIOStream> Open(const std::string& filepath,
+                                         const GPFileIOOptions& options = {});
+
+private:
+    friend class GPFileIOStream;
+
+    GPFileIOService();
+    void Wake(GPFileIOStream* stream);
+    void Remove(GPFileIOStream* stream);
+    std::vector<GPFileIOStream::Chunk*> Fill(GPFileIOStream* stream);
+    bool Complete(GPFileIOStream::Chunk* chunk, ssize_t result);
+    void ReadProc();
+#ifdef GP_HAVE_LIBURING
+    bool SetupRing();
+    void QueueRead(GPFileIOStream::Chunk* chunk);
+    void ArmWakeup();
+    void RingProc();
+#endif
+
+private:
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    // Streams with free chunks to fill
+    std::deque<GPFileIOStream*> requests_;
+    bool stop_ = false;
+    std::thread worker_;
+
+#ifdef GP_HAVE_LIBURING
+    struct io_uring ring_;
+    bool use_ring_ = false;
+    int wake_fd_ = -1;
+    uint64_t wake_value_ = 0;
+#endif
+};
+
+}  // namespace GPlayer
+
+#endif  // __GP_FILE_IO_SERVICE__
@@ -1,28 +1,37 @@
 #ifndef __GP_FILESINK__
 #define __GP_FILESINK__
 
-#include <fstream>
+#include <memory>
 #include <string>
 
+#include "gp_async_file_writer.h"
 #include "gp_beader.h"
 #include "gp_data.h"
 
 namespace GPlayer {
 
+// Writes everything it receives to a file. Process() only copies into the
+// writer's staging buffers, so the encoder and camera threads that feed the
+// sink do not wait on storage.
 class GPFileSink : public IBeader {
-private:
-    GPFileSink() = delete;
-
 public:
-    GPFileSink(std::string filename);
+    GPFileSink(std::string filename,
+               const GPAsyncFileWriterOptions& options = {});
     ~GPFileSink();
-    std::string GetInfo() const;
+    std::string GetInfo() const override;
     bool HasProc() override { return false; };
-    void Process(GPData* data);
+    virtual void Process(GPData* data);
+
+protected:
+    // For subclasses that open their own files; writer_ starts out empty
+    GPFileSink();
+
+protected:
+    // Closed on destruction if still open
+    std::unique_ptr<GPAsyncFileWriter> writer_;
 
 private:
     std::string filepath_;
-    std::ofstream* outfile_;
 };
 
 }  // namespace GPlayer
@@ -1,29 +1,188 @@
 #ifndef __GP_FILESRC__
 #define __GP_FILESRC__
 
+#include <atomic>
+#include <chrono>
+#include <deque>
 #include <fstream>
+#include <future>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 
 #include "gp_beader.h"
+#include "gp_bitstream.h"
 #include "gp_data.h"
+#include "gp_file_cache.h"
+#include "gp_file_io_service.h"
 
 namespace GPlayer {
 
+struct GPKeyframeIndexEntry {
+    uint64_t offset;
+    uint64_t frame;
+};
+
+enum class GPPacingMode {
+    None,           // data goes out as fast as it is read, no accounting
+    RealTime,       // one access unit per frame period, like a live camera
+    MaxThroughput,  // access units as fast as they are taken, with reports
+};
+
+struct GPPacingStats {
+    uint64_t frames = 0;
+    uint64_t bytes = 0;
+    double seconds = 0;  // since the first access unit
+    double fps = 0;
+    double bitrate = 0;  // bits per second
+    // Access units released more than one frame period after their time
+    uint64_t late_frames = 0;
+    double max_lateness = 0;  // seconds
+};
+
+// Reads a file through the shared GPFileIOService, or with use_mmap through
+// a read-only mapping of the whole file. A mapped source can also hand out
+// views of the file as GPBuffers, so consumers parse the page cache in place
+// and copy only once into their own buffers. Sources mapping the same file
+// share the mapping and its parsed tables through GPFileCache.
+// Further files can be queued behind the first one and the playlist can loop;
+// the files are read back to back as one stream, with the next file opened
+// ahead of time, so the decoder behind the source keeps its session.
 class GPFileSrc : public IBeader {
 private:
     GPFileSrc() = delete;
 
 public:
-    GPFileSrc(std::string filename);
+    GPFileSrc(std::string filename, bool use_mmap = false);
     ~GPFileSrc();
     std::string GetInfo() const;
     bool HasProc() override { return false; };
     void Process(GPData* data);
-    std::basic_istream<char>& Read(char* buffer, std::streamsize count);
+    // Returns the number of bytes read, 0 at the end of the playlist. A read
+    // never spans two files.
+    std::streamsize Read(char* buffer, std::streamsize count);
+
+    // Plays the playlist count times in total, or forever with count 0
+    void SetLoop(bool loop, uint32_t count = 0);
+    void Enqueue(const std::string& filepath);
+    uint64_t GetFileSwitches() const { return file_switches_; }
+
+    bool IsMapped() const { return mapped_; }
+    // Views of up to count bytes at the read position; nullptr at the end of
+    // the file or when the file is not mapped. The data must not be written.
+    std::shared_ptr<GPBuffer> PeekView(size_t count);
+    std::shared_ptr<GPBuffer> ReadView(size_t count);
+    void Skip(size_t count);
+
+    // Builds the keyframe index of an H.264/H.265 elementary stream. The index
+    // is kept next to the file as "<file>.gpidx" and reused while the file's
+    // size and modification time are unchanged. It covers the current file of
+    // the playlist only and is dropped when the next file starts.
+    bool BuildIndex(GPVideoCodec codec);
+    bool HasIndex() const { return indexed_; }
+    uint64_t GetFrameCount() const { return frame_count_; }
+    // Moves the read position to the keyframe at or before frame and returns
+    // that keyframe's frame number through keyframe. Fails for frames before
+    // the first keyframe.
+    bool SeekToFrame(uint64_t frame, uint64_t* keyframe);
+    // Frame rate from the timing info in the parameter sets at the head of
+    // the current file, or 0 if they have none
+    double GetFrameRate(GPVideoCodec codec);
+
+    // Paces ReadAccessUnit(). Elementary streams carry no timestamps, so in
+    // RealTime mode access unit n is released at n / fps after the first.
+    void SetPacing(GPPacingMode mode, double fps = 30.0);
+    GPPacingMode GetPacingMode() const { return pacing_mode_; }
+    GPPacingStats GetPacingStats();
+    // Copies the next complete access unit of an H.264/H.265 stream into
+    // buffer once the pacing mode releases it. Returns its size, 0 at the end
+    // of the playlist or -1 if it does not fit into capacity.
+    std::streamsize ReadAccessUnit(GPVideoCodec codec,
+                                   uint8_t* buffer,
+                                   size_t capacity);
+    // Copies the next NAL unit of a mapped file, including its start code,
+    // into buffer. Returns its size, 0 at the end of the playlist or -1 if it
+    // does not fit into capacity.
+    std::streamsize ReadNalUnit(uint8_t* buffer, size_t capacity);
+
+private:
+    struct Source {
+        std::string path;
+        std::unique_ptr<GPFileIOStream> stream;
+        std::shared_ptr<GPMappedFile> file;
+        std::shared_ptr<const uint8_t> mapping;
+        uint64_t size = 0;
+        uint64_t position = 0;
+        uint64_t advised_end = 0;
+    };
+
+    static std::unique_ptr<Source> OpenSource(const std::string& filepath,
+                                              bool use_mmap);
+    static bool Map(Source& source);
+    static void Advance(Source& source, size_t count);
+    int NextPlaylistIndex() const;
+    void Prefetch();
+    bool SwitchToNext();
+    bool ReadMappedAccessUnit(GPVideoCodec codec,
+                              uint8_t* buffer,
+                              size_t capacity,
+                              std::streamsize* length);
+    void Pace(uint64_t bytes);
+    void ReportPacing();
+    void SetIndex(const std::string& filepath,
+                  uint64_t frame_count,
+                  std::vector<GPKeyframeIndexEntry>&& keyframes);
+    bool LoadIndex(const std::string& filepath,
+                   GPVideoCodec codec,
+                   uint64_t file_size,
+                   int64_t mtime);
+    void SaveIndex(const std::string& filepath,
+                   GPVideoCodec codec,
+                   uint64_t file_size,
+                   int64_t mtime,
+                   uint64_t frame_count,
+                   const std::vector<GPKeyframeIndexEntry>& keyframes);
 
 private:
     std::string filepath_;
-    std::ifstream* inputfile_;
+    bool use_mmap_;
+    std::unique_ptr<Source> source_;
+    std::atomic<bool> mapped_{false};
+    std::mutex mutex_;
+    std::vector<GPKeyframeIndexEntry> keyframes_;
+    uint64_t frame_count_ = 0;
+    bool indexed_ = false;
+
+    std::vector<std::string> playlist_;
+    size_t playlist_index_ = 0;
+    bool loop_ = false;
+    uint32_t loop_count_ = 0;
+    uint32_t loops_done_ = 0;
+    std::future<std::unique_ptr<Source>> next_source_;
+    int prefetch_index_ = -1;
+    std::atomic<uint64_t> file_switches_{0};
+
+    // Access unit reader, used by the consumer thread only
+    std::mutex access_unit_mutex_;
+    std::unique_ptr<GPAccessUnitParser> parser_;
+    GPVideoCodec parser_codec_ = GPVideoCodec::H264;
+    std::vector<uint8_t> pending_;  // stream bytes from pending_offset_ on
+    uint64_t pending_offset_ = 0;
+    uint64_t parsed_offset_ = 0;
+    std::deque<GPAccessUnit> access_units_;
+    bool parser_finished_ = false;
+    // Set by SeekToFrame() to drop what was parsed before the seek
+    std::atomic<bool> parser_reset_{false};
+
+    std::atomic<GPPacingMode> pacing_mode_{GPPacingMode::None};
+    std::chrono::nanoseconds frame_period_{0};
+    std::mutex pacing_mutex_;
+    std::chrono::steady_clock::time_point pacing_start_;
+    std::chrono::steady_clock::time_point pacing_anchor_;
+    std::chrono::steady_clock::time_point last_report_;
+    uint64_t anchor_frames_ = 0;
+    GPPacingStats pacing_stats_;
 };
 
 }  // namespace GPlayer
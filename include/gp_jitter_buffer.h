@@ -0,0 +1,122 @@
+#ifndef __GP_JITTER_BUFFER_H__
+#define __GP_JITTER_BUFFER_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "gp_rtp.h"
+
+namespace GPlayer {
+
+struct GPJitterBufferOptions {
+    // Packets held at most; a sequence number further ahead pushes the
+    // oldest ones out early
+    size_t capacity = 8192;
+    // The delay added to every packet stays within these bounds
+    int64_t min_delay_us = 5000;
+    int64_t max_delay_us = 500000;
+    // The delay aimed for, in multiples of the measured jitter
+    double jitter_factor = 4.0;
+};
+
+struct GPJitterStats {
+    uint64_t packets = 0;
+    // Packets that arrived after their turn had passed
+    uint64_t late = 0;
+    // Packets that had not arrived when their turn came
+    uint64_t lost = 0;
+    uint64_t duplicates = 0;
+    // Malformed packets and the ones held when the stream restarted
+    uint64_t discarded = 0;
+    // RFC 3550 interarrival jitter of the frames
+    int64_t jitter_us = 0;
+    // The delay currently aimed for
+    int64_t target_delay_us = 0;
+    // Time the released packets spent in the buffer
+    int64_t average_delay_us = 0;
+    int64_t max_delay_us = 0;
+};
+
+// Holds RTP packets back so that they leave in sequence order and evenly
+// spaced, however unevenly they came in. A packet is due the target delay
+// after its RTP time on the receiver's clock, or after its arrival if it
+// came later than that; the target follows the measured interarrival
+// jitter, rising at once and falling slowly. A packet still missing when a
+// later one is due is given up on.
+class GPJitterBuffer {
+public:
+    using Callback = std::function<void(const uint8_t* packet, size_t length)>;
+
+    explicit GPJitterBuffer(
+        const GPJitterBufferOptions& options = GPJitterBufferOptions());
+
+    // Takes the packet by swapping it with a vector the buffer no longer
+    // needs, so receive buffers are recycled instead of copied. now_us is
+    // the arrival time on a monotonic clock. Packets are released early
+    // through callback when the buffer is full.
+    void Push(std::vector<uint8_t>& packet,
+              int64_t now_us,
+              const Callback& callback);
+    // Releases the packets due at now_us in sequence order
+    void Pop(int64_t now_us, const Callback& callback);
+    // Releases everything held, in order
+    void Flush(const Callback& callback);
+    // When the next packet is due, or -1 when nothing is held
+    int64_t GetNextDeadline();
+    GPJitterStats GetStats() const;
+
+private:
+    struct Slot {
+        std::vector<uint8_t> packet;
+        int64_t rtp_time_us = 0;
+        int64_t arrival_us = 0;
+        bool used = false;
+    };
+
+    Slot& GetSlot(uint16_t sequence)
+    {
+        return slots_[sequence % slots_.size()];
+    }
+    // The first packet held at or after next_sequence_
+    Slot* FindNext(uint16_t* sequence);
+    int64_t GetDeadline(const Slot& slot) const;
+    void Release(Slot& slot, int64_t now_us, const Callback& callback);
+    void Restart(const GPRtpHeader& header);
+    void UpdateTiming(int64_t rtp_time_us, int64_t now_us);
+
+private:
+    GPJitterBufferOptions options_;
+    std::vector<Slot> slots_;
+    size_t held_ = 0;
+    bool started_ = false;
+    uint32_t ssrc_ = 0;
+    uint16_t next_sequence_ = 0;
+    bool has_released_ = false;
+
+    // The RTP clock unwrapped, in microseconds
+    uint32_t last_timestamp_ = 0;
+    int64_t extended_timestamp_ = 0;
+
+    // Arrival time minus RTP time, as low as it went in the current window
+    // and the one before; the lowest one is taken as the network's fixed
+    // delay and tracks clock drift from window to window
+    int64_t base_transit_us_ = 0;
+    int64_t window_transit_us_ = 0;
+    int64_t window_start_us_ = 0;
+
+    bool has_arrival_ = false;
+    int64_t last_arrival_us_ = 0;
+    int64_t last_rtp_time_us_ = 0;
+    double jitter_us_ = 0;
+    double target_delay_us_ = 0;
+
+    int64_t total_delay_us_ = 0;
+    uint64_t released_ = 0;
+    GPJitterStats stats_;
+};
+
+}  // namespace GPlayer
+
+#endif  // __GP_JITTER_BUFFER_H__
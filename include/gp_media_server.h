@@ -3,25 +3,60 @@
 
 #include <fstream>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include "gp_beader.h"
+#include "gp_bitstream.h"
 #include "gp_data.h"
 #include "gp_message.h"
 
 namespace GPlayer {
 
+struct GPMediaStreamOptions {
+    GPVideoCodec codec = GPVideoCodec::H264;
+    // Bounds of the GOP cache; a GOP that outgrows them is not cached and
+    // viewers joining during it wait for the next keyframe. A joiner gets
+    // the whole cache at once, so max_cache_bytes should stay well below
+    // the clients' send_budget.
+    size_t max_cache_bytes = 8 << 20;
+    size_t max_cache_frames = 300;
+};
+
+struct GPMediaStreamStats {
+    uint64_t frames = 0;
+    uint64_t keyframes = 0;
+    size_t subscribers = 0;
+    size_t cached_frames = 0;
+    size_t cached_bytes = 0;
+    // Viewers that joined, and those among them that found no GOP cached
+    uint64_t joins = 0;
+    uint64_t cache_misses = 0;
+};
+
+// A TCP server for the PlayerMsg protocol that also fans out a live stream.
+// Linked behind GPNvVideoEncoder it gets one access unit per Process() call
+// and keeps the frames since the last keyframe; a subscribing viewer is sent
+// that GOP first, so it decodes at once instead of waiting for the next
+// keyframe, and the live frames after it.
 class GPMediaServer : public net::server_interface<PlayerMsg>, public IBeader {
 private:
     GPMediaServer() = delete;
 
 public:
-    GPMediaServer(uint16_t port);
+    GPMediaServer(
+        uint16_t port,
+        const net::server_options& options = net::server_options(),
+        const GPMediaStreamOptions& stream_options = GPMediaStreamOptions());
     ~GPMediaServer();
     std::string GetInfo() const;
     bool HasProc() override { return true; };
+    // data holds one access unit of the live stream
     void Process(GPData* data);
+    GPMediaStreamStats GetStreamStats();
     std::basic_istream<char>& Read(char* buffer, std::streamsize count);
     int Proc() override;
 
@@ -38,8 +73,39 @@ protected:
     void OnMessage(std::shared_ptr<net::connection<PlayerMsg>> client,
                    net::message<PlayerMsg>& msg) override;
 
+private:
+    using shared_message = std::shared_ptr<const net::message<PlayerMsg>>;
+
+    net::drop_class ClassifyFrame(const uint8_t* data, size_t length) const;
+    void Subscribe(std::shared_ptr<net::connection<PlayerMsg>> client);
+    void Unsubscribe(const std::shared_ptr<net::connection<PlayerMsg>>& client);
+
 private:
     uint16_t port_;
+    GPMediaStreamOptions stream_options_;
+
+    // Guards the cache and the subscribers, so a joiner gets the cache and
+    // then every live frame after it, each exactly once
+    std::mutex stream_mutex_;
+    struct Subscriber {
+        std::shared_ptr<net::connection<PlayerMsg>> client;
+        // Joined without a cached GOP and gets nothing before a keyframe
+        bool waiting_for_keyframe;
+    };
+    std::vector<Subscriber> subscribers_;
+    struct CachedFrame {
+        shared_message msg;
+        net::drop_class drop;
+    };
+    std::vector<CachedFrame> gop_cache_;
+    size_t gop_cache_bytes_ = 0;
+    // The cache holds every frame since the last keyframe
+    bool gop_cached_ = false;
+    uint32_t sequence_ = 0;
+    GPMediaStreamStats stream_stats_;
+
+    // OnMessage() runs on several threads with dispatch_threads
+    std::mutex roster_mutex_;
     std::unordered_map<uint32_t, sPlayerDescription> player_roster_;
     std::vector<uint32_t> garbage_ids_;
 };
@@ -17,9 +17,30 @@ enum class PlayerMsg : uint32_t {
     Game_AddPlayer,
     Game_RemovePlayer,
     Game_UpdatePlayer,
+
+    // Client to server, empty: starts and stops the live stream
+    Stream_Subscribe,
+    Stream_Unsubscribe,
+    // Server to client: sStreamStart, then the cached GOP and live frames
+    Stream_Start,
+    // sStreamFrame followed by one Annex-B access unit
+    Stream_Frame,
 };
 
 struct sPlayerDescription {
 };
 
+struct sStreamStart {
+    uint32_t codec;  // GPVideoCodec
+    // Frames that follow from the cache, starting with a keyframe; 0 when
+    // the stream has to wait for the next keyframe
+    uint32_t cached_frames;
+};
+
+struct sStreamFrame {
+    int64_t pts;  // microseconds, -1 when unknown
+    uint32_t keyframe;
+    uint32_t sequence;  // counts the frames of the stream
+};
+
 #endif  // __GP_MESSAGE_H__
\ No newline at end of file
@@ -0,0 +1,46 @@
+#ifndef __GP_MJPEG_DEMUXER__
+#define __GP_MJPEG_DEMUXER__
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "gp_beader.h"
+#include "gp_data.h"
+
+namespace GPlayer {
+
+// Splits a concatenated or multipart (multipart/x-mixed-replace) MJPEG byte
+// stream into complete JPEG frames and hands each frame to the linked
+// GPNvJpegDecoder. Bytes may arrive in arbitrary pieces through Process()
+// (camera, network), or be pulled from a parent GPFileSrc in Proc().
+class GPMjpegDemuxer : public IBeader {
+public:
+    explicit GPMjpegDemuxer(size_t max_frame_size = 16 * 1024 * 1024);
+    ~GPMjpegDemuxer();
+    std::string GetInfo() const override;
+    bool HasProc() override;
+    int Proc() override;
+    void Process(GPData* data);
+    uint64_t GetFrameCount() const { return frame_count_; }
+    uint64_t GetDroppedBytes() const { return dropped_bytes_; }
+
+private:
+    size_t GetJoinLength(const uint8_t* data, size_t length);
+    size_t Demux(uint8_t* data, size_t length);
+    size_t FindFrameEnd(const uint8_t* data, size_t length);
+    void PushFrame(uint8_t* data, size_t length);
+
+private:
+    // The start of a frame that did not end in the last buffer
+    std::vector<uint8_t> pending_;
+    size_t scan_offset_ = 0;
+    const size_t max_frame_size_;
+    uint64_t frame_count_ = 0;
+    uint64_t dropped_bytes_ = 0;
+    std::mutex mutex_;
+};
+
+}  // namespace GPlayer
+
+#endif  // __GP_MJPEG_DEMUXER__
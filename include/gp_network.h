@@ -3,14 +3,18 @@
 #define __GP_NETWORK_H__
 
 #include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
 #include <cstdint>
+#include <cstring>
 #include <deque>
 #include <iostream>
 #include <memory>
 #include <mutex>
 #include <optional>
 #include <thread>
+#include <type_traits>
 #include <vector>
 
 #include <asio.hpp>
@@ -33,6 +37,9 @@ struct message {
 
     size_t size() const { return body.size(); }
 
+    // Makes room for size bytes of body, so pushes do not reallocate
+    void reserve(size_t size) { body.reserve(size); }
+
     friend std::ostream& operator<<(std::ostream& os, const message<T>& msg)
     {
         os << "ID:" << int(msg.header.id) << " Size:" << msg.header.size;
@@ -45,17 +52,16 @@ struct message {
         static_assert(std::is_standard_layout<DataType>::value,
                       "Data is too complex to be pushed into vector");
 
-        size_t i = msg.body.size();
-
-        msg.body.resize(msg.body.size() + sizeof(DataType));
-
-        std::memcpy(msg.body.data() + i, &data, sizeof(DataType));
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&data);
+        msg.body.insert(msg.body.end(), bytes, bytes + sizeof(DataType));
 
         msg.header.size = msg.size();
 
         return msg;
     }
 
+    // Pops from the end, so values come out in reverse; message_reader
+    // reads them in the order they were pushed
     template <typename DataType>
     friend message<T>& operator>>(message<T>& msg, DataType& data)
     {
@@ -74,6 +80,184 @@ struct message {
     }
 };
 
+// Builds a message in a body reserved up front, typically one taken from a
+// connection's body_pool with connection::NewMessage()
+template <typename T>
+class message_builder {
+public:
+    explicit message_builder(T id, size_t capacity = 0)
+    {
+        msg_.header.id = id;
+        msg_.body.reserve(capacity);
+    }
+
+    message_builder(T id, std::vector<uint8_t>&& body)
+    {
+        msg_.header.id = id;
+        msg_.body = std::move(body);
+        msg_.body.clear();
+    }
+
+    template <typename DataType>
+    message_builder& operator<<(const DataType& data)
+    {
+        static_assert(std::is_standard_layout<DataType>::value,
+                      "Data is too complex to be pushed into vector");
+
+        return Append(&data, sizeof(DataType));
+    }
+
+    message_builder& Append(const void* data, size_t size)
+    {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        msg_.body.insert(msg_.body.end(), bytes, bytes + size);
+        return *this;
+    }
+
+    size_t size() const { return msg_.body.size(); }
+
+    // Leaves the builder empty
+    message<T> Build()
+    {
+        msg_.header.size = msg_.body.size();
+        return std::move(msg_);
+    }
+
+private:
+    message<T> msg_;
+};
+
+// Reads a message body front to back, in the order it was built. A read
+// past the end fails, leaves its target alone and fails the reader.
+template <typename T>
+class message_reader {
+public:
+    explicit message_reader(const message<T>& msg) : msg_(msg) {}
+
+    template <typename DataType>
+    message_reader& operator>>(DataType& data)
+    {
+        static_assert(std::is_standard_layout<DataType>::value,
+                      "Data is too complex to be pulled from vector");
+
+        Read(&data, sizeof(DataType));
+        return *this;
+    }
+
+    bool Read(void* data, size_t size)
+    {
+        if (!good_ || size > remaining()) {
+            good_ = false;
+            return false;
+        }
+        std::memcpy(data, msg_.body.data() + offset_, size);
+        offset_ += size;
+        return true;
+    }
+
+    size_t remaining() const { return msg_.body.size() - offset_; }
+    explicit operator bool() const { return good_; }
+
+private:
+    const message<T>& msg_;
+    size_t offset_ = 0;
+    bool good_ = true;
+};
+
+// Message bodies kept for reuse. A connection reads into bodies from its
+// pool and takes them back once the message was dispatched or sent, so in
+// steady state bodies are not allocated at all.
+class body_pool {
+public:
+    static constexpr size_t kMaxBodies = 32;
+    // Bodies above this size are freed rather than kept
+    static constexpr size_t kMaxCapacity = 4 << 20;
+
+    body_pool() { bodies_.reserve(kMaxBodies); }
+    body_pool(const body_pool&) = delete;
+
+    // An empty body with room for capacity bytes; the smallest pooled body
+    // that fits, else the largest to grow
+    std::vector<uint8_t> Acquire(size_t capacity)
+    {
+        std::vector<uint8_t> body;
+        {
+            std::scoped_lock lock(mutex_);
+            size_t best = bodies_.size();
+            for (size_t i = 0; i < bodies_.size(); i++) {
+                if (best == bodies_.size() || Better(bodies_[i].capacity(),
+                                                     bodies_[best].capacity(),
+                                                     capacity)) {
+                    best = i;
+                }
+            }
+            if (best < bodies_.size()) {
+                std::swap(bodies_[best], bodies_.back());
+                body = std::move(bodies_.back());
+                bodies_.pop_back();
+            }
+        }
+        body.clear();
+        body.reserve(capacity);
+        return body;
+    }
+
+    void Release(std::vector<uint8_t>&& body)
+    {
+        if (body.capacity() == 0 || body.capacity() > kMaxCapacity) {
+            return;
+        }
+        std::scoped_lock lock(mutex_);
+        if (bodies_.size() < kMaxBodies) {
+            bodies_.push_back(std::move(body));
+        }
+    }
+
+private:
+    static bool Better(size_t size, size_t best, size_t wanted)
+    {
+        if (best < wanted) {
+            return size > best;
+        }
+        return size >= wanted && size < best;
+    }
+
+private:
+    std::mutex mutex_;
+    std::vector<std::vector<uint8_t>> bodies_;
+};
+
+// How a queued message may be dropped when its connection falls behind
+enum class drop_class {
+    never,       // control messages
+    keyframe,    // a frame decodable on its own; streams resume on one
+    reference,   // a frame that later frames refer to
+    disposable,  // a frame nothing refers to; dropped first
+};
+
+// What one connection may hold in its send queue. Past either limit the
+// oldest disposable frames are dropped; if that is not enough, the frames
+// before the newest queued keyframe, and if there is none, every queued
+// frame, after which frames are skipped until the next keyframe.
+// Messages that are never dropped count but are always queued.
+struct send_budget {
+    size_t max_bytes = 16 << 20;
+    size_t max_messages = 4096;
+};
+
+// Per connection, since it was opened
+struct send_stats {
+    uint64_t messages_sent = 0;
+    uint64_t bytes_sent = 0;
+    uint64_t messages_dropped = 0;
+    uint64_t bytes_dropped = 0;
+    // Times the connection fell so far behind that it had to wait for a
+    // keyframe
+    uint64_t keyframe_waits = 0;
+    size_t queued_messages = 0;
+    size_t queued_bytes = 0;
+};
+
 // Forward declare the connection
 template <typename T>
 class connection;
@@ -137,6 +321,15 @@ public:
         cv_blocking_.notify_one();
     }
 
+    void push_back(T&& item)
+    {
+        std::scoped_lock lock(mux_queue_);
+        deq_queue_.emplace_back(std::move(item));
+
+        std::unique_lock<std::mutex> ul(mux_blocking_);
+        cv_blocking_.notify_one();
+    }
+
     void push_front(const T& item)
     {
         std::scoped_lock lock(mux_queue_);
@@ -198,6 +391,7 @@ public:
           messages_in_(message_in)
     {
         owner_type_ = parent;
+        open_ = socket_.is_open();
 
         if (owner_type_ == owner::server) {
             handshake_out_ = uint64_t(
@@ -215,6 +409,55 @@ public:
 
     uint32_t GetID() const { return id_; }
 
+    // With several io_context threads a server socket's executor is the
+    // connection's strand, so its handlers never run concurrently
+    asio::any_io_executor GetExecutor() { return socket_.get_executor(); }
+
+    // OnMessage() calls for this connection are serialised on the strand
+    void SetDispatchStrand(
+        const asio::strand<asio::thread_pool::executor_type>& strand)
+    {
+        dispatch_strand_.emplace(strand);
+    }
+
+    std::optional<asio::strand<asio::thread_pool::executor_type>>&
+    GetDispatchStrand()
+    {
+        return dispatch_strand_;
+    }
+
+    // A message to Send() on this connection, built in a pooled body
+    message_builder<T> NewMessage(T id, size_t capacity = 0)
+    {
+        return message_builder<T>(id, body_pool_.Acquire(capacity));
+    }
+
+    // Hands the body of a message read from this connection back to the
+    // pool once it is no longer needed; may be called from any thread
+    void Recycle(message<T>&& msg) { body_pool_.Release(std::move(msg.body)); }
+
+    // Takes effect for the messages queued from then on
+    void SetSendBudget(const send_budget& budget)
+    {
+        max_queued_bytes_ = budget.max_bytes;
+        max_queued_messages_ = budget.max_messages;
+    }
+
+    send_stats GetSendStats() const
+    {
+        send_stats stats;
+        stats.messages_sent = messages_sent_.load(std::memory_order_relaxed);
+        stats.bytes_sent = bytes_sent_.load(std::memory_order_relaxed);
+        stats.messages_dropped =
+            messages_dropped_.load(std::memory_order_relaxed);
+        stats.bytes_dropped = bytes_dropped_.load(std::memory_order_relaxed);
+        stats.keyframe_waits = keyframe_waits_.load(std::memory_order_relaxed);
+        stats.queued_messages =
+            queued_messages_.load(std::memory_order_relaxed);
+        stats.queued_bytes = queued_bytes_.load(std::memory_order_relaxed);
+        return stats;
+    }
+
 public:
     void ConnectToClient(net::server_interface<T>* server, uint32_t uid = 0)
     {
@@ -234,8 +477,11 @@ public:
         if (owner_type_ == owner::client) {
             asio::async_connect(
                 socket_, endpoints,
-                [this](std::error_code ec, asio::ip::tcp::endpoint endpoint) {
+                [this, self = this->shared_from_this()](
+                    std::error_code ec, asio::ip::tcp::endpoint endpoint) {
                     if (!ec) {
+                        open_ = true;
+
                         // Was: ReadHeader();
 
                         // First thing server will do is send packet to be
@@ -249,69 +495,214 @@ public:
     void Disconnect()
     {
         if (IsConnected())
-            asio::post(io_context_, [this]() { socket_.close(); });
+            asio::post(GetExecutor(),
+                       [this, self = this->shared_from_this()]() { Close(); });
     }
 
-    bool IsConnected() const { return socket_.is_open(); }
+    // May be called from any thread; the socket itself is only touched on
+    // the connection's executor
+    bool IsConnected() const { return open_; }
 
     void StartListening() {}
 
 public:
-    void Send(const message<T>& msg)
+    // Pass the message with std::move() to hand its body over uncopied;
+    // once written the body goes to this connection's pool
+    void Send(message<T> msg, drop_class drop = drop_class::never)
+    {
+        asio::post(GetExecutor(),
+                   [this, self = this->shared_from_this(), msg = std::move(msg),
+                    drop]() mutable {
+                       Queue({std::move(msg), nullptr, drop});
+                   });
+    }
+
+    // The message is only read, so one may be queued on many connections
+    void Send(std::shared_ptr<const message<T>> msg,
+              drop_class drop = drop_class::never)
     {
-        asio::post(io_context_, [this, msg]() {
-            bool writingMessage = !messages_out_.empty();
-            messages_out_.push_back(msg);
-            if (!writingMessage) {
-                WriteHeader();
+        asio::post(GetExecutor(),
+                   [this, self = this->shared_from_this(), msg = std::move(msg),
+                    drop]() mutable {
+                       Queue({message<T>(), std::move(msg), drop});
+                   });
+    }
+
+private:
+    // A message waiting to be written: owned when it was sent to this
+    // connection alone, shared when it was broadcast
+    struct outgoing_message {
+        message<T> owned;
+        std::shared_ptr<const message<T>> shared;
+        drop_class drop = drop_class::never;
+
+        const message<T>& get() const { return shared ? *shared : owned; }
+        size_t bytes() const
+        {
+            return sizeof(message_header<T>) + get().body.size();
+        }
+    };
+
+    void Queue(outgoing_message&& msg)
+    {
+        if (waiting_for_keyframe_ && msg.drop != drop_class::never) {
+            if (msg.drop != drop_class::keyframe) {
+                Drop(msg);
+                return;
             }
+            waiting_for_keyframe_ = false;
+        }
+
+        queued_messages_++;
+        queued_bytes_ += msg.bytes();
+        messages_out_.push_back(std::move(msg));
+        if (OverBudget()) {
+            // The messages of a write in flight are out of reach
+            Shed(writing_ ? write_count_ : 0);
+        }
+
+        // Shedding may have left nothing to send
+        if (!writing_ && !messages_out_.empty()) {
+            Write();
+        }
+    }
+
+    bool OverBudget() const
+    {
+        return queued_bytes_ > max_queued_bytes_ ||
+               queued_messages_ > max_queued_messages_;
+    }
+
+    // Drops queued messages from first on until the queue fits the budget
+    void Shed(size_t first)
+    {
+        // Stale disposable frames, oldest first
+        DropWhile(first, [this](const outgoing_message& out, size_t) {
+            return OverBudget() && out.drop == drop_class::disposable;
+        });
+        if (!OverBudget()) {
+            return;
+        }
+
+        // Everything the newest keyframe makes obsolete
+        size_t keyframe = messages_out_.size();
+        for (size_t i = messages_out_.size(); i-- > first;) {
+            if (messages_out_[i].drop == drop_class::keyframe) {
+                keyframe = i;
+                break;
+            }
+        }
+        if (keyframe < messages_out_.size()) {
+            DropWhile(first, [keyframe](const outgoing_message& out,
+                                        size_t index) {
+                return index < keyframe && out.drop != drop_class::never;
+            });
+            if (!OverBudget()) {
+                return;
+            }
+        }
+
+        // Too far behind for any queued frame to matter
+        DropWhile(first, [](const outgoing_message& out, size_t) {
+            return out.drop != drop_class::never;
         });
+        waiting_for_keyframe_ = true;
+        keyframe_waits_++;
     }
 
-private:
-    void WriteHeader()
+    // Drops the messages from first on that drop(message, index) picks,
+    // in queue order, keeping the others in order
+    template <typename Predicate>
+    void DropWhile(size_t first, Predicate drop)
     {
-        asio::async_write(socket_,
-                          asio::buffer(&messages_out_.front().header,
-                                       sizeof(message_header<T>)),
-                          [this](std::error_code ec, std::size_t length) {
-                              if (!ec) {
-                                  if (messages_out_.front().body.size() > 0) {
-                                      WriteBody();
-                                  }
-                                  else {
-                                      messages_out_.pop_front();
-                                      if (!messages_out_.empty()) {
-                                          WriteHeader();
-                                      }
-                                  }
-                              }
-                              else {
-                                  std::cout << "[" << id_
-                                            << "] Write Header Fail.\n";
-                                  socket_.close();
-                              }
-                          });
+        size_t kept = first;
+        for (size_t i = first; i < messages_out_.size(); i++) {
+            if (drop(messages_out_[i], i)) {
+                queued_messages_--;
+                queued_bytes_ -= messages_out_[i].bytes();
+                Drop(messages_out_[i]);
+            }
+            else {
+                if (kept != i) {
+                    messages_out_[kept] = std::move(messages_out_[i]);
+                }
+                kept++;
+            }
+        }
+        messages_out_.erase(messages_out_.begin() + kept, messages_out_.end());
     }
 
-    void WriteBody()
+    void Drop(outgoing_message& out)
     {
-        asio::async_write(socket_,
-                          asio::buffer(messages_out_.front().body.data(),
-                                       messages_out_.front().body.size()),
-                          [this](std::error_code ec, std::size_t length) {
-                              if (!ec) {
-                                  messages_out_.pop_front();
-                                  if (!messages_out_.empty()) {
-                                      WriteHeader();
-                                  }
-                              }
-                              else {
-                                  std::cout << "[" << id_
-                                            << "] Write Body Fail.\n";
-                                  socket_.close();
-                              }
-                          });
+        messages_dropped_++;
+        bytes_dropped_ += out.bytes();
+        body_pool_.Release(std::move(out.owned.body));
+        out.shared.reset();
+    }
+
+    // write_buffers_ as a buffer sequence; async_write() copies the
+    // sequence it is given, and copying the vector would allocate
+    struct write_buffer_view {
+        using value_type = asio::const_buffer;
+        using const_iterator = const asio::const_buffer*;
+
+        const asio::const_buffer* begin() const { return first; }
+        const asio::const_buffer* end() const { return last; }
+
+        const asio::const_buffer* first;
+        const asio::const_buffer* last;
+    };
+
+    // Everything queued by now, up to kMaxWriteBatch messages, goes out
+    // with one gathered write of headers and bodies
+    void Write()
+    {
+        writing_ = true;
+        write_buffers_.clear();
+        write_count_ = 0;
+        for (const auto& out : messages_out_) {
+            if (write_count_ == kMaxWriteBatch) {
+                break;
+            }
+            const message<T>& msg = out.get();
+            write_buffers_.emplace_back(&msg.header, sizeof(message_header<T>));
+            if (!msg.body.empty()) {
+                write_buffers_.emplace_back(msg.body.data(), msg.body.size());
+            }
+            write_count_++;
+        }
+
+        asio::async_write(
+            socket_,
+            write_buffer_view{write_buffers_.data(),
+                              write_buffers_.data() + write_buffers_.size()},
+            [this, self = this->shared_from_this()](std::error_code ec,
+                                                    std::size_t length) {
+                if (!ec) {
+                    for (size_t i = 0; i < write_count_; i++) {
+                        size_t bytes = messages_out_[i].bytes();
+                        messages_sent_++;
+                        bytes_sent_ += bytes;
+                        queued_messages_--;
+                        queued_bytes_ -= bytes;
+                        body_pool_.Release(
+                            std::move(messages_out_[i].owned.body));
+                    }
+                    messages_out_.erase(messages_out_.begin(),
+                                        messages_out_.begin() + write_count_);
+                    if (!messages_out_.empty()) {
+                        Write();
+                    }
+                    else {
+                        writing_ = false;
+                    }
+                }
+                else {
+                    writing_ = false;
+                    std::cout << "[" << id_ << "] Write Fail.\n";
+                    Close();
+                }
+            });
     }
 
     void ReadHeader()
@@ -319,9 +710,12 @@ private:
         asio::async_read(
             socket_,
             asio::buffer(&temporary_msg_in_.header, sizeof(message_header<T>)),
-            [this](std::error_code ec, std::size_t length) {
+            [this, self = this->shared_from_this()](std::error_code ec,
+                                                    std::size_t length) {
                 if (!ec) {
                     if (temporary_msg_in_.header.size > 0) {
+                        temporary_msg_in_.body =
+                            body_pool_.Acquire(temporary_msg_in_.header.size);
                         temporary_msg_in_.body.resize(
                             temporary_msg_in_.header.size);
                         ReadBody();
@@ -332,7 +726,7 @@ private:
                 }
                 else {
                     std::cout << "[" << id_ << "] Read Header Fail.\n";
-                    socket_.close();
+                    Close();
                 }
             });
     }
@@ -342,18 +736,25 @@ private:
         asio::async_read(socket_,
                          asio::buffer(temporary_msg_in_.body.data(),
                                       temporary_msg_in_.body.size()),
-                         [this](std::error_code ec, std::size_t length) {
+                         [this, self = this->shared_from_this()](
+                             std::error_code ec, std::size_t length) {
                              if (!ec) {
                                  AddToIncomingMessageQueue();
                              }
                              else {
                                  std::cout << "[" << id_
                                            << "] Read Body Fail.\n";
-                                 socket_.close();
+                                 Close();
                              }
                          });
     }
 
+    void Close()
+    {
+        open_ = false;
+        socket_.close();
+    }
+
     // "Encrypt" data
     uint64_t scramble(uint64_t nInput)
     {
@@ -366,13 +767,14 @@ private:
     {
         asio::async_write(socket_,
                           asio::buffer(&handshake_out_, sizeof(uint64_t)),
-                          [this](std::error_code ec, std::size_t length) {
+                          [this, self = this->shared_from_this()](
+                              std::error_code ec, std::size_t length) {
                               if (!ec) {
                                   if (owner_type_ == owner::client)
                                       ReadHeader();
                               }
                               else {
-                                  socket_.close();
+                                  Close();
                               }
                           });
     }
@@ -381,11 +783,13 @@ private:
     {
         asio::async_read(
             socket_, asio::buffer(&handshake_in_, sizeof(uint64_t)),
-            [this, server](std::error_code ec, std::size_t length) {
+            [this, self = this->shared_from_this(), server](
+                std::error_code ec, std::size_t length) {
                 if (!ec) {
                     if (owner_type_ == owner::server) {
                         if (handshake_in_ == handshake_check_) {
                             std::cout << "Client Validated" << std::endl;
+                            server_ = server;
                             server->OnClientValidated(this->shared_from_this());
 
                             ReadHeader();
@@ -393,7 +797,7 @@ private:
                         else {
                             std::cout << "Client Disconnected (Fail Validation)"
                                       << std::endl;
-                            socket_.close();
+                            Close();
                         }
                     }
                     else {
@@ -405,29 +809,60 @@ private:
                 else {
                     std::cout << "Client Disconnected (ReadValidation)"
                               << std::endl;
-                    socket_.close();
+                    Close();
                 }
             });
     }
 
+    // The body is moved on and comes back through Recycle(); ReadHeader()
+    // takes the next one from the pool
     void AddToIncomingMessageQueue()
     {
         if (owner_type_ == owner::server)
-            messages_in_.push_back(
-                {this->shared_from_this(), temporary_msg_in_});
+            server_->Deliver(
+                {this->shared_from_this(), std::move(temporary_msg_in_)});
         else
-            messages_in_.push_back({nullptr, temporary_msg_in_});
+            messages_in_.push_back({nullptr, std::move(temporary_msg_in_)});
+        temporary_msg_in_.body.clear();
 
         ReadHeader();
     }
 
 protected:
+    // Two buffers per message stay within the iovec count asio passes to a
+    // single writev()
+    static constexpr size_t kMaxWriteBatch = 32;
+
     asio::ip::tcp::socket socket_;
+    // Whether socket_ is open, readable off the connection's executor
+    std::atomic<bool> open_{false};
     asio::io_context& io_context_;
-    tsqueue<message<T>> messages_out_;
+    // Only touched on the io_context thread
+    std::deque<outgoing_message> messages_out_;
+    std::vector<asio::const_buffer> write_buffers_;
+    size_t write_count_ = 0;
+    // An async_write() is in flight; write_buffers_ and the first
+    // write_count_ messages belong to it until it completes
+    bool writing_ = false;
     tsqueue<owned_message<T>>& messages_in_;
     message<T> temporary_msg_in_;
+    body_pool body_pool_;
     owner owner_type_ = owner::server;
+    server_interface<T>* server_ = nullptr;
+    std::optional<asio::strand<asio::thread_pool::executor_type>>
+        dispatch_strand_;
+
+    // Send budget; the counters are written on the io_context thread only
+    size_t max_queued_bytes_ = send_budget().max_bytes;
+    size_t max_queued_messages_ = send_budget().max_messages;
+    bool waiting_for_keyframe_ = false;
+    std::atomic<size_t> queued_messages_{0};
+    std::atomic<size_t> queued_bytes_{0};
+    std::atomic<uint64_t> messages_sent_{0};
+    std::atomic<uint64_t> bytes_sent_{0};
+    std::atomic<uint64_t> messages_dropped_{0};
+    std::atomic<uint64_t> bytes_dropped_{0};
+    std::atomic<uint64_t> keyframe_waits_{0};
 
     // Handshake Validation
     uint64_t handshake_out_ = 0;
@@ -455,7 +890,7 @@ public:
             asio::ip::tcp::resolver::results_type endpoints =
                 resolver.resolve(host, std::to_string(port));
 
-            connection_ = std::make_unique<connection<T>>(
+            connection_ = std::make_shared<connection<T>>(
                 connection<T>::owner::client, io_context_,
                 asio::ip::tcp::socket(io_context_), messages_in_);
 
@@ -480,7 +915,7 @@ public:
         if (thread_context_.joinable())
             thread_context_.join();
 
-        connection_.release();
+        connection_.reset();
     }
 
     bool IsConnected()
@@ -492,31 +927,80 @@ public:
     }
 
 public:
-    void Send(const message<T>& msg)
+    void Send(message<T> msg)
     {
         if (IsConnected())
-            connection_->Send(msg);
+            connection_->Send(std::move(msg));
     }
 
     tsqueue<owned_message<T>>& Incoming() { return messages_in_; }
 
+    // A message to Send(), built in a pooled body
+    message_builder<T> NewMessage(T id, size_t capacity = 0)
+    {
+        if (connection_)
+            return connection_->NewMessage(id, capacity);
+        return message_builder<T>(id, capacity);
+    }
+
+    // Hands the body of a message taken from Incoming() back for reuse
+    void Recycle(message<T>&& msg)
+    {
+        if (connection_)
+            connection_->Recycle(std::move(msg));
+    }
+
 protected:
     asio::io_context io_context_;
     std::thread thread_context_;
-    std::unique_ptr<connection<T>> connection_;
+    std::shared_ptr<connection<T>> connection_;
 
 private:
     tsqueue<owned_message<T>> messages_in_;
 };
 
 // Server
+struct server_options {
+    // Threads running the io_context; with more than one every connection
+    // gets a strand, so its handlers stay serialised
+    size_t io_threads = 1;
+    // Listening sockets bound to the port with SO_REUSEPORT; the kernel
+    // spreads incoming connections across them
+    size_t acceptors = 1;
+    // Threads calling OnMessage(), in order per connection and in parallel
+    // across connections. 0 leaves the messages to Update().
+    size_t dispatch_threads = 0;
+    // Send queue limits of every client
+    send_budget client_budget;
+};
+
 template <typename T>
 class server_interface {
 public:
-    server_interface(uint16_t port)
-        : asio_acceptor_(io_context_,
-                         asio::ip::tcp::endpoint(asio::ip::tcp::v4(), port))
+    server_interface(uint16_t port,
+                     const server_options& options = server_options())
+        : options_(options)
     {
+        using reuse_port =
+            asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+
+        asio::ip::tcp::endpoint endpoint(asio::ip::tcp::v4(), port);
+        for (size_t i = 0; i < std::max<size_t>(1, options_.acceptors); i++) {
+            asio_acceptors_.emplace_back(io_context_);
+            asio::ip::tcp::acceptor& acceptor = asio_acceptors_.back();
+            acceptor.open(endpoint.protocol());
+            acceptor.set_option(asio::socket_base::reuse_address(true));
+            if (options_.acceptors > 1) {
+                acceptor.set_option(reuse_port(true));
+            }
+            acceptor.bind(endpoint);
+            acceptor.listen();
+        }
+
+        if (options_.dispatch_threads > 0) {
+            dispatch_pool_ =
+                std::make_unique<asio::thread_pool>(options_.dispatch_threads);
+        }
     }
 
     virtual ~server_interface() { Stop(); }
@@ -524,9 +1008,14 @@ public:
     bool Start()
     {
         try {
-            WaitForClientConnection();
+            for (auto& acceptor : asio_acceptors_) {
+                WaitForClientConnection(acceptor);
+            }
 
-            thread_context_ = std::thread([this]() { io_context_.run(); });
+            for (size_t i = 0; i < std::max<size_t>(1, options_.io_threads);
+                 i++) {
+                thread_contexts_.emplace_back([this]() { io_context_.run(); });
+            }
         }
         catch (std::exception& e) {
             // Something prohibited the server from listening
@@ -542,15 +1031,27 @@ public:
     {
         io_context_.stop();
 
-        if (thread_context_.joinable())
-            thread_context_.join();
+        for (auto& thread : thread_contexts_) {
+            if (thread.joinable())
+                thread.join();
+        }
+        thread_contexts_.clear();
+
+        if (dispatch_pool_) {
+            dispatch_pool_->join();
+        }
+
+        // Sockets must go before the io_context they belong to
+        std::scoped_lock lock(mux_connections_);
+        deq_connections_.clear();
+        messages_in_.clear();
 
         std::cout << "[SERVER] Stopped!\n";
     }
 
-    void WaitForClientConnection()
+    void WaitForClientConnection(asio::ip::tcp::acceptor& acceptor)
     {
-        asio_acceptor_.async_accept([this](std::error_code ec,
+        auto on_accept = [this, &acceptor](std::error_code ec,
                                            asio::ip::tcp::socket socket) {
             if (!ec) {
                 std::cout << "[SERVER] New Connection: "
@@ -562,38 +1063,58 @@ public:
                         std::move(socket), messages_in_);
 
                 if (OnClientConnect(newconn)) {
-                    deq_connections_.push_back(std::move(newconn));
+                    newconn->SetSendBudget(options_.client_budget);
+                    if (dispatch_pool_) {
+                        newconn->SetDispatchStrand(
+                            asio::make_strand(*dispatch_pool_));
+                    }
+                    {
+                        std::scoped_lock lock(mux_connections_);
+                        deq_connections_.push_back(newconn);
+                    }
 
-                    deq_connections_.back()->ConnectToClient(this,
-                                                             id_counter_++);
+                    uint32_t id = id_counter_++;
+                    asio::post(newconn->GetExecutor(), [this, newconn, id]() {
+                        newconn->ConnectToClient(this, id);
+                    });
 
-                    std::cout << "[" << deq_connections_.back()->GetID()
-                              << "] Connection Approved\n";
+                    std::cout << "[" << id << "] Connection Approved\n";
                 }
                 else {
                     std::cout << "[-----] Connection Denied\n";
                 }
             }
             else {
-                std::cout << "[SERVER] New Connection Error: " << ec.message()
-                          << "\n";
+                std::cout << "[SERVER] New Connection Error: "
+                          << ec.message() << "\n";
             }
 
-            WaitForClientConnection();
-        });
+            WaitForClientConnection(acceptor);
+        };
+
+        // A lone io thread never runs two handlers at once; the strand, and
+        // the executor wrapping it costs on every operation, is only needed
+        // with several
+        if (options_.io_threads > 1) {
+            acceptor.async_accept(asio::make_strand(io_context_),
+                                  std::move(on_accept));
+        }
+        else {
+            acceptor.async_accept(io_context_, std::move(on_accept));
+        }
     }
 
     void MessageClient(std::shared_ptr<connection<T>> client,
-                       const message<T>& msg)
+                       message<T> msg,
+                       drop_class drop = drop_class::never)
     {
         if (client && client->IsConnected()) {
-            client->Send(msg);
+            client->Send(std::move(msg), drop);
         }
         else {
             OnClientDisconnect(client);
 
-            client.reset();
-
+            std::scoped_lock lock(mux_connections_);
             deq_connections_.erase(std::remove(deq_connections_.begin(),
                                                deq_connections_.end(), client),
                                    deq_connections_.end());
@@ -601,28 +1122,46 @@ public:
     }
 
     void MessageAllClients(
-        const message<T>& msg,
-        std::shared_ptr<connection<T>> pIgnoreClient = nullptr)
+        message<T> msg,
+        std::shared_ptr<connection<T>> pIgnoreClient = nullptr,
+        drop_class drop = drop_class::never)
     {
-        bool bInvalidClientExists = false;
+        MessageAllClients(std::make_shared<const message<T>>(std::move(msg)),
+                          pIgnoreClient, drop);
+    }
 
-        for (auto& client : deq_connections_) {
-            if (client && client->IsConnected()) {
-                if (client != pIgnoreClient)
-                    client->Send(msg);
+    // Every client queues the same immutable message; a broadcast costs one
+    // queue entry and one write per client, never a copy of the body.
+    // Every client drops frames against its own budget, so a slow one
+    // does not hold back the others.
+    void MessageAllClients(
+        std::shared_ptr<const message<T>> msg,
+        std::shared_ptr<connection<T>> pIgnoreClient = nullptr,
+        drop_class drop = drop_class::never)
+    {
+        std::vector<std::shared_ptr<connection<T>>> invalidClients;
+        {
+            std::scoped_lock lock(mux_connections_);
+            for (auto& client : deq_connections_) {
+                if (client && client->IsConnected()) {
+                    if (client != pIgnoreClient)
+                        client->Send(msg, drop);
+                }
+                else {
+                    invalidClients.push_back(std::move(client));
+                }
             }
-            else {
-                OnClientDisconnect(client);
-                client.reset();
 
-                bInvalidClientExists = true;
-            }
+            if (!invalidClients.empty())
+                deq_connections_.erase(
+                    std::remove(deq_connections_.begin(),
+                                deq_connections_.end(), nullptr),
+                    deq_connections_.end());
         }
 
-        if (bInvalidClientExists)
-            deq_connections_.erase(std::remove(deq_connections_.begin(),
-                                               deq_connections_.end(), nullptr),
-                                   deq_connections_.end());
+        for (auto& client : invalidClients) {
+            OnClientDisconnect(client);
+        }
     }
 
     void Update(size_t nMaxMessages = -1, bool bWait = false)
@@ -635,11 +1174,27 @@ public:
             auto msg = messages_in_.pop_front();
 
             OnMessage(msg.remote, msg.msg);
+            msg.remote->Recycle(std::move(msg.msg));
 
             nMessageCount++;
         }
     }
 
+    // Called on the connection's strand with every message it reads
+    void Deliver(owned_message<T>&& msg)
+    {
+        auto& strand = msg.remote->GetDispatchStrand();
+        if (!strand) {
+            messages_in_.push_back(std::move(msg));
+            return;
+        }
+
+        asio::post(*strand, [this, msg = std::move(msg)]() mutable {
+            OnMessage(msg.remote, msg.msg);
+            msg.remote->Recycle(std::move(msg.msg));
+        });
+    }
+
 protected:
     virtual bool OnClientConnect(std::shared_ptr<connection<T>> client)
     {
@@ -648,6 +1203,9 @@ protected:
 
     virtual void OnClientDisconnect(std::shared_ptr<connection<T>> client) {}
 
+    // With dispatch_threads, calls for different clients run concurrently.
+    // The body goes back to the client's pool afterwards unless it was
+    // moved away.
     virtual void OnMessage(std::shared_ptr<connection<T>> client,
                            message<T>& msg)
     {
@@ -657,13 +1215,18 @@ public:
     virtual void OnClientValidated(std::shared_ptr<connection<T>> client) {}
 
 protected:
+    server_options options_;
     tsqueue<owned_message<T>> messages_in_;
     std::deque<std::shared_ptr<connection<T>>> deq_connections_;
+    std::mutex mux_connections_;
 
     asio::io_context io_context_;
-    std::thread thread_context_;
-    asio::ip::tcp::acceptor asio_acceptor_;
-    uint32_t id_counter_ = 10000;
+    std::vector<std::thread> thread_contexts_;
+    std::deque<asio::ip::tcp::acceptor> asio_acceptors_;
+    // Declared after the io_context: queued OnMessage() calls hold
+    // connections, which must go first
+    std::unique_ptr<asio::thread_pool> dispatch_pool_;
+    std::atomic<uint32_t> id_counter_{10000};
 };
 
 }  // namespace net
@@ -2,6 +2,7 @@
 #define __GPNVJPEG_DECODER__
 
 #include "gp_beader.h"
+#include "gp_data.h"
 
 class NvJPEGDecoder;
 
@@ -10,8 +11,10 @@ namespace GPlayer {
 class GPNvJpegDecoder : public IBeader {
 public:
     explicit GPNvJpegDecoder();
+    ~GPNvJpegDecoder();
     std::string GetInfo() const override { return "NVJpegDecoder"; }
     bool HasProc() override { return false; };
+    void Process(GPData* data);
     int decodeToFd(int& fd,
                    unsigned char* buffer,
                    uint32_t bytesused,
@@ -19,11 +22,17 @@ public:
                    uint32_t& width,
                    uint32_t& height);
 
+private:
+    bool prepare_render_buffer(uint32_t width, uint32_t height);
+
 private:
     // MJPEG decoding
     NvJPEGDecoder* jpegdec_;
+    int render_dmabuf_fd_ = -1;
+    uint32_t render_width_ = 0;
+    uint32_t render_height_ = 0;
 };
 
 }  // namespace GPlayer
 
-#endif  // __GPNVJPEG_DECODER__
\ No newline at end of file
+#endif  // __GPNVJPEG_DECODER__
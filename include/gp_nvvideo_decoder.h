@@ -9,6 +9,7 @@
 #include <pthread.h>
 #include <string.h>
 #include <unistd.h>
+#include <atomic>
 #include <condition_variable>
 #include <deque>
 #include <fstream>
@@ -84,11 +85,28 @@ public:
     ~GPNvVideoDecoder();
     std::string GetInfo() const override;
     void Process(GPData* data);
+    // Lets a source receive straight into the input ring instead of
+    // handing buffers to Process() to copy: Reserve() returns where up to
+    // *length bytes may be written, 0 while the ring is full, and Commit()
+    // passes them on. One writer at a time.
+    uint8_t* Reserve(size_t* length);
+    void Commit(size_t length);
     int Proc() override;
     bool HasProc() override { return true; };
+    // Seeks a GPFileSrc input: decoding restarts from the keyframe at or
+    // before the target and the frames in between are decoded but not shown.
+    bool Seek(uint64_t frame);
+    // Seeks by time at the frame rate in the stream's parameter sets; fails
+    // for streams without timing info
+    bool SeekTime(double seconds);
 
 private:
     int read_decoder_input_nalu(NvBuffer* buffer);
+    bool reads_ring_nalus();
+    bool has_decoder_input_nalu();
+    int read_file_input_nalu(NvBuffer* buffer, GPFileSrc* file_src);
+    int read_file_input_access_unit(NvBuffer* buffer, GPFileSrc* file_src);
+    void update_copyts_flag(const uint8_t* nalu);
     int read_decoder_input_chunk(NvBuffer* buffer);
     int read_vpx_decoder_input_chunk(NvBuffer* buffer);
     void Abort();
@@ -116,6 +134,10 @@ private:
     void ProcessData();
     void Display(int fd);
     void PrintProfilingStats();
+    bool apply_pending_seek(int& plane_buffer_index);
+    void stamp_seek_epoch(struct v4l2_buffer& v4l2_buf);
+    bool drop_frame_after_seek(const struct v4l2_buffer& v4l2_buf);
+    bool copies_timestamps() const;
 
 private:
     std::vector<std::weak_ptr<GPDisplayEGLSink>> display_sinks_;
@@ -126,9 +148,20 @@ private:
     gp_circular_buffer<uint8_t> buffer_;
     std::mutex buffer_lock_;
     std::condition_variable buffer_condition_;
+    // Length of the whole NAL unit at the start of the ring, 0 until its end
+    // has arrived, and how far the search for that end got
+    size_t input_nalu_length_ = 0;
+    size_t input_scanned_ = 0;
     GPSemaphore pollthread_sema_;
     GPSemaphore decoderthread_sema_;
     const bool use_nvbuf_transform_api_ = true;
+    std::atomic<bool> seek_pending_{false};
+    std::atomic<uint64_t> seek_target_{0};
+    std::mutex seek_lock_;
+    uint32_t seek_epoch_ = 0;
+    uint64_t seek_discard_frames_ = 0;
+    // Copied timestamps: the first one after the flush, in microseconds
+    uint64_t seek_timestamp_ = 0;
 };
 
 };  // namespace GPlayer
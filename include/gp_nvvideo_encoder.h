@@ -5,7 +5,6 @@
 #include <linux/videodev2.h>
 #include <malloc.h>
 #include <poll.h>
-#include <semaphore.h>
 #include <string.h>
 #include <fstream>
 #include <iostream>
@@ -18,6 +17,7 @@
 
 #include "context.h"
 #include "gp_beader.h"
+#include "gp_semaphore.h"
 #include "gplayer.h"
 
 class NvVideoEncoder;
@@ -139,11 +139,7 @@ typedef struct : public context_t {
     uint32_t input_frames_queued_count;
 
     int max_perf;
-    int blocking_mode;      // Set if running in blocking mode
-    sem_t pollthread_sema;  // Polling thread waits on this to be signalled to
-                            // issue Poll
-    sem_t encoderthread_sema;    // Encoder thread waits on this to be signalled
-                                 // to continue q/dq loop
+    int blocking_mode;           // Set if running in blocking mode
     pthread_t enc_pollthread;    // Polling thread, created if running in
                                  // non-blocking mode.
     pthread_t enc_capture_loop;  // Encoder capture thread
@@ -213,6 +209,10 @@ private:
     std::shared_ptr<VideoEncodeContext_T> ctx_;
     std::vector<GPData*> frames_;
     std::mutex frames_mutex_;
+    // Polling thread waits on this to be signalled to issue Poll
+    GPSemaphore pollthread_sema_;
+    // Encoder thread waits on this to be signalled to continue q/dq loop
+    GPSemaphore encoderthread_sema_;
 };  // class GPNvVideoEncoder
 
 }  // namespace GPlayer
@@ -5,11 +5,15 @@
 #include <chrono>
 #include <condition_variable>
 #include <list>
+#include <map>
 #include <memory>
 #include <queue>
+#include <string>
 #include <thread>
+#include <vector>
 
 #include "gp_beader.h"
+#include "gp_thread_policy.h"
 
 namespace GPlayer {
 
@@ -42,6 +46,18 @@ public:
     bool AddMessage(const GPMessage& msg);
     bool GetMessage(GPMessage* msg);
 
+    // Thread policies are keyed by beader name, which covers every thread
+    // of the beader, or by "<beader name>/<thread name>" for one of them.
+    // The file holds one JSON object of such keys, see GPThreadPolicy.
+    bool LoadThreadPolicies(const std::string& filename);
+    void SetThreadPolicy(const std::string& key, const GPThreadPolicy& policy);
+    bool FindThreadPolicy(const IBeader& beader,
+                          const std::string& thread_name,
+                          GPThreadPolicy& policy);
+    // Every beader thread started so far, as placed by the kernel
+    void AddThreadPlacement(const GPThreadPlacement& placement);
+    std::vector<GPThreadPlacement> GetThreadPlacements();
+
     template <typename... T>
     void AddMany(T&&... multi_beaders)
     {
@@ -54,6 +70,9 @@ private:
     std::deque<GPMessage> messages_;
     std::mutex mutex_;
     std::condition_variable cv_;
+    std::map<std::string, GPThreadPolicy> thread_policies_;
+    std::vector<GPThreadPlacement> thread_placements_;
+    std::mutex thread_mutex_;
 };
 
 }  // namespace GPlayer
@@ -0,0 +1,81 @@
+#ifndef __GP_PREROLL_SINK__
+#define __GP_PREROLL_SINK__
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gp_async_file_writer.h"
+#include "gp_bitstream.h"
+#include "gp_filesink.h"
+
+namespace GPlayer {
+
+struct GPPreRollOptions {
+    std::string directory = ".";
+    std::string prefix = "event";
+    std::string extension = ".h264";
+    GPVideoCodec codec = GPVideoCodec::H264;
+    uint32_t pre_roll = 10;   // seconds kept in memory before a trigger
+    uint32_t post_roll = 10;  // seconds recorded after the last trigger
+    // Memory for the pre-roll; the oldest frames go first when it is full
+    size_t ring_size = 32 * 1024 * 1024;
+    GPAsyncFileWriterOptions writer;
+};
+
+// A GPFileSink that records only around events. The last pre_roll seconds
+// of the stream are kept in a fixed-size memory ring that always starts at
+// a keyframe. Trigger() writes the ring to a new file named
+// <prefix>-<YYYYmmdd-HHMMSS-mmm> and keeps recording until post_roll
+// seconds after the last trigger; nothing touches the disk in between.
+class GPPreRollSink : public GPFileSink {
+public:
+    explicit GPPreRollSink(const GPPreRollOptions& options);
+    ~GPPreRollSink();
+    std::string GetInfo() const override;
+    void Process(GPData* data) override;
+    // Safe to call from any thread; takes effect with the next frame
+    void Trigger();
+    bool IsRecording() const { return recording_; }
+    uint64_t GetEventCount() const { return event_count_; }
+    // Frames that did not fit into the ring at all
+    uint64_t GetDroppedFrames() const { return dropped_frames_; }
+
+private:
+    struct Frame {
+        uint64_t position;  // in the ring, counting every byte ever stored
+        size_t length;
+        std::chrono::steady_clock::time_point time;
+        bool keyframe;
+    };
+
+    void Store(const uint8_t* data,
+               size_t length,
+               bool keyframe,
+               std::chrono::steady_clock::time_point now);
+    void StartEvent();
+    void StopEvent();
+
+private:
+    GPPreRollOptions options_;
+    std::vector<uint8_t> ring_;
+    uint64_t ring_end_ = 0;
+    std::deque<Frame> frames_;
+
+    std::atomic<bool> triggered_{false};
+    std::atomic<int64_t> trigger_time_{0};  // steady_clock ticks
+    std::atomic<bool> recording_{false};
+    std::chrono::steady_clock::time_point post_roll_end_;
+    // GPFileSink::writer_ holds the recording of the current event
+    std::future<void> closing_;
+    std::atomic<uint64_t> event_count_{0};
+    std::atomic<uint64_t> dropped_frames_{0};
+};
+
+}  // namespace GPlayer
+
+#endif  // __GP_PREROLL_SINK__
@@ -0,0 +1,225 @@
+#ifndef __GP_RTP_H__
+#define __GP_RTP_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "gp_bitstream.h"
+
+namespace GPlayer {
+
+#define RTP_HEADER_SIZE 12
+#define RTP_VIDEO_CLOCK_RATE 90000
+
+// Settings of GPRtpPayloader and GPRtpDepayloader
+struct GPRtpOptions {
+    GPVideoCodec codec = GPVideoCodec::H264;
+    // Where the payloader sends to, or the address the depayloader binds
+    std::string host = "127.0.0.1";
+    uint16_t port = 5004;
+    uint8_t payload_type = 96;
+    // Largest RTP packet, header included; 1400 stays below a 1500 byte
+    // Ethernet MTU with room for IP, UDP and a tunnel header
+    size_t mtu = 1400;
+    // Packets the depayloader holds while it waits for a missing one
+    size_t reorder_depth = 64;
+    int socket_buffer_size = 4 << 20;
+};
+
+struct GPRtpHeader {
+    bool marker;
+    uint8_t payload_type;
+    uint16_t sequence;
+    uint32_t timestamp;
+    uint32_t ssrc;
+};
+
+// Parses the fixed RTP header and skips CSRCs, the header extension and
+// padding. Returns false for packets that are not RTP version 2 or are cut
+// short.
+bool ParseRtpPacket(const uint8_t* packet,
+                    size_t length,
+                    GPRtpHeader& header,
+                    const uint8_t*& payload,
+                    size_t& payload_length);
+
+// RTP packets laid out back to back in one buffer that keeps its capacity
+// from one access unit to the next
+class GPRtpPackets {
+public:
+    void Clear()
+    {
+        data_.clear();
+        ends_.clear();
+    }
+
+    size_t GetCount() const { return ends_.size(); }
+    const uint8_t* GetPacket(size_t index) const
+    {
+        return data_.data() + GetOffset(index);
+    }
+    size_t GetLength(size_t index) const
+    {
+        return ends_[index] - GetOffset(index);
+    }
+
+    // Adds a packet of length bytes and returns it to be written; valid
+    // until the next Append()
+    uint8_t* Append(size_t length)
+    {
+        size_t offset = data_.size();
+        data_.resize(offset + length);
+        ends_.push_back(data_.size());
+        return data_.data() + offset;
+    }
+
+private:
+    size_t GetOffset(size_t index) const
+    {
+        return index == 0 ? 0 : ends_[index - 1];
+    }
+
+private:
+    std::vector<uint8_t> data_;
+    std::vector<size_t> ends_;
+};
+
+// Splits Annex-B access units into RTP packets, following RFC 6184
+// (H.264, non-interleaved mode) and RFC 7798 (H.265). Runs of NAL units
+// that fit into one packet share an aggregation packet (STAP-A / AP), a
+// NAL unit on its own goes as a single NAL unit packet and larger ones are
+// fragmented (FU-A / FU). The last packet of an access unit carries the
+// marker bit. Sequence numbers and the timestamp base start at random.
+class GPRtpPacketizer {
+public:
+    GPRtpPacketizer(GPVideoCodec codec,
+                    uint8_t payload_type,
+                    size_t mtu,
+                    uint32_t ssrc = 0);
+
+    // data holds one access unit, pts is in microseconds; the packets are
+    // appended to packets
+    void Packetize(const uint8_t* data,
+                   size_t length,
+                   int64_t pts,
+                   GPRtpPackets& packets);
+
+    uint32_t GetSsrc() const { return ssrc_; }
+    uint16_t GetSequence() const { return sequence_; }
+
+private:
+    struct Nalu {
+        const uint8_t* data;
+        size_t length;
+    };
+
+    void SplitNalus(const uint8_t* data, size_t length);
+    void FlushAggregate(bool marker, GPRtpPackets& packets);
+    void Fragment(const Nalu& nalu, bool marker, GPRtpPackets& packets);
+    uint8_t* AppendPacket(size_t payload_length,
+                          bool marker,
+                          GPRtpPackets& packets);
+
+private:
+    const GPVideoCodec codec_;
+    const uint8_t payload_type_;
+    const size_t max_payload_;
+    // Bytes of a NAL unit header, 1 for H.264 and 2 for H.265
+    const size_t header_size_;
+    uint32_t ssrc_;
+    uint16_t sequence_;
+    uint32_t timestamp_base_;
+    uint32_t timestamp_ = 0;
+    std::vector<Nalu> nalus_;
+    // NAL units waiting to be sent together and their aggregated size
+    std::vector<Nalu> aggregate_;
+    size_t aggregate_size_ = 0;
+};
+
+// Since the depacketizer was created
+struct GPRtpStats {
+    uint64_t packets = 0;
+    uint64_t bytes = 0;
+    // Packets given up on once reorder_depth later ones had arrived
+    uint64_t lost = 0;
+    // Packets that arrived ahead of an earlier one and were held back
+    uint64_t reordered = 0;
+    // Duplicates, packets older than the ones already passed on and
+    // malformed ones
+    uint64_t discarded = 0;
+    uint64_t access_units = 0;
+    // Access units dropped because one of their packets was lost
+    uint64_t broken_access_units = 0;
+};
+
+// Puts access units back together from the RTP packets of one stream.
+// Packets are put in sequence order within a window of reorder_depth
+// packets: one that is missing when the window is full is given up on, and
+// the access unit it belonged to is dropped. Access units end at the marker
+// bit, or when the timestamp changes if the marker packet was lost.
+class GPRtpDepacketizer {
+public:
+    // An Annex-B access unit; pts is in microseconds since the first
+    // packet of the stream
+    using Callback = std::function<
+        void(const uint8_t* data, size_t length, int64_t pts, bool keyframe)>;
+
+    // reorder_depth is rounded up to a power of two, at most 4096
+    GPRtpDepacketizer(GPVideoCodec codec, size_t reorder_depth = 64);
+
+    void Push(const uint8_t* packet, size_t length, const Callback& callback);
+    // Gives up on the missing packets and passes on the ones held back
+    void Flush(const Callback& callback);
+    const GPRtpStats& GetStats() const { return stats_; }
+
+private:
+    struct Slot {
+        std::vector<uint8_t> packet;
+        bool used = false;
+    };
+
+    Slot& GetSlot(uint16_t sequence)
+    {
+        return slots_[sequence % slots_.size()];
+    }
+    void Advance(const Callback& callback);
+    void Resync(uint16_t sequence, int distance, const Callback& callback);
+    void Reset(const Callback& callback);
+    void Depacketize(const uint8_t* packet,
+                     size_t length,
+                     const Callback& callback);
+    void DepacketizeH264(const uint8_t* payload, size_t length);
+    void DepacketizeH265(const uint8_t* payload, size_t length);
+    void AppendAggregate(const uint8_t* data, size_t length, size_t skip);
+    void AppendNalu(const uint8_t* data, size_t length);
+    void EmitAccessUnit(const Callback& callback);
+
+private:
+    const GPVideoCodec codec_;
+    std::vector<Slot> slots_;
+    size_t held_ = 0;
+    bool started_ = false;
+    uint32_t ssrc_ = 0;
+    uint16_t next_sequence_ = 0;
+
+    std::vector<uint8_t> access_unit_;
+    bool in_access_unit_ = false;
+    bool damaged_ = false;
+    bool in_fragment_ = false;
+    uint32_t timestamp_ = 0;
+
+    // The 32 bit timestamps unwrapped
+    bool has_timestamp_ = false;
+    uint32_t last_timestamp_ = 0;
+    int64_t extended_timestamp_ = 0;
+    int64_t first_timestamp_ = 0;
+
+    GPRtpStats stats_;
+};
+
+}  // namespace GPlayer
+
+#endif  // __GP_RTP_H__
@@ -0,0 +1,66 @@
+#ifndef __GP_RTP_DEPAYLOADER_H__
+#define __GP_RTP_DEPAYLOADER_H__
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+
+#include "gp_beader.h"
+#include "gp_data.h"
+#include "gp_rtp.h"
+
+namespace GPlayer {
+
+// Receives an RTP stream over UDP and passes the access units it carries to
+// the linked NvVideoDecoder and FileSink beaders, with their PTS set from the
+// RTP timestamps. Proc() reads the socket bound to options.host and
+// options.port until Stop(); packets that arrive some other way can be fed
+// to Process() instead.
+class GPRtpDepayloader : public IBeader {
+private:
+    GPRtpDepayloader() = delete;
+
+public:
+    using AccessUnitCallback =
+        std::function<void(GPBuffer& buffer, bool keyframe)>;
+
+    GPRtpDepayloader(const GPRtpOptions& options);
+    ~GPRtpDepayloader();
+    std::string GetInfo() const;
+    int Proc() override;
+    bool HasProc() override { return true; };
+    void Stop() { stop_ = true; }
+    // data holds one RTP packet
+    void Process(GPData* data);
+    // Called with every access unit, before the linked beaders
+    void SetAccessUnitCallback(const AccessUnitCallback& callback);
+    GPRtpStats GetStats();
+
+private:
+    void OnAccessUnit(const uint8_t* data,
+                      size_t length,
+                      int64_t pts,
+                      bool keyframe);
+    void UpdateStats();
+
+private:
+    GPRtpOptions options_;
+    int socket_ = -1;
+    std::atomic<bool> stop_{false};
+
+    // Keeps the packets of Proc() and Process() in order; held while the
+    // access units they complete go to the linked beaders
+    std::mutex depacketizer_mutex_;
+    GPRtpDepacketizer depacketizer_;
+    GPRtpDepacketizer::Callback on_access_unit_;
+
+    // Never held while an access unit is passed on
+    std::mutex mutex_;
+    AccessUnitCallback callback_;
+    GPRtpStats stats_;
+};
+
+}  // namespace GPlayer
+
+#endif  // __GP_RTP_DEPAYLOADER_H__
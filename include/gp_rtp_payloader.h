@@ -0,0 +1,59 @@
+#ifndef __GP_RTP_PAYLOADER_H__
+#define __GP_RTP_PAYLOADER_H__
+
+#include <sys/socket.h>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "gp_beader.h"
+#include "gp_data.h"
+#include "gp_rtp.h"
+
+namespace GPlayer {
+
+struct GPRtpPayloaderStats {
+    uint64_t access_units = 0;
+    uint64_t packets = 0;
+    uint64_t bytes = 0;
+    // Packets the socket refused, most often for a full send buffer
+    uint64_t send_errors = 0;
+};
+
+// Sends the access units it receives as RTP over UDP. Every buffer given to
+// Process() holds one Annex-B access unit, as the encoder's capture plane
+// hands them out; its PTS becomes the RTP timestamp, or the arrival time for
+// buffers without one. The packets of an access unit go out with sendmmsg()
+// in batches.
+class GPRtpPayloader : public IBeader {
+private:
+    GPRtpPayloader() = delete;
+
+public:
+    GPRtpPayloader(const GPRtpOptions& options);
+    ~GPRtpPayloader();
+    std::string GetInfo() const;
+    bool HasProc() override { return false; };
+    void Process(GPData* data);
+    GPRtpPayloaderStats GetStats();
+
+private:
+    void Send();
+
+private:
+    GPRtpOptions options_;
+    int socket_ = -1;
+
+    std::mutex mutex_;
+    GPRtpPacketizer packetizer_;
+    GPRtpPackets packets_;
+    std::vector<struct mmsghdr> messages_;
+    std::vector<struct iovec> iovecs_;
+    std::chrono::steady_clock::time_point start_time_;
+    GPRtpPayloaderStats stats_;
+};
+
+}  // namespace GPlayer
+
+#endif  // __GP_RTP_PAYLOADER_H__
@@ -0,0 +1,85 @@
+#ifndef __GP_SEGMENT_SINK__
+#define __GP_SEGMENT_SINK__
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "gp_async_file_writer.h"
+#include "gp_bitstream.h"
+#include "gp_filesink.h"
+
+namespace GPlayer {
+
+struct GPSegmentOptions {
+    std::string directory = ".";
+    std::string prefix = "record";
+    std::string extension = ".h264";
+    GPVideoCodec codec = GPVideoCodec::H264;
+    uint32_t max_duration = 60;  // seconds, 0 for no limit
+    uint64_t max_size = 0;       // bytes, 0 for no limit
+    uint64_t preallocate_size = 64 * 1024 * 1024;
+    // Cut only in front of a keyframe, so every segment decodes on its own
+    bool keyframe_aligned = true;
+    GPAsyncFileWriterOptions writer;
+};
+
+// A GPFileSink for continuous recording that splits the stream into
+// segments by duration or size, named <prefix>-<YYYYmmdd-HHMMSS-mmm> after
+// their first frame. The next segment is opened and preallocated by a
+// housekeeping thread ahead of time, which also renames and closes segments,
+// so a rotation on the producer thread is only a pointer swap.
+class GPSegmentSink : public GPFileSink {
+public:
+    explicit GPSegmentSink(const GPSegmentOptions& options);
+    ~GPSegmentSink();
+    std::string GetInfo() const override;
+    void Process(GPData* data) override;
+    uint64_t GetSegmentCount() const { return segment_count_; }
+    // Rotations postponed because the next segment was not ready
+    uint64_t GetLateRotations() const { return late_rotations_; }
+
+private:
+    struct Segment {
+        std::unique_ptr<GPAsyncFileWriter> writer;
+        std::string path;
+    };
+
+    struct Task {
+        std::unique_ptr<Segment> close;
+        std::string rename_from;
+        std::string rename_to;
+    };
+
+    std::unique_ptr<Segment> OpenSegment();
+    bool IsSegmentFull() const;
+    void StartSegment();
+    void Rotate();
+    void PushTask(Task&& task);
+    void HousekeepingProc();
+
+private:
+    GPSegmentOptions options_;
+    std::unique_ptr<Segment> current_;
+    bool segment_started_ = false;
+    std::chrono::steady_clock::time_point segment_start_;
+    uint64_t segment_bytes_ = 0;
+    uint64_t segment_count_ = 0;
+    uint64_t late_rotations_ = 0;
+    uint64_t placeholder_count_ = 0;
+
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    std::unique_ptr<Segment> next_;
+    std::deque<Task> tasks_;
+    bool stop_ = false;
+    std::thread housekeeping_;
+};
+
+}  // namespace GPlayer
+
+#endif  // __GP_SEGMENT_SINK__
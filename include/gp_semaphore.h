@@ -1,34 +1,247 @@
 #ifndef __GP_SMAPHORE__
 #define __GP_SMAPHORE__
 
-#include <condition_variable>
-#include <mutex>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <thread>
 
 namespace GPlayer {
 
-class GPSemaphore {
+// How the waits on a GPSemaphore or GPEvent went so far
+struct GPSyncStats {
+    uint64_t spin_acquires = 0;  // satisfied while spinning
+    uint64_t parks = 0;          // waits that went to sleep in the kernel
+    uint64_t wakeups = 0;        // kernel wake calls made for sleepers
+};
+
+// The waiting side shared by GPSemaphore and GPEvent: a waiter spins for a
+// while, then sleeps on the futex word_ while it still holds the idle value.
+// The spin budget adapts, doubling past the spins the last hand-off needed
+// and halving after a spin that came to nothing; on a single CPU there is
+// nothing to wait for while spinning and waiters go straight to the kernel.
+class GPFutexWaiter {
 public:
-    GPSemaphore(std::size_t count = 0) : count_(count) {}
+    GPSyncStats GetStats() const
+    {
+        GPSyncStats stats;
+        stats.spin_acquires = spin_acquires_.load(std::memory_order_relaxed);
+        stats.parks = parks_.load(std::memory_order_relaxed);
+        stats.wakeups = wakeups_.load(std::memory_order_relaxed);
+        return stats;
+    }
 
-    void release()
+protected:
+    static constexpr int32_t kMinSpins = 16;
+    static constexpr int32_t kMaxSpins = 4096;
+
+    explicit GPFutexWaiter(int32_t value)
+        : word_(value),
+          spin_limit_(std::thread::hardware_concurrency() > 1 ? kMinSpins * 4
+                                                              : 0)
     {
-        std::lock_guard<std::mutex> lock(lock_);
-        count_++;
-        cv_.notify_one();
     }
-    void acquire()
+
+    // Retries attempt() until it succeeds or the deadline, if any, passes
+    template <typename Attempt>
+    bool Wait(Attempt&& attempt,
+              int32_t idle,
+              const std::chrono::steady_clock::time_point* deadline)
+    {
+        int32_t limit = spin_limit_.load(std::memory_order_relaxed);
+        for (int32_t i = 0; i < limit; i++) {
+            if (attempt()) {
+                spin_acquires_.fetch_add(1, std::memory_order_relaxed);
+                spin_limit_.store(std::clamp((i + 1) * 2, kMinSpins, kMaxSpins),
+                                  std::memory_order_relaxed);
+                return true;
+            }
+            CpuRelax();
+        }
+        if (limit > 0) {
+            spin_limit_.store(std::max(kMinSpins, limit / 2),
+                              std::memory_order_relaxed);
+        }
+
+        // Counted and fenced before the last attempt, so a release either
+        // sees the waiter or the waiter sees the release
+        waiters_++;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        bool acquired = false;
+        for (;;) {
+            if (attempt()) {
+                acquired = true;
+                break;
+            }
+
+            struct timespec timeout;
+            if (deadline) {
+                auto left = *deadline - std::chrono::steady_clock::now();
+                if (left <= std::chrono::steady_clock::duration::zero()) {
+                    break;
+                }
+                auto seconds =
+                    std::chrono::duration_cast<std::chrono::seconds>(left);
+                timeout.tv_sec = seconds.count();
+                timeout.tv_nsec =
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        left - seconds)
+                        .count();
+            }
+            parks_.fetch_add(1, std::memory_order_relaxed);
+            // Returns at once if word_ is no longer idle
+            syscall(SYS_futex, &word_, FUTEX_WAIT_PRIVATE, idle,
+                    deadline ? &timeout : nullptr, nullptr, 0);
+        }
+        waiters_--;
+        return acquired;
+    }
+
+    void Wake(int count)
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiters_.load(std::memory_order_relaxed) > 0) {
+            wakeups_.fetch_add(1, std::memory_order_relaxed);
+            syscall(SYS_futex, &word_, FUTEX_WAKE_PRIVATE, count, nullptr,
+                    nullptr, 0);
+        }
+    }
+
+    template <typename Clock, typename Duration>
+    static std::chrono::steady_clock::time_point ToSteady(
+        const std::chrono::time_point<Clock, Duration>& time)
+    {
+        return std::chrono::steady_clock::now() +
+               std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                   time - Clock::now());
+    }
+
+    static void CpuRelax()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+        asm volatile("yield" ::: "memory");
+#endif
+    }
+
+    std::atomic<int32_t> word_;
+
+private:
+    std::atomic<int32_t> waiters_{0};
+    std::atomic<int32_t> spin_limit_;
+    std::atomic<uint64_t> spin_acquires_{0};
+    std::atomic<uint64_t> parks_{0};
+    std::atomic<uint64_t> wakeups_{0};
+};
+
+// A counting semaphore for hand-offs between threads, such as a poll thread
+// and the thread it wakes for every buffer. release() costs an atomic add
+// unless somebody sleeps; acquire() spins briefly before it sleeps.
+class GPSemaphore : public GPFutexWaiter {
+public:
+    GPSemaphore(std::size_t count = 0)
+        : GPFutexWaiter(static_cast<int32_t>(count))
+    {
+    }
+
+    void release(std::size_t update = 1)
+    {
+        word_.fetch_add(static_cast<int32_t>(update));
+        Wake(static_cast<int>(update));
+    }
+
+    void acquire() { Wait([this]() { return try_acquire(); }, 0, nullptr); }
+
+    bool try_acquire()
+    {
+        int32_t count = word_.load(std::memory_order_relaxed);
+        while (count > 0) {
+            if (word_.compare_exchange_weak(count, count - 1,
+                                            std::memory_order_acquire,
+                                            std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    template <typename Rep, typename Period>
+    bool try_acquire_for(const std::chrono::duration<Rep, Period>& timeout)
+    {
+        auto deadline = std::chrono::steady_clock::now() +
+                        std::chrono::duration_cast<
+                            std::chrono::steady_clock::duration>(timeout);
+        return Wait([this]() { return try_acquire(); }, 0, &deadline);
+    }
+
+    template <typename Clock, typename Duration>
+    bool try_acquire_until(const std::chrono::time_point<Clock, Duration>& time)
+    {
+        auto deadline = ToSteady(time);
+        return Wait([this]() { return try_acquire(); }, 0, &deadline);
+    }
+};
+
+// A flag threads wait on until it is set. A manual-reset event releases
+// every waiter and stays set until reset(); an auto-reset event releases a
+// single waiter and clears itself.
+class GPEvent : public GPFutexWaiter {
+public:
+    explicit GPEvent(bool auto_reset = false, bool set = false)
+        : GPFutexWaiter(set ? 1 : 0), auto_reset_(auto_reset)
+    {
+    }
+
+    void set()
+    {
+        if (word_.exchange(1) == 0) {
+            Wake(auto_reset_ ? 1 : INT_MAX);
+        }
+    }
+
+    void reset() { word_.store(0); }
+    bool is_set() const { return word_.load() != 0; }
+
+    void wait() { Wait([this]() { return try_wait(); }, 0, nullptr); }
+
+    bool try_wait()
+    {
+        if (!auto_reset_) {
+            return word_.load(std::memory_order_acquire) != 0;
+        }
+        int32_t expected = 1;
+        return word_.compare_exchange_strong(expected, 0,
+                                             std::memory_order_acquire);
+    }
+
+    template <typename Rep, typename Period>
+    bool wait_for(const std::chrono::duration<Rep, Period>& timeout)
+    {
+        auto deadline = std::chrono::steady_clock::now() +
+                        std::chrono::duration_cast<
+                            std::chrono::steady_clock::duration>(timeout);
+        return Wait([this]() { return try_wait(); }, 0, &deadline);
+    }
+
+    template <typename Clock, typename Duration>
+    bool wait_until(const std::chrono::time_point<Clock, Duration>& time)
     {
-        std::unique_lock<std::mutex> lock(lock_);
-        cv_.wait(lock, [&]() { return count_ != 0; });
-        count_--;
+        auto deadline = ToSteady(time);
+        return Wait([this]() { return try_wait(); }, 0, &deadline);
     }
 
 private:
-    std::mutex lock_;
-    std::condition_variable cv_;
-    std::size_t count_;
+    const bool auto_reset_;
 };
 
 }  // namespace GPlayer
 
-#endif  // __GP_SMAPHORE__
\ No newline at end of file
+#endif  // __GP_SMAPHORE__
@@ -0,0 +1,40 @@
+#ifndef __GP_SOCKET_H__
+#define __GP_SOCKET_H__
+
+#include <sys/types.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace GPlayer {
+
+// Asks for a receive buffer of size bytes on socket and warns when the
+// kernel grants less, as it caps the size at net.core.rmem_max. name says
+// whose buffer it is in the warnings.
+void SetReceiveBufferSize(int socket, int size, const std::string& name);
+
+// The 32 bit big endian size in front of every access unit of a Length
+// framed stream, which may take several recv() calls to arrive
+class GPLengthPrefix {
+public:
+    // Receives what is missing of the prefix from socket and returns what
+    // recv() did
+    ssize_t Receive(int socket);
+    bool IsComplete() const { return size_ == sizeof(bytes_); }
+    // Sets frame_size from a complete prefix, and the next Receive() starts
+    // on a new one. Returns false, after logging it against name, when the
+    // size is over max_frame_size: the stream is out of step.
+    bool Take(size_t max_frame_size,
+              const std::string& name,
+              size_t* frame_size);
+    // Drops the part of a prefix received so far
+    void Reset() { size_ = 0; }
+
+private:
+    uint8_t bytes_[4];
+    size_t size_ = 0;
+};
+
+}  // namespace GPlayer
+
+#endif  // __GP_SOCKET_H__
@@ -1,31 +1,92 @@
 #ifndef __GP_SOCKET_CLIENT_H__
 #define __GP_SOCKET_CLIENT_H__
 
-#include <fstream>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
 #include <string>
 
 #include "gp_beader.h"
 #include "gp_data.h"
+#include "gp_socket.h"
 
 namespace GPlayer {
 
+class GPNvVideoDecoder;
+
+enum class GPStreamFraming {
+    AnnexB,  // a plain H.264/H.265 byte stream
+    Length,  // every access unit behind its size, 32 bit big endian
+};
+
+struct GPSocketClientOptions {
+    std::string host = "127.0.0.1";
+    uint16_t port = 8554;
+    GPStreamFraming framing = GPStreamFraming::AnnexB;
+    int socket_buffer_size = 4 << 20;
+    // Waits between connection attempts double from min_retry to max_retry
+    // and start over once connected
+    std::chrono::milliseconds min_retry{100};
+    std::chrono::milliseconds max_retry{5000};
+    // A longer length prefix means the stream is corrupt
+    size_t max_frame_size = 16 << 20;
+};
+
+struct GPSocketClientStats {
+    bool connected = false;
+    uint64_t connects = 0;
+    // Connections that were lost and made again
+    uint64_t reconnects = 0;
+    uint64_t connect_failures = 0;
+    uint64_t bytes = 0;
+    // Access units received, with Length framing only
+    uint64_t frames = 0;
+    double bitrate = 0;  // bits per second over the last second
+};
+
+// Pulls an encoded stream from a TCP server, such as an edge encoder, and
+// feeds the linked NvVideoDecoder. Data is received straight into the
+// decoder's input ring through Reserve() / Commit(), without a copy in
+// between; length prefixes are taken off on the way. A lost connection is
+// made again after a growing wait.
 class GPSocketClient : public IBeader {
 private:
     GPSocketClient() = delete;
 
 public:
-    GPSocketClient(int port);
+    GPSocketClient(const GPSocketClientOptions& options);
+    GPSocketClient(const std::string& host,
+                   uint16_t port,
+                   GPStreamFraming framing = GPStreamFraming::AnnexB);
     ~GPSocketClient();
     std::string GetInfo() const;
     int Proc() override;
     bool HasProc() override { return true; };
-    void Process(GPData* data);
-    std::basic_istream<char>& Read(char* buffer, std::streamsize count);
+    void Stop() { stop_ = true; }
+    GPSocketClientStats GetStats();
+
+private:
+    bool Connect();
+    void Disconnect();
+    // Returns false when the connection is gone
+    bool Receive(GPNvVideoDecoder* decoder);
+    bool ReceiveLengthPrefix();
+    void Account(size_t bytes, bool frame_end);
 
 private:
-    std::string filepath_;
-    std::ifstream* inputfile_;
-    int port_;
+    GPSocketClientOptions options_;
+    int socket_ = -1;
+    std::atomic<bool> stop_{false};
+
+    // Length framing: the prefix read so far and the rest of the frame
+    GPLengthPrefix prefix_;
+    size_t frame_left_ = 0;
+
+    std::mutex stats_mutex_;
+    GPSocketClientStats stats_;
+    uint64_t window_bytes_ = 0;
+    std::chrono::steady_clock::time_point window_start_;
 };
 
 }  // namespace GPlayer
@@ -0,0 +1,191 @@
+#ifndef __GP_SOCKET_SERVER_H__
+#define __GP_SOCKET_SERVER_H__
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "gp_beader.h"
+#include "gp_data.h"
+#include "gp_rtp.h"
+#include "gp_socket.h"
+#include "gp_socket_client.h"
+
+namespace GPlayer {
+
+class GPNvVideoDecoder;
+
+struct GPSocketServerOptions {
+    // Both TCP and UDP are served on this address and port
+    std::string address = "0.0.0.0";
+    uint16_t port = 8554;
+    bool tcp = true;
+    bool udp = true;
+    // How TCP pushers frame their stream
+    GPStreamFraming framing = GPStreamFraming::AnnexB;
+    // UDP pushers send RTP of this codec
+    GPVideoCodec codec = GPVideoCodec::H264;
+    size_t reorder_depth = 64;
+    // Pushers past this many are turned away
+    size_t max_streams = 64;
+    int socket_buffer_size = 8 << 20;
+    // Datagrams taken by one recvmmsg() call
+    size_t batch_size = 32;
+    // Lets the kernel coalesce the datagrams of a flow into one buffer of up
+    // to 64 KB (UDP_GRO, Linux 5.0)
+    bool gro = true;
+    // A UDP stream ends after this long without a datagram
+    std::chrono::milliseconds udp_timeout{5000};
+    // A UDP source turned away is dropped unasked for this long
+    std::chrono::milliseconds udp_reject_timeout{5000};
+    // A longer length prefix means the TCP stream is corrupt
+    size_t max_frame_size = 16 << 20;
+};
+
+enum class GPIngestProtocol { Tcp, Udp };
+
+struct GPIngestStream {
+    uint64_t id;
+    GPIngestProtocol protocol;
+    // address:port of the pusher
+    std::string peer;
+};
+
+struct GPIngestStreamStats {
+    GPIngestStream stream;
+    uint64_t bytes = 0;
+    // Access units; for TCP with Length framing only
+    uint64_t frames = 0;
+    // RTP packets given up on
+    uint64_t lost = 0;
+};
+
+struct GPSocketServerStats {
+    uint64_t tcp_streams = 0;
+    uint64_t udp_streams = 0;
+    // Pushers turned away because of max_streams or by the factory
+    uint64_t rejected = 0;
+    uint64_t active_streams = 0;
+    uint64_t bytes = 0;
+    uint64_t udp_datagrams = 0;
+    // Datagrams handed over as one GRO buffer count once above and once
+    // each here
+    uint64_t udp_segments = 0;
+    // Datagrams of pushers that were turned away, or malformed
+    uint64_t udp_dropped = 0;
+};
+
+// Ingests video from many pushers at once, over TCP and UDP on the same
+// port. Every TCP connection and every UDP source address is a stream of
+// its own, which the branch factory gives a decoder: the streams are kept
+// apart from there on, each in its own pipeline branch.
+//
+// One thread serves all of them. TCP sockets are edge-triggered in epoll
+// and read until drained, straight into the decoder's input ring. UDP
+// datagrams are read in recvmmsg() batches, GRO buffers are split back
+// into datagrams, and the RTP of every source is depacketized on its own.
+class GPSocketServer : public IBeader {
+private:
+    GPSocketServer() = delete;
+
+public:
+    // Returns the decoder of a new stream's branch, or nullptr to turn the
+    // pusher away. Called on the server thread; the branch's threads are
+    // the factory's to start.
+    using BranchFactory = std::function<std::shared_ptr<GPNvVideoDecoder>(
+        const GPIngestStream& stream)>;
+    // Called once a stream ended, for its branch to be torn down
+    using StreamClosedCallback =
+        std::function<void(const GPIngestStreamStats& stats)>;
+
+    GPSocketServer(const GPSocketServerOptions& options);
+    ~GPSocketServer();
+    std::string GetInfo() const;
+    int Proc() override;
+    bool HasProc() override { return true; };
+    void Stop();
+    void SetBranchFactory(const BranchFactory& factory);
+    void SetStreamClosedCallback(const StreamClosedCallback& callback);
+    GPSocketServerStats GetStats();
+    std::vector<GPIngestStreamStats> GetStreams();
+
+private:
+    struct Stream {
+        GPIngestStreamStats stats;
+        std::shared_ptr<GPNvVideoDecoder> decoder;
+        // TCP
+        int socket = -1;
+        // The decoder's ring was full; retried on the next turn, since the
+        // edge that reported the data will not come again
+        bool stalled = false;
+        // The pusher closed its end; its last data and the end of the
+        // stream raise one edge, so the socket is read up to the end
+        bool hung_up = false;
+        GPLengthPrefix prefix;
+        size_t frame_left = 0;
+        // UDP
+        uint64_t source = 0;
+        std::unique_ptr<GPRtpDepacketizer> depacketizer;
+        std::chrono::steady_clock::time_point last_datagram;
+    };
+
+    bool Open();
+    bool OpenTcp(const struct sockaddr_in& address);
+    bool OpenUdp(const struct sockaddr_in& address);
+    void Accept(std::unique_lock<std::mutex>& lock);
+    // Returns false when the connection is gone
+    bool ReceiveTcp(Stream& stream);
+    void ReceiveUdp(std::unique_lock<std::mutex>& lock);
+    void PushDatagram(const struct sockaddr_in& source,
+                      const uint8_t* data,
+                      size_t length,
+                      std::unique_lock<std::mutex>& lock);
+    // Take the lock held on mutex_ and let go of it around the callbacks
+    Stream* AddStream(GPIngestProtocol protocol,
+                      const struct sockaddr_in& peer,
+                      std::unique_lock<std::mutex>& lock);
+    void CloseStream(uint64_t id, std::unique_lock<std::mutex>& lock);
+    void CloseIdleStreams(std::unique_lock<std::mutex>& lock);
+
+private:
+    GPSocketServerOptions options_;
+    int epoll_ = -1;
+    int listener_ = -1;
+    int udp_ = -1;
+    // Wakes epoll_wait() on Stop()
+    int wakeup_ = -1;
+    std::atomic<bool> stop_{false};
+
+    std::vector<std::vector<uint8_t>> datagrams_;
+    std::vector<struct mmsghdr> messages_;
+    std::vector<struct iovec> iovecs_;
+    std::vector<struct sockaddr_in> sources_;
+    std::vector<std::vector<uint8_t>> controls_;
+    size_t datagram_size_;
+
+    // Held by the server thread while it works on the streams, except
+    // around the callbacks
+    std::mutex mutex_;
+    std::unordered_map<uint64_t, std::unique_ptr<Stream>> streams_;
+    // Stream ids of the UDP sources, by address and port
+    std::unordered_map<uint64_t, uint64_t> udp_sources_;
+    // When the UDP sources turned away were, by address and port
+    std::unordered_map<uint64_t, std::chrono::steady_clock::time_point>
+        rejected_sources_;
+    uint64_t next_id_;
+    GPSocketServerStats stats_;
+    std::chrono::steady_clock::time_point last_sweep_;
+    BranchFactory factory_;
+    StreamClosedCallback closed_callback_;
+};
+
+}  // namespace GPlayer
+
+#endif  // __GP_SOCKET_SERVER_H__
@@ -0,0 +1,56 @@
+#ifndef __GP_THREAD_POLICY_H__
+#define __GP_THREAD_POLICY_H__
+
+#include <sys/types.h>
+#include <string>
+#include <vector>
+
+#include "nlohmann/json.hpp"
+
+namespace GPlayer {
+
+enum class GPSchedPolicy {
+    Other,       // SCHED_OTHER, weighted by the nice level
+    Fifo,        // SCHED_FIFO
+    RoundRobin,  // SCHED_RR
+};
+
+struct GPThreadPlacement;
+
+// Where a thread runs and how it is scheduled. Real-time policies and
+// negative nice levels need CAP_SYS_NICE or a matching RLIMIT_RTPRIO /
+// RLIMIT_NICE; what the kernel refuses is logged and left as it was.
+struct GPThreadPolicy {
+    std::string name;        // empty keeps the thread's own name
+    std::vector<int> cores;  // empty allows every core
+    GPSchedPolicy scheduling = GPSchedPolicy::Other;
+    int priority = 0;  // 1 to 99, for Fifo and RoundRobin
+    int nice = 0;      // -20 to 19, for Other
+
+    // {"name": "capture", "cores": [2, 3], "scheduling": "fifo",
+    //  "priority": 50, "nice": 0}; every key is optional and scheduling is
+    // one of "other", "fifo" or "rr"
+    static bool FromJson(const nlohmann::json& json, GPThreadPolicy& policy);
+
+    // Applies the policy to the calling thread, naming it default_name
+    // unless the policy has a name, and returns where it ended up
+    GPThreadPlacement Apply(const std::string& default_name) const;
+};
+
+// The effective placement of a thread, as read back from the kernel
+struct GPThreadPlacement {
+    std::string beader;
+    std::string name;
+    pid_t tid = 0;
+    std::vector<int> cores;
+    GPSchedPolicy scheduling = GPSchedPolicy::Other;
+    int priority = 0;
+    int nice = 0;
+
+    static GPThreadPlacement GetCurrent(const std::string& name);
+    std::string ToString() const;
+};
+
+}  // namespace GPlayer
+
+#endif  // __GP_THREAD_POLICY_H__
@@ -1,31 +1,314 @@
 #ifndef __GP_THREADPOOL_H__
 #define __GP_THREADPOOL_H__
 
+#include <algorithm>
 #include <atomic>
-#include <cassert>
+#include <chrono>
 #include <condition_variable>
+#include <cstddef>
+#include <deque>
 #include <functional>
+#include <future>
+#include <memory>
 #include <mutex>
-#include <queue>
+#include <new>
 #include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 namespace GPlayer {
+
+// A move-only void() callable. Callables up to kInlineSize bytes, which
+// covers lambdas capturing a few pointers or a std::packaged_task, are kept
+// inside the task; larger ones are moved to the heap.
+class GPTask {
+public:
+    static constexpr size_t kInlineSize = 48;
+
+    GPTask() = default;
+
+    template <typename F,
+              typename = std::enable_if_t<
+                  !std::is_same<std::decay_t<F>, GPTask>::value>>
+    GPTask(F&& func)
+    {
+        using T = std::decay_t<F>;
+        if constexpr (sizeof(T) <= kInlineSize &&
+                      alignof(T) <= alignof(std::max_align_t) &&
+                      std::is_nothrow_move_constructible<T>::value) {
+            new (storage_) T(std::forward<F>(func));
+            ops_ = &kInlineOps<T>;
+        }
+        else {
+            *reinterpret_cast<T**>(storage_) = new T(std::forward<F>(func));
+            ops_ = &kHeapOps<T>;
+        }
+    }
+
+    GPTask(GPTask&& other) noexcept : ops_(other.ops_)
+    {
+        if (ops_) {
+            ops_->move(storage_, other.storage_);
+            other.ops_ = nullptr;
+        }
+    }
+
+    GPTask& operator=(GPTask&& other) noexcept
+    {
+        if (this != &other) {
+            Reset();
+            ops_ = other.ops_;
+            if (ops_) {
+                ops_->move(storage_, other.storage_);
+                other.ops_ = nullptr;
+            }
+        }
+        return *this;
+    }
+
+    GPTask(const GPTask&) = delete;
+    GPTask& operator=(const GPTask&) = delete;
+
+    ~GPTask() { Reset(); }
+
+    explicit operator bool() const { return ops_ != nullptr; }
+    void operator()() { ops_->invoke(storage_); }
+
+private:
+    struct Ops {
+        void (*invoke)(void* storage);
+        // Move constructs into dst and destroys src
+        void (*move)(void* dst, void* src);
+        void (*destroy)(void* storage);
+    };
+
+    template <typename T>
+    static constexpr Ops kInlineOps = {
+        [](void* storage) { (*static_cast<T*>(storage))(); },
+        [](void* dst, void* src) {
+            new (dst) T(std::move(*static_cast<T*>(src)));
+            static_cast<T*>(src)->~T();
+        },
+        [](void* storage) { static_cast<T*>(storage)->~T(); },
+    };
+
+    template <typename T>
+    static constexpr Ops kHeapOps = {
+        [](void* storage) { (**static_cast<T**>(storage))(); },
+        [](void* dst, void* src) {
+            *static_cast<T**>(dst) = *static_cast<T**>(src);
+        },
+        [](void* storage) { delete *static_cast<T**>(storage); },
+    };
+
+    void Reset()
+    {
+        if (ops_) {
+            ops_->destroy(storage_);
+            ops_ = nullptr;
+        }
+    }
+
+private:
+    alignas(std::max_align_t) unsigned char storage_[kInlineSize];
+    const Ops* ops_ = nullptr;
+};
+
+enum class GPTaskPriority {
+    Realtime,     // display and encode work with a frame budget
+    Interactive,  // the default
+    Background,   // bulk work such as file I/O and snapshots
+};
+
+static constexpr size_t kTaskPriorityCount = 3;
+
+struct GPTaskOptions {
+    GPTaskPriority priority = GPTaskPriority::Interactive;
+    // A task that has not started by its deadline is dropped; a submitted
+    // task's future then reports a broken promise
+    std::chrono::steady_clock::time_point deadline =
+        std::chrono::steady_clock::time_point::max();
+};
+
+// Per priority class, since the pool was created
+struct GPThreadPoolStats {
+    uint64_t tasks = 0;    // started
+    uint64_t expired = 0;  // dropped at their deadline
+    // Time from Post() until the task started, read to a scheduler tick
+    std::chrono::microseconds total_delay{0};
+    std::chrono::microseconds max_delay{0};
+};
+
+// A tile of a width x height area, see GPThreadPool::ParallelForTiles()
+struct GPTile {
+    size_t x;
+    size_t y;
+    size_t width;
+    size_t height;
+};
+
+// A fixed set of worker threads, each with its own task deques, one per
+// priority class. Workers take the highest class that has work anywhere in
+// the pool: their own tasks newest first, else the oldest task of another
+// worker. A lower class task that has waited longer than its class's
+// starvation limit may go first, but only in a small share of the takes, so
+// Realtime work keeps most of the pool under sustained load. Tasks posted
+// from a worker stay on that worker; tasks from other threads are spread
+// round-robin.
 class GPThreadPool {
 public:
-    GPThreadPool();
+    // num_threads 0 uses one thread per CPU
+    explicit GPThreadPool(size_t num_threads = 0);
+    // The pool shared by the per-frame CPU stages of all beaders
+    static GPThreadPool& GetInstance();
+    // Runs the tasks already posted, then joins the workers
     ~GPThreadPool();
-    void Post(std::function<void()>& func);
+    GPThreadPool(const GPThreadPool&) = delete;
+    GPThreadPool& operator=(const GPThreadPool&) = delete;
+
+    // Tasks posted after Done() are dropped, except those posted by tasks
+    void Post(GPTask task, const GPTaskOptions& options = {});
+    void Post(GPTask task, GPTaskPriority priority)
+    {
+        GPTaskOptions options;
+        options.priority = priority;
+        Post(std::move(task), options);
+    }
+
+    template <typename F, typename... Args>
+    auto Submit(F&& func, Args&&... args)
+        -> std::future<std::invoke_result_t<F, Args...>>
+    {
+        return Submit(GPTaskOptions(), std::forward<F>(func),
+                      std::forward<Args>(args)...);
+    }
+
+    template <typename F, typename... Args>
+    auto Submit(const GPTaskOptions& options, F&& func, Args&&... args)
+        -> std::future<std::invoke_result_t<F, Args...>>
+    {
+        using R = std::invoke_result_t<F, Args...>;
+        std::packaged_task<R()> task(
+            [func = std::forward<F>(func),
+             args = std::make_tuple(std::forward<Args>(args)...)]() mutable {
+                return std::apply(std::move(func), std::move(args));
+            });
+        std::future<R> future = task.get_future();
+        Post(std::move(task), options);
+        return future;
+    }
+
+    // Calls body(first, last) on consecutive chunks of [begin, end) and
+    // returns once all of them ran. The calling thread takes chunks too, so
+    // this may be nested or called from a task. A chunk holds grain items
+    // (rows, usually); 0 picks a few chunks per thread. A range of a single
+    // chunk runs inline without touching the pool.
+    template <typename F>
+    void ParallelFor(size_t begin, size_t end, F&& body, size_t grain = 0)
+    {
+        ParallelRange(begin, end, grain, &body,
+                      [](void* body, size_t first, size_t last) {
+                          (*static_cast<std::remove_reference_t<F>*>(body))(
+                              first, last);
+                      });
+    }
+
+    // Calls body(const GPTile&) for tile_width x tile_height tiles of a
+    // width x height area; tiles on the right and bottom edges are cut to
+    // fit. Tiles are handed out in row-major order, one at a time.
+    template <typename F>
+    void ParallelForTiles(size_t width,
+                          size_t height,
+                          size_t tile_width,
+                          size_t tile_height,
+                          F&& body)
+    {
+        if (width == 0 || height == 0 || tile_width == 0 || tile_height == 0) {
+            return;
+        }
+        size_t columns = (width + tile_width - 1) / tile_width;
+        size_t rows = (height + tile_height - 1) / tile_height;
+        ParallelFor(
+            0, columns * rows,
+            [&](size_t first, size_t last) {
+                for (size_t i = first; i < last; i++) {
+                    GPTile tile;
+                    tile.x = (i % columns) * tile_width;
+                    tile.y = (i / columns) * tile_height;
+                    tile.width = std::min(tile_width, width - tile.x);
+                    tile.height = std::min(tile_height, height - tile.y);
+                    body(tile);
+                }
+            },
+            1);
+    }
+
+    // Stops accepting tasks and joins the workers once the queued tasks ran;
+    // must not be called from a task
     void Done();
+    size_t GetThreadCount() const { return workers_.size(); }
+
+    // How long a queued task of the class may be passed over by higher
+    // classes before it shares the pool with them; Realtime tasks are never
+    // passed over
+    void SetStarvationLimit(GPTaskPriority priority,
+                            std::chrono::microseconds limit);
+    GPThreadPoolStats GetStats(GPTaskPriority priority) const;
 
 private:
-    void InfiniteLoopFunc();
+    struct Entry {
+        GPTask task;
+        std::chrono::steady_clock::time_point queued;
+        std::chrono::steady_clock::time_point deadline;
+    };
+
+    // Written by one worker only, so an update is a plain load and store;
+    // GetStats() adds up the workers' counters
+    struct Counters {
+        std::atomic<uint64_t> tasks{0};
+        std::atomic<uint64_t> expired{0};
+        std::atomic<int64_t> total_delay{0};  // microseconds
+        std::atomic<int64_t> max_delay{0};
+    };
+
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Entry> tasks[kTaskPriorityCount];
+        std::thread thread;
+        // Only touched by the worker's own thread
+        size_t takes_since_starved = 0;
+        Counters counters[kTaskPriorityCount];
+    };
+
+    void ParallelRange(size_t begin,
+                       size_t end,
+                       size_t grain,
+                       void* body,
+                       void (*invoke)(void* body, size_t first, size_t last));
+    bool Take(size_t index, Entry& entry, size_t& priority);
+    bool TakeStarved(size_t index,
+                     size_t priority,
+                     std::chrono::steady_clock::time_point now,
+                     Entry& entry);
+    bool Pop(size_t index, size_t priority, Entry& entry);
+    bool Steal(size_t index, size_t priority, Entry& entry);
+    void Run(Counters& counters, Entry& entry);
+    bool HasPending() const;
+    void WorkerProc(size_t index);
 
 private:
-    std::vector<std::thread> threads_;
-    std::queue<std::function<void()>> function_queue_;
-    std::atomic<bool> accept_functions_;
-    std::mutex lock_;
-    std::condition_variable thread_condition_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::atomic<size_t> next_worker_{0};
+    // Tasks queued and not picked up yet, per class
+    std::atomic<size_t> class_pending_[kTaskPriorityCount];
+    std::atomic<int64_t> starvation_limits_[kTaskPriorityCount];
+    std::atomic<bool> accept_tasks_{true};
+    std::atomic<size_t> sleepers_{0};
+    std::mutex sleep_mutex_;
+    std::condition_variable sleep_condition_;
+    std::once_flag join_once_;
 };
 
 }  // namespace GPlayer
@@ -0,0 +1,86 @@
+#ifndef __GP_UDP_SRC_H__
+#define __GP_UDP_SRC_H__
+
+#include <sys/socket.h>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "gp_beader.h"
+#include "gp_data.h"
+#include "gp_jitter_buffer.h"
+#include "gp_rtp.h"
+
+namespace GPlayer {
+
+struct GPUdpSrcOptions {
+    GPVideoCodec codec = GPVideoCodec::H264;
+    // A multicast group to join, or the unicast address to bind
+    std::string address = "0.0.0.0";
+    uint16_t port = 5004;
+    // Local address of the interface a multicast group is joined on
+    std::string interface = "0.0.0.0";
+    int socket_buffer_size = 8 << 20;
+    // Datagrams taken by one recvmmsg() call
+    size_t batch_size = 32;
+    // Larger datagrams are dropped
+    size_t max_packet_size = 2048;
+    GPJitterBufferOptions jitter;
+};
+
+// Receives an RTP stream over unicast or multicast UDP for LAN camera
+// distribution. Datagrams are read in batches with recvmmsg(), put in order
+// and evened out by a GPJitterBuffer, and the access units they carry go to
+// the linked NvVideoDecoder beaders with their PTS set.
+class GPUdpSrc : public IBeader {
+private:
+    GPUdpSrc() = delete;
+
+public:
+    using AccessUnitCallback =
+        std::function<void(GPBuffer& buffer, bool keyframe)>;
+
+    GPUdpSrc(const GPUdpSrcOptions& options);
+    ~GPUdpSrc();
+    std::string GetInfo() const;
+    int Proc() override;
+    bool HasProc() override { return true; };
+    void Stop() { stop_ = true; }
+    // Called with every access unit, before the linked decoders
+    void SetAccessUnitCallback(const AccessUnitCallback& callback);
+    GPJitterStats GetJitterStats();
+    GPRtpStats GetRtpStats();
+
+private:
+    bool Open();
+    void Receive();
+    void OnAccessUnit(const uint8_t* data,
+                      size_t length,
+                      int64_t pts,
+                      bool keyframe);
+    static int64_t Now();
+
+private:
+    GPUdpSrcOptions options_;
+    int socket_ = -1;
+    std::atomic<bool> stop_{false};
+
+    // Receive buffers, swapped with the jitter buffer's as packets go in
+    std::vector<std::vector<uint8_t>> packets_;
+    std::vector<struct mmsghdr> messages_;
+    std::vector<struct iovec> iovecs_;
+
+    std::mutex mutex_;
+    GPJitterBuffer jitter_buffer_;
+    // Gets the packets in order already, so it reorders nothing
+    GPRtpDepacketizer depacketizer_;
+    GPJitterBuffer::Callback on_packet_;
+    GPRtpDepacketizer::Callback on_access_unit_;
+    AccessUnitCallback callback_;
+};
+
+}  // namespace GPlayer
+
+#endif  // __GP_UDP_SRC_H__
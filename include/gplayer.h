@@ -10,9 +10,20 @@
 #include "gp_filesink.h"
 #include "gp_filesrc.h"
 #include "gp_media_server.h"
+#include "gp_mjpeg_demuxer.h"
+#include "gp_nvjpeg_decoder.h"
 #include "gp_nvvideo_decoder.h"
 #include "gp_nvvideo_encoder.h"
 #include "gp_pipeline.h"
+#include "gp_preroll_sink.h"
+#include "gp_rtp.h"
+#include "gp_rtp_depayloader.h"
+#include "gp_rtp_payloader.h"
+#include "gp_segment_sink.h"
+#include "gp_socket.h"
+#include "gp_socket_client.h"
+#include "gp_socket_server.h"
+#include "gp_udp_src.h"
 #include "gp_video_decoder_group.h"
 
 #endif  // __GPLAYER__
@@ -11,6 +11,7 @@
 #include "camera_recorder.h"
 #include "dma_buffer.h"
 #include "gp_log.h"
+#include "gp_threadpool.h"
 
 using namespace Argus;
 using namespace ArgusSamples;
@@ -201,26 +202,26 @@ bool ConsumerThread::threadExecute()
             NvBufferParams par;
             NvBufferGetParams(dmabuf_fd, &par);
             void* ptr_y;
-            uint8_t* ptr_cur;
-            int i, j, a, b;
             NvBufferMemMap(dmabuf_fd, Y_INDEX, NvBufferMem_Write, &ptr_y);
             NvBufferMemSyncForCpu(dmabuf_fd, Y_INDEX, &ptr_y);
-            ptr_cur =
-                (uint8_t*)ptr_y + par.pitch[Y_INDEX] * START_POS + START_POS;
+            size_t pitch = par.pitch[Y_INDEX];
+            uint8_t* origin = (uint8_t*)ptr_y + pitch * START_POS + START_POS;
 
             // overwrite some pixels to put an 'N' on each Y plane
-            // scan array_n to decide which pixel should be overwritten
-            for (i = 0; i < FONT_SIZE; i++) {
-                for (j = 0; j < FONT_SIZE; j++) {
-                    a = i >> SHIFT_BITS;
-                    b = j >> SHIFT_BITS;
-                    if (array_n[a][b])
-                        (*ptr_cur) = 0xff;  // white color
-                    ptr_cur++;
-                }
-                ptr_cur = (uint8_t*)ptr_y +
-                          par.pitch[Y_INDEX] * (START_POS + i) + START_POS;
-            }
+            // scan array_n to decide which pixel should be overwritten,
+            // one glyph row per chunk on the thread pool
+            GPThreadPool::GetInstance().ParallelFor(
+                0, FONT_SIZE,
+                [origin, pitch](size_t first, size_t last) {
+                    for (size_t i = first; i < last; i++) {
+                        uint8_t* ptr_cur = origin + pitch * i;
+                        for (int j = 0; j < FONT_SIZE; j++) {
+                            if (array_n[i >> SHIFT_BITS][j >> SHIFT_BITS])
+                                ptr_cur[j] = 0xff;  // white color
+                        }
+                    }
+                },
+                1 << SHIFT_BITS);
             NvBufferMemSyncForDevice(dmabuf_fd, Y_INDEX, &ptr_y);
             NvBufferMemUnMap(dmabuf_fd, Y_INDEX, &ptr_y);
         }
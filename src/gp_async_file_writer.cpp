@@ -0,0 +1,452 @@
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include "gp_async_file_writer.h"
+#include "gp_log.h"
+
+namespace GPlayer {
+
+// Buffer, offset and length alignment required by O_DIRECT
+static const size_t kDirectAlignment = 4096;
+
+static size_t AlignUp(size_t value, size_t alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+GPAsyncFileWriter::GPAsyncFileWriter(const GPAsyncFileWriterOptions& options)
+    : options_(options)
+{
+    options_.buffer_size =
+        AlignUp(std::max<size_t>(options_.buffer_size, 1), kDirectAlignment);
+    options_.max_inflight_bytes =
+        std::max(options_.max_inflight_bytes, options_.buffer_size);
+}
+
+GPAsyncFileWriter::~GPAsyncFileWriter()
+{
+    Close();
+}
+
+bool GPAsyncFileWriter::Open(const std::string& filepath)
+{
+    if (fd_ >= 0) {
+        Close();
+    }
+
+    int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+    if (options_.direct_io) {
+        fd_ = open(filepath.c_str(), flags | O_DIRECT, 0644);
+        if (fd_ < 0 && errno == EINVAL) {
+            SPDLOG_WARN("{} does not support O_DIRECT, using buffered I/O",
+                        filepath);
+            options_.direct_io = false;
+        }
+    }
+    if (fd_ < 0) {
+        fd_ = open(filepath.c_str(), flags, 0644);
+    }
+    if (fd_ < 0) {
+        SPDLOG_CRITICAL("Failed to open output file {}: {}", filepath,
+                        strerror(errno));
+        return false;
+    }
+
+    filepath_ = filepath;
+    file_offset_ = 0;
+    synced_offset_ = 0;
+    preallocated_ = false;
+    bytes_written_ = 0;
+    error_ = 0;
+    stop_ = false;
+
+#ifdef GP_HAVE_LIBURING
+    use_ring_ = options_.use_io_uring && SetupRing();
+    if (use_ring_) {
+        worker_ = std::thread(&GPAsyncFileWriter::ReapProc, this);
+        return true;
+    }
+#endif
+    worker_ = std::thread(&GPAsyncFileWriter::WriterProc, this);
+    return true;
+}
+
+bool GPAsyncFileWriter::Preallocate(uint64_t size)
+{
+    if (fd_ < 0 || size == 0) {
+        return false;
+    }
+
+    if (fallocate(fd_, FALLOC_FL_KEEP_SIZE, 0, size) < 0) {
+        SPDLOG_TRACE("Failed to preallocate {} bytes for {}: {}", size,
+                     filepath_, strerror(errno));
+        return false;
+    }
+
+    preallocated_ = true;
+    return true;
+}
+
+bool GPAsyncFileWriter::Write(const uint8_t* data, size_t length)
+{
+    if (fd_ < 0 || error_) {
+        return false;
+    }
+
+    while (length > 0) {
+        if (!current_) {
+            current_ = AcquireBuffer();
+        }
+
+        size_t size = std::min(length, options_.buffer_size - current_->length);
+        memcpy(current_->data + current_->length, data, size);
+        current_->length += size;
+        data += size;
+        length -= size;
+
+        if (current_->length == options_.buffer_size) {
+            Submit(current_);
+            current_ = nullptr;
+        }
+    }
+
+    return !error_;
+}
+
+void GPAsyncFileWriter::Flush()
+{
+    if (fd_ < 0 || !current_ || current_->length == 0) {
+        return;
+    }
+
+    if (!options_.direct_io) {
+        Submit(current_);
+        current_ = nullptr;
+        return;
+    }
+
+    // The partial block is kept back, it is rewritten at the same offset
+    // once it has been filled or the file is closed
+    size_t aligned = current_->length & ~(kDirectAlignment - 1);
+    if (aligned == 0) {
+        return;
+    }
+
+    Buffer* rest = AcquireBuffer();
+    rest->length = current_->length - aligned;
+    memcpy(rest->data, current_->data + aligned, rest->length);
+    current_->length = aligned;
+    Submit(current_);
+    current_ = rest;
+}
+
+bool GPAsyncFileWriter::Close()
+{
+    if (fd_ < 0) {
+        return true;
+    }
+
+    off_t file_size = file_offset_;
+    if (current_ && current_->length > 0) {
+        file_size += current_->length;
+        if (options_.direct_io) {
+            size_t padded = AlignUp(current_->length, kDirectAlignment);
+            memset(current_->data + current_->length, 0,
+                   padded - current_->length);
+            current_->length = padded;
+        }
+        Submit(current_);
+    }
+    else if (current_) {
+        std::lock_guard<std::mutex> guard(mutex_);
+        ReleaseBuffer(current_);
+    }
+    current_ = nullptr;
+
+    WaitInflight(0);
+
+#ifdef GP_HAVE_LIBURING
+    if (use_ring_) {
+        // A NOP tagged with the ring itself tells the reaper to exit
+        std::lock_guard<std::mutex> guard(ring_lock_);
+        struct io_uring_sqe* sqe = io_uring_get_sqe(&ring_);
+        io_uring_prep_nop(sqe);
+        io_uring_sqe_set_data(sqe, &ring_);
+        io_uring_submit(&ring_);
+    }
+#endif
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        stop_ = true;
+    }
+    queue_condition_.notify_all();
+    if (worker_.joinable()) {
+        worker_.join();
+    }
+#ifdef GP_HAVE_LIBURING
+    if (use_ring_) {
+        io_uring_queue_exit(&ring_);
+        use_ring_ = false;
+    }
+#endif
+
+    if ((preallocated_ || file_offset_ != file_size) &&
+        ftruncate(fd_, file_size) < 0) {
+        SetError(errno);
+    }
+    if (options_.sync_policy != GPFileSyncPolicy::None && fdatasync(fd_) < 0) {
+        SetError(errno);
+    }
+    if (close(fd_) < 0) {
+        SetError(errno);
+    }
+    fd_ = -1;
+    bytes_written_ = file_size;
+
+    for (Buffer* buffer : free_buffers_) {
+        free(buffer->data);
+        delete buffer;
+    }
+    free_buffers_.clear();
+
+    SPDLOG_TRACE("Closed {}, {} bytes", filepath_, file_size);
+    return error_ == 0;
+}
+
+GPAsyncFileWriter::Buffer* GPAsyncFileWriter::AcquireBuffer()
+{
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        if (!free_buffers_.empty()) {
+            Buffer* buffer = free_buffers_.back();
+            free_buffers_.pop_back();
+            buffer->length = 0;
+            return buffer;
+        }
+    }
+
+    Buffer* buffer = new Buffer{nullptr, 0, 0, 0};
+    if (posix_memalign(reinterpret_cast<void**>(&buffer->data),
+                       kDirectAlignment, options_.buffer_size) != 0) {
+        SPDLOG_CRITICAL("Failed to allocate a {} byte write buffer",
+                        options_.buffer_size);
+        abort();
+    }
+    return buffer;
+}
+
+// Called with mutex_ held
+void GPAsyncFileWriter::ReleaseBuffer(Buffer* buffer)
+{
+    buffer->length = 0;
+    free_buffers_.push_back(buffer);
+}
+
+void GPAsyncFileWriter::Submit(Buffer* buffer)
+{
+    // The only place the producer waits on storage
+    if (inflight_bytes_ + buffer->length > options_.max_inflight_bytes) {
+        WaitInflight(options_.max_inflight_bytes - buffer->length);
+    }
+
+    buffer->offset = file_offset_;
+    buffer->done = 0;
+    file_offset_ += buffer->length;
+    inflight_bytes_ += buffer->length;
+
+    bool sync = options_.sync_policy == GPFileSyncPolicy::Interval &&
+                static_cast<size_t>(file_offset_ - synced_offset_) >=
+                    options_.sync_interval_bytes;
+    if (sync) {
+        synced_offset_ = file_offset_;
+    }
+
+#ifdef GP_HAVE_LIBURING
+    if (use_ring_) {
+        QueueWrite(buffer);
+        if (sync) {
+            QueueSync();
+        }
+        return;
+    }
+#endif
+
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        queue_.push_back(buffer);
+        if (sync) {
+            // A buffer without data asks the writer thread to sync
+            queue_.push_back(nullptr);
+        }
+    }
+    queue_condition_.notify_one();
+}
+
+void GPAsyncFileWriter::Complete(Buffer* buffer, int error)
+{
+    if (error) {
+        SetError(error);
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        inflight_bytes_ -= buffer->length;
+        bytes_written_ += buffer->done;
+        ReleaseBuffer(buffer);
+    }
+    inflight_condition_.notify_all();
+}
+
+void GPAsyncFileWriter::WaitInflight(size_t limit)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    inflight_condition_.wait(lock,
+                             [&]() { return inflight_bytes_ <= limit; });
+}
+
+void GPAsyncFileWriter::SetError(int error)
+{
+    int expected = 0;
+    if (error_.compare_exchange_strong(expected, error)) {
+        SPDLOG_ERROR("Failed to write {}: {}", filepath_, strerror(error));
+    }
+}
+
+void GPAsyncFileWriter::WriterProc()
+{
+    pthread_setname_np(pthread_self(), "GPFileWriter");
+
+    for (;;) {
+        Buffer* buffer;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            queue_condition_.wait(
+                lock, [this]() { return stop_ || !queue_.empty(); });
+            if (queue_.empty()) {
+                break;
+            }
+            buffer = queue_.front();
+            queue_.pop_front();
+        }
+
+        if (!buffer) {
+            if (fdatasync(fd_) < 0) {
+                SetError(errno);
+            }
+            continue;
+        }
+
+        int error = 0;
+        while (buffer->done < buffer->length && !error_) {
+            ssize_t ret = pwrite(fd_, buffer->data + buffer->done,
+                                 buffer->length - buffer->done,
+                                 buffer->offset + buffer->done);
+            if (ret < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                error = errno;
+                break;
+            }
+            buffer->done += ret;
+        }
+        Complete(buffer, error);
+    }
+}
+
+#ifdef GP_HAVE_LIBURING
+bool GPAsyncFileWriter::SetupRing()
+{
+    unsigned entries = std::max<size_t>(
+        16, 2 * (options_.max_inflight_bytes / options_.buffer_size + 2));
+    int ret = io_uring_queue_init(entries, &ring_, 0);
+    if (ret < 0) {
+        SPDLOG_WARN("io_uring is not available ({}), using a writer thread",
+                    strerror(-ret));
+        return false;
+    }
+    return true;
+}
+
+void GPAsyncFileWriter::QueueWrite(Buffer* buffer)
+{
+    std::lock_guard<std::mutex> guard(ring_lock_);
+
+    struct io_uring_sqe* sqe;
+    while (!(sqe = io_uring_get_sqe(&ring_))) {
+        io_uring_submit(&ring_);
+    }
+    io_uring_prep_write(sqe, fd_, buffer->data + buffer->done,
+                        buffer->length - buffer->done,
+                        buffer->offset + buffer->done);
+    io_uring_sqe_set_data(sqe, buffer);
+    io_uring_submit(&ring_);
+}
+
+void GPAsyncFileWriter::QueueSync()
+{
+    std::lock_guard<std::mutex> guard(ring_lock_);
+
+    struct io_uring_sqe* sqe;
+    while (!(sqe = io_uring_get_sqe(&ring_))) {
+        io_uring_submit(&ring_);
+    }
+    // Drain so the sync starts after every write queued before it
+    io_uring_prep_fsync(sqe, fd_, IORING_FSYNC_DATASYNC);
+    sqe->flags |= IOSQE_IO_DRAIN;
+    io_uring_sqe_set_data(sqe, nullptr);
+    io_uring_submit(&ring_);
+}
+
+void GPAsyncFileWriter::ReapProc()
+{
+    pthread_setname_np(pthread_self(), "GPFileReaper");
+
+    for (;;) {
+        struct io_uring_cqe* cqe;
+        int ret = io_uring_wait_cqe(&ring_, &cqe);
+        if (ret < 0) {
+            if (ret == -EINTR) {
+                continue;
+            }
+            SPDLOG_CRITICAL("io_uring_wait_cqe failed: {}", strerror(-ret));
+            SetError(-ret);
+            break;
+        }
+
+        void* data = io_uring_cqe_get_data(cqe);
+        int res = cqe->res;
+        io_uring_cqe_seen(&ring_, cqe);
+
+        if (data == &ring_) {
+            break;
+        }
+        if (!data) {
+            if (res < 0) {
+                SetError(-res);
+            }
+            continue;
+        }
+
+        Buffer* buffer = static_cast<Buffer*>(data);
+        if (res <= 0) {
+            Complete(buffer, res < 0 ? -res : EIO);
+            continue;
+        }
+        buffer->done += res;
+        if (buffer->done < buffer->length) {
+            // Short write, queue the remainder
+            QueueWrite(buffer);
+            continue;
+        }
+        Complete(buffer, 0);
+    }
+}
+#endif  // GP_HAVE_LIBURING
+
+}  // namespace GPlayer
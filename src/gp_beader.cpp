@@ -187,6 +187,22 @@ bool IBeader::Attach(const std::shared_ptr<GPPipeline>& pipeline)
     return false;
 }
 
+void IBeader::ApplyThreadPolicy(const std::string& thread_name)
+{
+    GPThreadPolicy policy;
+    auto pipeline = pipeline_.lock();
+    if (pipeline) {
+        pipeline->FindThreadPolicy(*this, thread_name, policy);
+    }
+
+    GPThreadPlacement placement = policy.Apply(thread_name);
+    placement.beader = name_;
+    SPDLOG_INFO("Thread placement: {}", placement.ToString());
+    if (pipeline) {
+        pipeline->AddThreadPlacement(placement);
+    }
+}
+
 int IBeader::Proc()
 {
     SPDLOG_CRITICAL("kill the warhog");
@@ -0,0 +1,599 @@
+
+#if defined(__aarch64__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define GP_BITSTREAM_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define GP_BITSTREAM_SSE2
+#endif
+
+#include <algorithm>
+
+#include "gp_bitstream.h"
+
+namespace GPlayer {
+
+#if defined(GP_BITSTREAM_NEON) || defined(GP_BITSTREAM_SSE2)
+#define GP_BITSTREAM_SIMD
+
+static const size_t kVectorWidth = 16;
+
+// Returns a mask with one lane per candidate position p[0] .. p[15], set when
+// p[i] == 0xFF and p[i + 1] == marker. Reads 17 bytes.
+#if defined(GP_BITSTREAM_NEON)
+static const int kLaneBits = 4;
+
+static inline uint64_t MatchMarker16(const uint8_t* p, uint8_t marker)
+{
+    uint8x16_t prefix = vceqq_u8(vld1q_u8(p), vdupq_n_u8(JPEG_MARKER_PREFIX));
+    uint8x16_t code = vceqq_u8(vld1q_u8(p + 1), vdupq_n_u8(marker));
+    uint8x16_t match = vandq_u8(prefix, code);
+
+    // NEON has no movemask; narrowing by 4 leaves one nibble per lane.
+    uint8x8_t nibbles = vshrn_n_u16(vreinterpretq_u16_u8(match), 4);
+    return vget_lane_u64(vreinterpret_u64_u8(nibbles), 0);
+}
+#else
+static const int kLaneBits = 1;
+
+static inline uint64_t MatchMarker16(const uint8_t* p, uint8_t marker)
+{
+    __m128i prefix =
+        _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)),
+                       _mm_set1_epi8(static_cast<char>(JPEG_MARKER_PREFIX)));
+    __m128i code = _mm_cmpeq_epi8(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 1)),
+        _mm_set1_epi8(static_cast<char>(marker)));
+    return static_cast<uint32_t>(
+        _mm_movemask_epi8(_mm_and_si128(prefix, code)));
+}
+#endif
+
+// Same lane layout as MatchMarker16, set when p[i .. i + 2] == 00 00 01.
+// Reads 18 bytes.
+#if defined(GP_BITSTREAM_NEON)
+static inline uint64_t MatchStartCode16(const uint8_t* p)
+{
+    uint8x16_t zero0 = vceqq_u8(vld1q_u8(p), vdupq_n_u8(0));
+    uint8x16_t zero1 = vceqq_u8(vld1q_u8(p + 1), vdupq_n_u8(0));
+    uint8x16_t one = vceqq_u8(vld1q_u8(p + 2), vdupq_n_u8(1));
+    uint8x16_t match = vandq_u8(vandq_u8(zero0, zero1), one);
+
+    uint8x8_t nibbles = vshrn_n_u16(vreinterpretq_u16_u8(match), 4);
+    return vget_lane_u64(vreinterpret_u64_u8(nibbles), 0);
+}
+#else
+static inline uint64_t MatchStartCode16(const uint8_t* p)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i zero0 = _mm_cmpeq_epi8(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), zero);
+    __m128i zero1 = _mm_cmpeq_epi8(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 1)), zero);
+    __m128i one = _mm_cmpeq_epi8(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 2)),
+        _mm_set1_epi8(1));
+    return static_cast<uint32_t>(_mm_movemask_epi8(
+        _mm_and_si128(_mm_and_si128(zero0, zero1), one)));
+}
+#endif
+#endif  // GP_BITSTREAM_NEON || GP_BITSTREAM_SSE2
+
+size_t FindJpegMarker(const uint8_t* data, size_t length, uint8_t marker)
+{
+    size_t i = 0;
+
+    if (length < 2) {
+        return length;
+    }
+
+#ifdef GP_BITSTREAM_SIMD
+    for (; i + kVectorWidth + 1 <= length; i += kVectorWidth) {
+        uint64_t mask = MatchMarker16(data + i, marker);
+        if (mask) {
+            return i + __builtin_ctzll(mask) / kLaneBits;
+        }
+    }
+#endif
+
+    for (; i + 1 < length; i++) {
+        if (data[i] == JPEG_MARKER_PREFIX && data[i + 1] == marker) {
+            return i;
+        }
+    }
+
+    return length;
+}
+
+size_t RFindJpegMarker(const uint8_t* data,
+                       size_t length,
+                       uint8_t marker,
+                       size_t search_size)
+{
+    if (length < 2) {
+        return length;
+    }
+
+    size_t begin = search_size < length ? length - search_size : 0;
+    size_t i = length - 1;
+
+#ifdef GP_BITSTREAM_SIMD
+    while (i >= begin + kVectorWidth) {
+        i -= kVectorWidth;
+        uint64_t mask = MatchMarker16(data + i, marker);
+        if (mask) {
+            return i + (63 - __builtin_clzll(mask)) / kLaneBits;
+        }
+    }
+#endif
+
+    while (i > begin) {
+        i--;
+        if (data[i] == JPEG_MARKER_PREFIX && data[i + 1] == marker) {
+            return i;
+        }
+    }
+
+    return length;
+}
+
+size_t FindStartCode(const uint8_t* data, size_t length)
+{
+    size_t i = 0;
+
+    if (length < 3) {
+        return length;
+    }
+
+#ifdef GP_BITSTREAM_SIMD
+    for (; i + kVectorWidth + 2 <= length; i += kVectorWidth) {
+        uint64_t mask = MatchStartCode16(data + i);
+        if (mask) {
+            return i + __builtin_ctzll(mask) / kLaneBits;
+        }
+    }
+#endif
+
+    for (; i + 2 < length; i++) {
+        if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1) {
+            return i;
+        }
+    }
+
+    return length;
+}
+
+int GetNaluType(GPVideoCodec codec, const uint8_t* nalu)
+{
+    if (codec == GPVideoCodec::H264) {
+        return nalu[0] & 0x1F;
+    }
+    return (nalu[0] >> 1) & 0x3F;
+}
+
+bool IsVclNalu(GPVideoCodec codec, int type)
+{
+    if (codec == GPVideoCodec::H264) {
+        return type >= 1 && type <= 5;
+    }
+    return type < 32;
+}
+
+bool IsKeyframeNalu(GPVideoCodec codec, int type)
+{
+    if (codec == GPVideoCodec::H264) {
+        return type == 5;
+    }
+    // IRAP pictures: BLA, IDR and CRA
+    return type >= 16 && type <= 21;
+}
+
+bool IsAccessUnitPrefixNalu(GPVideoCodec codec, int type)
+{
+    if (codec == GPVideoCodec::H264) {
+        // SEI, SPS, PPS, AUD and types 14..18
+        return (type >= 6 && type <= 9) || (type >= 14 && type <= 18);
+    }
+    // VPS, SPS, PPS, AUD, prefix SEI and types 41..44, 48..55
+    return (type >= 32 && type <= 35) || type == 39 ||
+           (type >= 41 && type <= 44) || (type >= 48 && type <= 55);
+}
+
+bool IsFirstSliceNalu(GPVideoCodec codec, const uint8_t* nalu)
+{
+    if (codec == GPVideoCodec::H264) {
+        // first_mb_in_slice == 0 is a single '1' bit in exp-Golomb
+        return nalu[1] & 0x80;
+    }
+    // first_slice_segment_in_pic_flag follows the two byte header
+    return nalu[2] & 0x80;
+}
+
+bool HasKeyframeNalu(GPVideoCodec codec, const uint8_t* data, size_t length)
+{
+    size_t pos = 0;
+
+    while (pos < length) {
+        size_t sc = pos + FindStartCode(data + pos, length - pos);
+        if (sc + 3 >= length) {
+            break;
+        }
+
+        int type = GetNaluType(codec, data + sc + 3);
+        if (IsVclNalu(codec, type)) {
+            return IsKeyframeNalu(codec, type);
+        }
+        pos = sc + 3;
+    }
+
+    return false;
+}
+
+bool IsKeyframe(GPVideoCodec codec, const uint8_t* data, size_t length)
+{
+    if (length >= 2 && data[0] == JPEG_MARKER_PREFIX &&
+        data[1] == JPEG_MARKER_SOI) {
+        return true;
+    }
+    return HasKeyframeNalu(codec, data, length);
+}
+
+// Reads the RBSP of a NAL unit, emulation prevention bytes taken out, as
+// fixed length and exp-Golomb fields. Reading past the end yields zeros and
+// marks the reader failed.
+class GPBitReader {
+public:
+    GPBitReader(const uint8_t* data, size_t length)
+    {
+        rbsp_.reserve(length);
+        int zeros = 0;
+        for (size_t i = 0; i < length; i++) {
+            if (zeros >= 2 && data[i] == 3) {
+                zeros = 0;
+                continue;
+            }
+            zeros = data[i] == 0 ? zeros + 1 : 0;
+            rbsp_.push_back(data[i]);
+        }
+    }
+
+    uint32_t Bit()
+    {
+        if (position_ >= rbsp_.size() * 8) {
+            failed_ = true;
+            return 0;
+        }
+        uint32_t bit = (rbsp_[position_ / 8] >> (7 - position_ % 8)) & 1;
+        position_++;
+        return bit;
+    }
+
+    uint32_t Bits(int count)
+    {
+        uint32_t value = 0;
+        while (count-- > 0) {
+            value = (value << 1) | Bit();
+        }
+        return value;
+    }
+
+    void Skip(size_t count)
+    {
+        position_ += count;
+        if (position_ > rbsp_.size() * 8) {
+            failed_ = true;
+        }
+    }
+
+    uint32_t Ue()
+    {
+        int zeros = 0;
+        while (!Bit()) {
+            if (failed_ || ++zeros > 31) {
+                failed_ = true;
+                return 0;
+            }
+        }
+        return ((1u << zeros) - 1) + Bits(zeros);
+    }
+
+    int32_t Se()
+    {
+        uint32_t value = Ue();
+        return value & 1 ? int32_t((value + 1) / 2) : -int32_t(value / 2);
+    }
+
+    bool Failed() const { return failed_; }
+
+private:
+    std::vector<uint8_t> rbsp_;
+    size_t position_ = 0;
+    bool failed_ = false;
+};
+
+static void SkipScalingList(GPBitReader& reader, int size)
+{
+    int last_scale = 8;
+    int next_scale = 8;
+    for (int i = 0; i < size && !reader.Failed(); i++) {
+        if (next_scale != 0) {
+            next_scale = (last_scale + reader.Se() + 256) % 256;
+        }
+        last_scale = next_scale == 0 ? last_scale : next_scale;
+    }
+}
+
+// timing_info of the VUI of an H.264 SPS; nalu starts at the NAL header
+static double GetH264FrameRate(const uint8_t* nalu, size_t length)
+{
+    GPBitReader reader(nalu + 1, length - 1);
+    uint32_t profile_idc = reader.Bits(8);
+    reader.Skip(16);  // constraint flags, level_idc
+    reader.Ue();      // seq_parameter_set_id
+    if (profile_idc == 100 || profile_idc == 110 || profile_idc == 122 ||
+        profile_idc == 244 || profile_idc == 44 || profile_idc == 83 ||
+        profile_idc == 86 || profile_idc == 118 || profile_idc == 128 ||
+        profile_idc == 138 || profile_idc == 139 || profile_idc == 134 ||
+        profile_idc == 135) {
+        uint32_t chroma_format_idc = reader.Ue();
+        if (chroma_format_idc == 3) {
+            reader.Skip(1);  // separate_colour_plane_flag
+        }
+        reader.Ue();     // bit_depth_luma_minus8
+        reader.Ue();     // bit_depth_chroma_minus8
+        reader.Skip(1);  // qpprime_y_zero_transform_bypass_flag
+        if (reader.Bit()) {
+            int lists = chroma_format_idc != 3 ? 8 : 12;
+            for (int i = 0; i < lists; i++) {
+                if (reader.Bit()) {
+                    SkipScalingList(reader, i < 6 ? 16 : 64);
+                }
+            }
+        }
+    }
+    reader.Ue();  // log2_max_frame_num_minus4
+    uint32_t pic_order_cnt_type = reader.Ue();
+    if (pic_order_cnt_type == 0) {
+        reader.Ue();  // log2_max_pic_order_cnt_lsb_minus4
+    }
+    else if (pic_order_cnt_type == 1) {
+        reader.Skip(1);  // delta_pic_order_always_zero_flag
+        reader.Se();     // offset_for_non_ref_pic
+        reader.Se();     // offset_for_top_to_bottom_field
+        uint32_t cycle = reader.Ue();
+        for (uint32_t i = 0; i < cycle && !reader.Failed(); i++) {
+            reader.Se();
+        }
+    }
+    reader.Ue();     // max_num_ref_frames
+    reader.Skip(1);  // gaps_in_frame_num_value_allowed_flag
+    reader.Ue();     // pic_width_in_mbs_minus1
+    reader.Ue();     // pic_height_in_map_units_minus1
+    if (!reader.Bit()) {
+        reader.Skip(1);  // mb_adaptive_frame_field_flag
+    }
+    reader.Skip(1);  // direct_8x8_inference_flag
+    if (reader.Bit()) {
+        for (int i = 0; i < 4; i++) {
+            reader.Ue();  // frame_crop offsets
+        }
+    }
+    if (!reader.Bit()) {
+        return 0;  // no vui_parameters
+    }
+
+    if (reader.Bit() && reader.Bits(8) == 255) {
+        reader.Skip(32);  // sar_width, sar_height of Extended_SAR
+    }
+    if (reader.Bit()) {
+        reader.Skip(1);  // overscan_appropriate_flag
+    }
+    if (reader.Bit()) {
+        reader.Skip(4);  // video_format, video_full_range_flag
+        if (reader.Bit()) {
+            reader.Skip(24);  // colour description
+        }
+    }
+    if (reader.Bit()) {
+        reader.Ue();  // chroma_sample_loc_type_top_field
+        reader.Ue();  // chroma_sample_loc_type_bottom_field
+    }
+    if (!reader.Bit()) {
+        return 0;  // no timing_info
+    }
+    uint32_t num_units_in_tick = reader.Bits(32);
+    uint32_t time_scale = reader.Bits(32);
+    if (reader.Failed() || num_units_in_tick == 0) {
+        return 0;
+    }
+    // A tick is a field, two of them make a frame
+    return time_scale / (2.0 * num_units_in_tick);
+}
+
+// vps_timing_info of an H.265 VPS; nalu starts at the NAL header
+static double GetH265FrameRate(const uint8_t* nalu, size_t length)
+{
+    GPBitReader reader(nalu + 2, length - 2);
+    // vps_video_parameter_set_id, base layer flags, vps_max_layers_minus1
+    reader.Skip(12);
+    uint32_t sub_layers = reader.Bits(3) + 1;
+    reader.Skip(17);  // vps_temporal_id_nesting_flag, reserved 0xffff
+
+    // profile_tier_level(1, sub_layers - 1)
+    reader.Skip(88 + 8);  // general profile, general_level_idc
+    bool profile_present[8];
+    bool level_present[8];
+    for (uint32_t i = 0; i + 1 < sub_layers; i++) {
+        profile_present[i] = reader.Bit();
+        level_present[i] = reader.Bit();
+    }
+    if (sub_layers > 1) {
+        reader.Skip((9 - sub_layers) * 2);  // reserved_zero_2bits
+    }
+    for (uint32_t i = 0; i + 1 < sub_layers; i++) {
+        reader.Skip((profile_present[i] ? 88 : 0) + (level_present[i] ? 8 : 0));
+    }
+
+    bool ordering_info_present = reader.Bit();
+    for (uint32_t i = ordering_info_present ? 0 : sub_layers - 1;
+         i < sub_layers; i++) {
+        reader.Ue();  // vps_max_dec_pic_buffering_minus1
+        reader.Ue();  // vps_max_num_reorder_pics
+        reader.Ue();  // vps_max_latency_increase_plus1
+    }
+    uint32_t max_layer_id = reader.Bits(6);
+    uint32_t layer_sets = reader.Ue() + 1;
+    reader.Skip(size_t(layer_sets - 1) * (max_layer_id + 1));
+    if (!reader.Bit()) {
+        return 0;  // no vps_timing_info
+    }
+    uint32_t num_units_in_tick = reader.Bits(32);
+    uint32_t time_scale = reader.Bits(32);
+    if (reader.Failed() || num_units_in_tick == 0) {
+        return 0;
+    }
+    return double(time_scale) / num_units_in_tick;
+}
+
+double GetFrameRate(GPVideoCodec codec, const uint8_t* data, size_t length)
+{
+    int type = codec == GPVideoCodec::H264 ? 7 : 32;
+    size_t pos = 0;
+
+    while (pos < length) {
+        size_t sc = pos + FindStartCode(data + pos, length - pos);
+        if (sc + 3 >= length) {
+            break;
+        }
+        const uint8_t* nalu = data + sc + 3;
+        size_t end = sc + 3 + FindStartCode(nalu, length - sc - 3);
+        size_t nalu_length = end - sc - 3;
+        pos = sc + 3;
+
+        if (nalu_length < 3 || GetNaluType(codec, nalu) != type) {
+            continue;
+        }
+        double fps = codec == GPVideoCodec::H264
+                         ? GetH264FrameRate(nalu, nalu_length)
+                         : GetH265FrameRate(nalu, nalu_length);
+        if (fps > 0) {
+            return fps;
+        }
+    }
+
+    return 0;
+}
+
+// A start code and the three bytes after it cover the NAL unit header and
+// the first byte of the slice header for both codecs.
+static const size_t kNaluProbeSize = 6;
+
+void GPAccessUnitParser::Parse(const uint8_t* data,
+                               size_t length,
+                               uint64_t offset,
+                               const Callback& callback)
+{
+    // Start codes that straddle the previous piece are searched in the
+    // carried tail joined with the head of this piece.
+    if (!carry_.empty()) {
+        size_t carried = carry_.size();
+        uint64_t carry_offset = offset - carried;
+        carry_.insert(carry_.end(), data,
+                      data + std::min(length, kNaluProbeSize));
+
+        size_t pos = 0;
+        while (pos < carried) {
+            size_t sc = pos + FindStartCode(carry_.data() + pos,
+                                            carry_.size() - pos);
+            if (sc >= carried || sc + kNaluProbeSize > carry_.size()) {
+                break;
+            }
+            if (carry_offset + sc >= next_offset_) {
+                OnNalu(carry_offset + sc, carry_.data() + sc + 3, callback);
+            }
+            pos = sc + 3;
+        }
+        carry_.resize(carried);
+    }
+
+    size_t pos = 0;
+    while (pos + kNaluProbeSize <= length) {
+        size_t sc = pos + FindStartCode(data + pos, length - pos);
+        if (sc + kNaluProbeSize > length) {
+            break;
+        }
+        if (offset + sc >= next_offset_) {
+            OnNalu(offset + sc, data + sc + 3, callback);
+        }
+        pos = sc + 3;
+    }
+
+    // Keep the last few bytes of the stream for the next piece
+    if (length >= kNaluProbeSize) {
+        carry_.assign(data + length - kNaluProbeSize, data + length);
+    }
+    else {
+        carry_.insert(carry_.end(), data, data + length);
+        if (carry_.size() > kNaluProbeSize) {
+            carry_.erase(carry_.begin(), carry_.end() - kNaluProbeSize);
+        }
+    }
+}
+
+void GPAccessUnitParser::OnNalu(uint64_t offset,
+                                const uint8_t* nalu,
+                                const Callback& callback)
+{
+    next_offset_ = offset + 3;
+
+    int type = GetNaluType(codec_, nalu);
+    bool vcl = IsVclNalu(codec_, type);
+    bool boundary = false;
+
+    if (!started_) {
+        boundary = true;
+    }
+    else if (has_vcl_) {
+        boundary = vcl ? IsFirstSliceNalu(codec_, nalu)
+                       : IsAccessUnitPrefixNalu(codec_, type);
+    }
+
+    if (boundary) {
+        if (started_) {
+            current_.size = offset - current_.offset;
+            callback(current_);
+            current_.index++;
+        }
+        current_.offset = offset;
+        current_.keyframe = false;
+        started_ = true;
+        has_vcl_ = false;
+    }
+
+    if (vcl) {
+        has_vcl_ = true;
+        if (IsKeyframeNalu(codec_, type)) {
+            current_.keyframe = true;
+        }
+    }
+}
+
+void GPAccessUnitParser::Finish(uint64_t end_offset, const Callback& callback)
+{
+    if (started_ && end_offset > current_.offset) {
+        current_.size = end_offset - current_.offset;
+        callback(current_);
+    }
+    Reset();
+}
+
+void GPAccessUnitParser::Reset()
+{
+    carry_.clear();
+    next_offset_ = 0;
+    current_ = {0, 0, 0, false};
+    started_ = false;
+    has_vcl_ = false;
+}
+
+}  // namespace GPlayer
@@ -26,12 +26,17 @@
 
 #include "NvJpegDecoder.h"
 
+#include "gp_bitstream.h"
 #include "gp_camera_v4l2.h"
 #include "gp_log.h"
+#include "gp_mjpeg_demuxer.h"
+#include "gp_threadpool.h"
 #include "nlohmann/json.hpp"
 namespace GPlayer {
 
 #define MJPEG_EOS_SEARCH_SIZE 4096
+// Rows per chunk when a plane is cleared on the thread pool
+#define CLEAR_CHROMA_ROWS 64
 
 static bool quit = false;
 
@@ -39,7 +44,8 @@ using namespace std;
 
 GPCameraV4l2::GPCameraV4l2()
 {
-    SetProperties("", "", BeaderType::CameraV4l2Src, false);
+    SetProperties("GPCameraV4l2", "GPCameraV4l2", BeaderType::CameraV4l2Src,
+                  false);
 
     nvcolor_fmt_ = {
         // TODO: add more pixel format mapping
@@ -224,7 +230,6 @@ bool GPCameraV4l2::nvbuff_do_clearchroma(int dmabuf_fd)
     NvBufferParams params = {0};
     void* sBaseAddr[3] = {NULL};
     int ret = 0;
-    int size;
     unsigned i;
 
     ret = NvBufferGetParams(dmabuf_fd, &params);
@@ -241,8 +246,14 @@ bool GPCameraV4l2::nvbuff_do_clearchroma(int dmabuf_fd)
         if (ret != 0)
             ERROR_RETURN("{}: NvBufferMemSyncForCpu Failed \n", __func__);
 
-        size = params.height[i] * params.pitch[i];
-        memset(sBaseAddr[i], 0x80, size);
+        uint8_t* base = static_cast<uint8_t*>(sBaseAddr[i]);
+        size_t pitch = params.pitch[i];
+        GPThreadPool::GetInstance().ParallelFor(
+            0, params.height[i],
+            [base, pitch](size_t first, size_t last) {
+                memset(base + first * pitch, 0x80, (last - first) * pitch);
+            },
+            CLEAR_CHROMA_ROWS);
 
         ret = NvBufferMemSyncForDevice(dmabuf_fd, i, &sBaseAddr[i]);
         if (ret != 0)
@@ -540,6 +551,8 @@ bool GPCameraV4l2::start_capture(v4l2_context_t* ctx)
         GetChild(BeaderType::NvJpegDecoder).get());
     GPDisplayEGLSink* display = dynamic_cast<GPDisplayEGLSink*>(
         GetChild(BeaderType::EGLDisplaySink).get());
+    GPMjpegDemuxer* mjpeg_demuxer = dynamic_cast<GPMjpegDemuxer*>(
+        GetChild(BeaderType::MjpegDemuxer).get());
 
     // Ensure a clean shutdown if user types <ctrl+c>
     sig_action.sa_handler = signal_handle;
@@ -612,24 +625,25 @@ bool GPCameraV4l2::start_capture(v4l2_context_t* ctx)
             if (ctx->cam_pixfmt == V4L2_PIX_FMT_MJPEG) {
                 int fd = 0;
                 uint32_t width, height, pixfmt;  // out parameters
-                unsigned int i = 0;
-                unsigned int eos_search_size = MJPEG_EOS_SEARCH_SIZE;
                 unsigned int bytesused = bufsize;
-                uint8_t* p;
 
                 // v4l2_buf.bytesused may have padding bytes for alignment
-                // Search for EOF to get exact size
-                if (eos_search_size > bytesused)
-                    eos_search_size = bytesused;
-                for (i = 0; i < eos_search_size; i++) {
-                    p = (uint8_t*)(pbuf + bytesused);
-                    if ((*(p - 2) == 0xff) && (*(p - 1) == 0xd9)) {
-                        break;
-                    }
-                    bytesused--;
+                // Search for EOF to get exact size. The frame may end at any
+                // of the last MJPEG_EOS_SEARCH_SIZE positions, so the EOI
+                // marker lies in the last MJPEG_EOS_SEARCH_SIZE + 1 bytes.
+                size_t eoi = RFindJpegMarker(pbuf, bufsize, JPEG_MARKER_EOI,
+                                             MJPEG_EOS_SEARCH_SIZE + 1);
+                if (eoi != bufsize) {
+                    bytesused = eoi + 2;
                 }
 
-                if (!jpeg_decoder) {
+                if (mjpeg_demuxer) {
+                    // The demuxer decodes through its own linked decoder
+                    GPBuffer gpbuffer(pbuf, bytesused);
+                    GPData data(&gpbuffer);
+                    mjpeg_demuxer->Process(&data);
+                }
+                else if (!jpeg_decoder) {
                     SPDLOG_TRACE("No found MJPEG decoder in this beader.");
                 }
                 else {
@@ -729,7 +743,7 @@ int GPCameraV4l2::Proc()
     v4l2_context_t& ctx = ctx_;
     int error = 0;
 
-    pthread_setname_np(pthread_self(), "GPCameraV4l2::Proc");
+    ApplyThreadPolicy("CameraCapture");
 
     CHECK_ERROR(init_components(&ctx), cleanup,
                 "Failed to initialize v4l2 components");
@@ -0,0 +1,180 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include "gp_file_cache.h"
+#include "gp_log.h"
+
+namespace GPlayer {
+
+// How much of the file one step of the access unit parser takes in
+#define MAPPED_PARSE_CHUNK_SIZE (1024 * 1024)
+
+std::mutex GPFileCache::mutex_;
+std::map<std::pair<dev_t, ino_t>, std::weak_ptr<GPMappedFile>>
+    GPFileCache::files_;
+
+GPMappedFile::~GPMappedFile()
+{
+    if (data_) {
+        munmap(const_cast<uint8_t*>(data_), size_);
+    }
+}
+
+bool GPMappedFile::FindNalUnit(uint64_t position,
+                               uint64_t* begin,
+                               uint64_t* end)
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+
+    // Scan on until the NAL unit and the start code after it are known
+    while (nal_scanned_ < size_ &&
+           (nal_units_.size() < 2 ||
+            nal_units_[nal_units_.size() - 2] < position)) {
+        uint64_t offset =
+            nal_scanned_ + FindStartCode(data_ + nal_scanned_,
+                                         size_ - nal_scanned_);
+        if (offset >= size_) {
+            nal_scanned_ = size_;
+            SPDLOG_TRACE("{}: {} NAL units", filepath_, nal_units_.size());
+            break;
+        }
+        nal_units_.push_back(offset);
+        nal_scanned_ = offset + 3;
+    }
+
+    auto it = std::lower_bound(nal_units_.begin(), nal_units_.end(), position);
+    if (it == nal_units_.end()) {
+        return false;
+    }
+    *begin = *it;
+    *end = it + 1 != nal_units_.end() ? *(it + 1) : size_;
+    return true;
+}
+
+bool GPMappedFile::FindAccessUnit(GPVideoCodec codec,
+                                  uint64_t position,
+                                  GPAccessUnit* access_unit)
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+
+    AccessUnitTable& table = access_units_[static_cast<int>(codec)];
+    while ((table.access_units.empty() ||
+            table.access_units.back().offset < position) &&
+           ParseAccessUnits(codec, table)) {
+    }
+
+    auto it = std::lower_bound(
+        table.access_units.begin(), table.access_units.end(), position,
+        [](const GPAccessUnit& au, uint64_t p) { return au.offset < p; });
+    if (it == table.access_units.end()) {
+        return false;
+    }
+    *access_unit = *it;
+    return true;
+}
+
+const std::vector<GPAccessUnit>& GPMappedFile::GetAccessUnits(
+    GPVideoCodec codec)
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+
+    AccessUnitTable& table = access_units_[static_cast<int>(codec)];
+    while (ParseAccessUnits(codec, table)) {
+    }
+    // Complete, so it does not change any more
+    return table.access_units;
+}
+
+bool GPMappedFile::ParseAccessUnits(GPVideoCodec codec,
+                                    AccessUnitTable& table)
+{
+    if (table.parsed == size_) {
+        return false;
+    }
+    if (!table.parser) {
+        table.parser = std::make_unique<GPAccessUnitParser>(codec);
+    }
+
+    auto on_access_unit = [&table](const GPAccessUnit& access_unit) {
+        table.access_units.push_back(access_unit);
+    };
+    uint64_t length =
+        std::min<uint64_t>(MAPPED_PARSE_CHUNK_SIZE, size_ - table.parsed);
+    table.parser->Parse(data_ + table.parsed, length, table.parsed,
+                        on_access_unit);
+    table.parsed += length;
+    if (table.parsed == size_) {
+        table.parser->Finish(size_, on_access_unit);
+        table.parser.reset();
+        SPDLOG_TRACE("{}: {} access units", filepath_,
+                     table.access_units.size());
+    }
+    return true;
+}
+
+std::shared_ptr<GPMappedFile> GPFileCache::Open(const std::string& filepath)
+{
+    int fd = open(filepath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        SPDLOG_ERROR("Failed to open {}: {}", filepath, strerror(errno));
+        return nullptr;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+        close(fd);
+        return nullptr;
+    }
+
+    int64_t mtime = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+    auto key = std::make_pair(st.st_dev, st.st_ino);
+
+    std::lock_guard<std::mutex> guard(mutex_);
+
+    auto it = files_.find(key);
+    if (it != files_.end()) {
+        auto file = it->second.lock();
+        if (file && file->size_ == static_cast<uint64_t>(st.st_size) &&
+            file->mtime_ == mtime) {
+            close(fd);
+            return file;
+        }
+    }
+
+    void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping keeps its own reference to the file
+    close(fd);
+    if (addr == MAP_FAILED) {
+        SPDLOG_WARN("Failed to map {}: {}, falling back to reads", filepath,
+                    strerror(errno));
+        return nullptr;
+    }
+    madvise(addr, st.st_size, MADV_SEQUENTIAL);
+
+    std::shared_ptr<GPMappedFile> file(new GPMappedFile());
+    file->filepath_ = filepath;
+    file->data_ = static_cast<const uint8_t*>(addr);
+    file->size_ = st.st_size;
+    file->mtime_ = mtime;
+
+    // Forget the files nobody reads any more
+    for (auto entry = files_.begin(); entry != files_.end();) {
+        if (entry->second.expired()) {
+            entry = files_.erase(entry);
+        }
+        else {
+            ++entry;
+        }
+    }
+    files_[key] = file;
+
+    SPDLOG_TRACE("Map input file {}, {} bytes", filepath, file->size_);
+    return file;
+}
+
+}  // namespace GPlayer
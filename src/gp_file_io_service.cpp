@@ -0,0 +1,448 @@
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#ifdef GP_HAVE_LIBURING
+#include <sys/eventfd.h>
+#endif
+
+#include "gp_file_io_service.h"
+#include "gp_log.h"
+
+namespace GPlayer {
+
+#define IO_RING_ENTRIES 256
+
+static size_t AlignUp(size_t value, size_t alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+GPFileIOStream::~GPFileIOStream()
+{
+    {
+        // Chunk memory must outlive the reads in flight
+        std::unique_lock<std::mutex> lock(mutex_);
+        closing_ = true;
+        condition_.wait(lock, [this]() { return inflight_ == 0; });
+    }
+    service_->Remove(this);
+    close(fd_);
+}
+
+std::streamsize GPFileIOStream::Read(char* buffer, std::streamsize count)
+{
+    std::streamsize total = 0;
+    bool wake = false;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (total < count) {
+        if (error_) {
+            if (total == 0) {
+                total = -1;
+            }
+            break;
+        }
+        if (count_ == 0 && next_offset_ >= size_) {
+            break;
+        }
+
+        Chunk& chunk = chunks_[head_];
+        if (count_ == 0 || !chunk.ready) {
+            // Hand out what is there rather than wait for more
+            if (total > 0) {
+                break;
+            }
+            lock.unlock();
+            service_->Wake(this);
+            wake = false;
+            lock.lock();
+            condition_.wait(lock, [this]() {
+                return error_ || (count_ == 0 && next_offset_ >= size_) ||
+                       (count_ > 0 && chunks_[head_].ready);
+            });
+            continue;
+        }
+
+        size_t length =
+            std::min<size_t>(count - total, chunk.filled - chunk.consumed);
+        memcpy(buffer + total, chunk.data + chunk.consumed, length);
+        chunk.consumed += length;
+        total += length;
+        position_ += length;
+
+        if (chunk.consumed == chunk.filled) {
+            head_ = (head_ + 1) % chunks_.size();
+            count_--;
+            wake = true;
+        }
+    }
+    lock.unlock();
+
+    if (wake) {
+        service_->Wake(this);
+    }
+    return total;
+}
+
+void GPFileIOStream::Seek(uint64_t offset)
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        condition_.wait(lock, [this]() { return inflight_ == 0; });
+        head_ = 0;
+        count_ = 0;
+        next_offset_ = std::min(offset, size_);
+        position_ = next_offset_;
+        error_ = 0;
+    }
+    service_->Wake(this);
+}
+
+std::shared_ptr<GPFileIOService> GPFileIOService::GetInstance()
+{
+    // The service and its thread live as long as any stream uses them
+    static std::mutex mutex;
+    static std::weak_ptr<GPFileIOService> instance;
+
+    std::lock_guard<std::mutex> guard(mutex);
+    std::shared_ptr<GPFileIOService> service = instance.lock();
+    if (!service) {
+        service.reset(new GPFileIOService());
+        instance = service;
+    }
+    return service;
+}
+
+GPFileIOService::GPFileIOService()
+{
+#ifdef GP_HAVE_LIBURING
+    use_ring_ = SetupRing();
+    if (use_ring_) {
+        worker_ = std::thread(&GPFileIOService::RingProc, this);
+        return;
+    }
+#endif
+    worker_ = std::thread(&GPFileIOService::ReadProc, this);
+}
+
+GPFileIOService::~GPFileIOService()
+{
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        stop_ = true;
+    }
+    condition_.notify_all();
+#ifdef GP_HAVE_LIBURING
+    if (use_ring_) {
+        eventfd_write(wake_fd_, 1);
+    }
+#endif
+    worker_.join();
+
+#ifdef GP_HAVE_LIBURING
+    if (use_ring_) {
+        io_uring_queue_exit(&ring_);
+        close(wake_fd_);
+    }
+#endif
+}
+
+std::unique_ptr<GPFileIOStream> GPFileIOService::Open(
+    const std::string& filepath,
+    const GPFileIOOptions& options)
+{
+    int fd = open(filepath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        SPDLOG_ERROR("Failed to open {}: {}", filepath, strerror(errno));
+        return nullptr;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        SPDLOG_ERROR("Failed to stat {}: {}", filepath, strerror(errno));
+        close(fd);
+        return nullptr;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    std::unique_ptr<GPFileIOStream> stream(new GPFileIOStream());
+    stream->service_ = shared_from_this();
+    stream->filepath_ = filepath;
+    stream->fd_ = fd;
+    stream->size_ = st.st_size;
+
+    size_t chunk_size = AlignUp(std::max<size_t>(options.chunk_size, 1),
+                                static_cast<size_t>(getpagesize()));
+    size_t window = std::max<size_t>(options.window, 1);
+    stream->memory_.resize(chunk_size * window);
+    for (size_t i = 0; i < window; i++) {
+        stream->chunks_.push_back({stream.get(),
+                                   stream->memory_.data() + i * chunk_size,
+                                   0, chunk_size, 0, 0, false});
+    }
+
+    Wake(stream.get());
+    return stream;
+}
+
+void GPFileIOService::Wake(GPFileIOStream* stream)
+{
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        if (stream->queued_) {
+            return;
+        }
+        stream->queued_ = true;
+        requests_.push_back(stream);
+    }
+
+#ifdef GP_HAVE_LIBURING
+    if (use_ring_) {
+        eventfd_write(wake_fd_, 1);
+        return;
+    }
+#endif
+    condition_.notify_one();
+}
+
+void GPFileIOService::Remove(GPFileIOStream* stream)
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    requests_.erase(std::remove(requests_.begin(), requests_.end(), stream),
+                    requests_.end());
+}
+
+// Claims the free chunks of a stream for reading; called with mutex_ held,
+// so a stream is not destroyed while it is being filled.
+std::vector<GPFileIOStream::Chunk*> GPFileIOService::Fill(
+    GPFileIOStream* stream)
+{
+    std::vector<GPFileIOStream::Chunk*> chunks;
+    stream->queued_ = false;
+
+    std::lock_guard<std::mutex> guard(stream->mutex_);
+    if (stream->closing_ || stream->error_) {
+        return chunks;
+    }
+
+    size_t chunk_size = stream->memory_.size() / stream->chunks_.size();
+    while (stream->count_ < stream->chunks_.size() &&
+           stream->next_offset_ < stream->size_) {
+        GPFileIOStream::Chunk& chunk =
+            stream->chunks_[(stream->head_ + stream->count_) %
+                            stream->chunks_.size()];
+        chunk.offset = stream->next_offset_;
+        chunk.length = std::min<uint64_t>(chunk_size,
+                                          stream->size_ - chunk.offset);
+        chunk.filled = 0;
+        chunk.consumed = 0;
+        chunk.ready = false;
+
+        stream->next_offset_ += chunk.length;
+        stream->count_++;
+        stream->inflight_++;
+        chunks.push_back(&chunk);
+    }
+    return chunks;
+}
+
+// Accounts a finished read; returns false while the chunk still misses data
+bool GPFileIOService::Complete(GPFileIOStream::Chunk* chunk, ssize_t result)
+{
+    GPFileIOStream* stream = chunk->stream;
+
+    if (result > 0) {
+        chunk->filled += result;
+        if (chunk->filled < chunk->length) {
+            return false;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(stream->mutex_);
+        if (result < 0) {
+            if (!stream->error_) {
+                stream->error_ = -result;
+                SPDLOG_ERROR("Failed to read {}: {}", stream->filepath_,
+                             strerror(-result));
+            }
+        }
+        else if (result == 0) {
+            // The file got shorter since it was opened
+            chunk->length = chunk->filled;
+            stream->size_ =
+                std::min(stream->size_, chunk->offset + chunk->filled);
+        }
+        chunk->ready = true;
+        stream->inflight_--;
+        // Under the lock: once inflight_ reaches 0 the stream's destructor
+        // may return and free the condition variable as soon as the lock
+        // is let go
+        stream->condition_.notify_all();
+    }
+    return true;
+}
+
+void GPFileIOService::ReadProc()
+{
+    pthread_setname_np(pthread_self(), "GPFileIO");
+
+    for (;;) {
+        std::vector<GPFileIOStream::Chunk*> chunks;
+        int fd;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            condition_.wait(lock,
+                            [this]() { return stop_ || !requests_.empty(); });
+            if (stop_) {
+                break;
+            }
+            GPFileIOStream* stream = requests_.front();
+            requests_.pop_front();
+            chunks = Fill(stream);
+            fd = stream->fd_;
+        }
+        if (chunks.empty()) {
+            continue;
+        }
+
+        // The claimed chunks are consecutive in the file, so one preadv
+        // fills all of them
+        std::vector<struct iovec> iov;
+        for (auto* chunk : chunks) {
+            iov.push_back({chunk->data, chunk->length});
+        }
+        ssize_t ret = preadv(fd, iov.data(), iov.size(), chunks[0]->offset);
+        int error = ret < 0 ? errno : 0;
+
+        for (auto* chunk : chunks) {
+            if (ret > 0) {
+                ssize_t length = std::min<ssize_t>(ret, chunk->length);
+                ret -= length;
+                if (Complete(chunk, length)) {
+                    continue;
+                }
+            }
+            else if (ret < 0 && error != EINTR) {
+                Complete(chunk, -error);
+                continue;
+            }
+
+            // Short read, fill the rest of the chunk on its own
+            for (;;) {
+                ssize_t length =
+                    pread(fd, chunk->data + chunk->filled,
+                          chunk->length - chunk->filled,
+                          chunk->offset + chunk->filled);
+                if (length < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (Complete(chunk, length < 0 ? -errno : length)) {
+                    break;
+                }
+            }
+        }
+    }
+}
+
+#ifdef GP_HAVE_LIBURING
+bool GPFileIOService::SetupRing()
+{
+    int ret = io_uring_queue_init(IO_RING_ENTRIES, &ring_, 0);
+    if (ret < 0) {
+        SPDLOG_WARN("io_uring is not available ({}), using preadv",
+                    strerror(-ret));
+        return false;
+    }
+
+    wake_fd_ = eventfd(0, EFD_CLOEXEC);
+    if (wake_fd_ < 0) {
+        io_uring_queue_exit(&ring_);
+        return false;
+    }
+    return true;
+}
+
+void GPFileIOService::QueueRead(GPFileIOStream::Chunk* chunk)
+{
+    struct io_uring_sqe* sqe;
+    while (!(sqe = io_uring_get_sqe(&ring_))) {
+        io_uring_submit(&ring_);
+    }
+    io_uring_prep_read(sqe, chunk->stream->fd_, chunk->data + chunk->filled,
+                       chunk->length - chunk->filled,
+                       chunk->offset + chunk->filled);
+    io_uring_sqe_set_data(sqe, chunk);
+}
+
+// Reads the eventfd through the ring, so new requests wake up the wait for
+// completions
+void GPFileIOService::ArmWakeup()
+{
+    struct io_uring_sqe* sqe;
+    while (!(sqe = io_uring_get_sqe(&ring_))) {
+        io_uring_submit(&ring_);
+    }
+    io_uring_prep_read(sqe, wake_fd_, &wake_value_, sizeof(wake_value_), 0);
+    io_uring_sqe_set_data(sqe, &wake_fd_);
+}
+
+void GPFileIOService::RingProc()
+{
+    pthread_setname_np(pthread_self(), "GPFileIO");
+
+    ArmWakeup();
+    io_uring_submit(&ring_);
+
+    for (;;) {
+        struct io_uring_cqe* cqe;
+        int ret = io_uring_wait_cqe(&ring_, &cqe);
+        if (ret < 0 && ret != -EINTR) {
+            SPDLOG_CRITICAL("io_uring wait failed: {}", strerror(-ret));
+            break;
+        }
+
+        unsigned head;
+        unsigned completions = 0;
+        io_uring_for_each_cqe(&ring_, head, cqe)
+        {
+            void* data = io_uring_cqe_get_data(cqe);
+            if (data == &wake_fd_) {
+                ArmWakeup();
+            }
+            else {
+                auto* chunk = static_cast<GPFileIOStream::Chunk*>(data);
+                if (!Complete(chunk, cqe->res)) {
+                    QueueRead(chunk);
+                }
+            }
+            completions++;
+        }
+        io_uring_cq_advance(&ring_, completions);
+
+        {
+            std::lock_guard<std::mutex> guard(mutex_);
+            if (stop_) {
+                break;
+            }
+            // Every stream waiting for data goes into one submission
+            while (!requests_.empty()) {
+                GPFileIOStream* stream = requests_.front();
+                requests_.pop_front();
+                for (auto* chunk : Fill(stream)) {
+                    QueueRead(chunk);
+                }
+            }
+        }
+        io_uring_submit(&ring_);
+    }
+}
+#endif
+
+}  // namespace GPlayer
@@ -3,23 +3,28 @@
 
 namespace GPlayer {
 
-GPFileSink::GPFileSink(std::string filepath) : filepath_(filepath)
+GPFileSink::GPFileSink(std::string filepath,
+                       const GPAsyncFileWriterOptions& options)
+    : writer_(std::make_unique<GPAsyncFileWriter>(options)),
+      filepath_(filepath)
 {
     SetProperties("GPFileSink", "GPFileSink", BeaderType::FileSink, true);
 
-    outfile_ = new std::ofstream(filepath);
-    if (outfile_->is_open()) {
+    if (writer_->Open(filepath)) {
         SPDLOG_TRACE("Open output file {}", filepath);
     }
-    else {
-        SPDLOG_CRITICAL("Failed to open output file {}", filepath);
-    }
+}
+
+GPFileSink::GPFileSink()
+{
+    SetProperties("GPFileSink", "GPFileSink", BeaderType::FileSink, true);
 }
 
 GPFileSink::~GPFileSink()
 {
-    outfile_->close();
-    delete outfile_;
+    if (writer_) {
+        writer_->Close();
+    }
 }
 
 std::string GPFileSink::GetInfo() const
@@ -30,8 +35,7 @@ std::string GPFileSink::GetInfo() const
 void GPFileSink::Process(GPData* data)
 {
     GPBuffer* buffer = *data;
-    outfile_->write(reinterpret_cast<const char*>(buffer->GetData()),
-                    buffer->GetLength());
+    writer_->Write(buffer->GetData(), buffer->GetLength());
 }
 
 }  // namespace GPlayer
@@ -1,27 +1,64 @@
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <future>
+#include <thread>
+
+#include "gp_file_cache.h"
+#include "gp_file_io_service.h"
 #include "gp_filesrc.h"
 #include "gp_log.h"
 
 namespace GPlayer {
 
-GPFileSrc::GPFileSrc(std::string filepath) : filepath_(filepath)
-{
-    inputfile_ =
-        new std::ifstream(filepath, std::ifstream::in | std::ifstream::binary);
+#define INDEX_READ_CHUNK_SIZE (4 * 1024 * 1024)
+#define INDEX_FILE_SUFFIX ".gpidx"
+#define INDEX_FILE_VERSION 1
+// The parameter sets are looked for at the head of the file
+#define FRAME_RATE_PROBE_SIZE (64 * 1024)
+
+struct GPKeyframeIndexHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t codec;
+    uint32_t reserved;
+    uint64_t file_size;
+    int64_t mtime;
+    uint64_t frame_count;
+    uint64_t entry_count;
+};
+
+static const char kIndexMagic[4] = {'G', 'P', 'I', 'X'};
 
+// Pages ahead of the read position that are requested with MADV_WILLNEED
+#define MMAP_READAHEAD_SIZE (16 * 1024 * 1024)
+
+#define ACCESS_UNIT_READ_SIZE (1024 * 1024)
+// A real-time source this late starts a new timeline instead of bursting
+#define PACING_RESYNC_TIME std::chrono::seconds(1)
+#define PACING_REPORT_INTERVAL std::chrono::seconds(5)
+
+GPFileSrc::GPFileSrc(std::string filepath, bool use_mmap)
+    : filepath_(filepath), use_mmap_(use_mmap)
+{
     SetProperties("GPFileSrc", "GPFileSrc", BeaderType::FileSrc, true);
 
-    if (inputfile_->is_open()) {
-        SPDLOG_TRACE("Open input file {}", filepath);
-    }
-    else {
-        SPDLOG_CRITICAL("Failed to open input file {}", filepath);
+    playlist_.push_back(filepath);
+    source_ = OpenSource(filepath, use_mmap_);
+    if (source_) {
+        mapped_ = source_->mapping != nullptr;
     }
 }
 
 GPFileSrc::~GPFileSrc()
 {
-    inputfile_->close();
-    delete inputfile_;
+    if (next_source_.valid()) {
+        next_source_.wait();
+    }
 }
 
 std::string GPFileSrc::GetInfo() const
@@ -32,13 +69,732 @@ std::string GPFileSrc::GetInfo() const
 void GPFileSrc::Process(GPData* data)
 {
     GPBuffer* buffer = *data;
-    inputfile_->read(reinterpret_cast<char*>(buffer->GetData()),
-                     buffer->GetLength());
+    Read(reinterpret_cast<char*>(buffer->GetData()), buffer->GetLength());
+}
+
+void GPFileSrc::SetLoop(bool loop, uint32_t count)
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    loop_ = loop;
+    loop_count_ = count;
+    Prefetch();
+}
+
+void GPFileSrc::Enqueue(const std::string& filepath)
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    playlist_.push_back(filepath);
+    Prefetch();
+}
+
+std::streamsize GPFileSrc::Read(char* buffer, std::streamsize count)
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+
+    // A read stops at the end of a file, the next one starts the next file
+    for (;;) {
+        if (!source_ && !SwitchToNext()) {
+            return 0;
+        }
+
+        std::streamsize length;
+        if (source_->mapping) {
+            length = std::min<uint64_t>(count,
+                                        source_->size - source_->position);
+            memcpy(buffer, source_->mapping.get() + source_->position, length);
+            Advance(*source_, length);
+        }
+        else {
+            // Read errors end the file, the playlist carries on
+            length = std::max<std::streamsize>(
+                source_->stream->Read(buffer, count), 0);
+        }
+
+        if (length > 0 || !SwitchToNext()) {
+            return length;
+        }
+    }
+}
+
+// The mapping stays alive as long as any view handed out from it
+std::shared_ptr<GPBuffer> GPFileSrc::PeekView(size_t count)
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+
+    // Also steps over files that could not be mapped, e.g. empty ones
+    while (source_ && (source_->mapping ? source_->position >= source_->size
+                                        : source_->stream->Tell() >=
+                                              source_->stream->GetSize())) {
+        if (!SwitchToNext()) {
+            return nullptr;
+        }
+    }
+    if (!source_ || !source_->mapping) {
+        return nullptr;
+    }
+
+    size_t length = std::min<uint64_t>(
+        {count, source_->size - source_->position, UINT32_MAX});
+    std::shared_ptr<const uint8_t> mapping = source_->mapping;
+    return std::shared_ptr<GPBuffer>(
+        new GPBuffer(const_cast<uint8_t*>(mapping.get()) + source_->position,
+                     length),
+        [mapping](GPBuffer* buffer) { delete buffer; });
+}
+
+std::shared_ptr<GPBuffer> GPFileSrc::ReadView(size_t count)
+{
+    auto view = PeekView(count);
+    if (view) {
+        Skip(view->GetLength());
+    }
+    return view;
+}
+
+void GPFileSrc::Skip(size_t count)
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+
+    if (!source_) {
+        return;
+    }
+    if (source_->mapping) {
+        Advance(*source_,
+                std::min<uint64_t>(count, source_->size - source_->position));
+    }
+    else {
+        source_->stream->Seek(source_->stream->Tell() + count);
+    }
+}
+
+std::unique_ptr<GPFileSrc::Source> GPFileSrc::OpenSource(
+    const std::string& filepath,
+    bool use_mmap)
+{
+    auto source = std::make_unique<Source>();
+    source->path = filepath;
+
+    if (use_mmap && Map(*source)) {
+        return source;
+    }
+
+    // Reads go through the shared I/O thread, so a slow disk does not block
+    // the consumer while the read-ahead window has data
+    source->stream = GPFileIOService::GetInstance()->Open(filepath);
+    if (!source->stream) {
+        SPDLOG_CRITICAL("Failed to open input file {}", filepath);
+        return nullptr;
+    }
+
+    SPDLOG_TRACE("Open input file {}", filepath);
+    return source;
 }
 
-std::basic_istream<char>& GPFileSrc::Read(char* buffer, std::streamsize count)
+bool GPFileSrc::Map(Source& source)
 {
-    return inputfile_->read(buffer, count);
+    source.file = GPFileCache::Open(source.path);
+    if (!source.file) {
+        return false;
+    }
+
+    // The views share the ownership of the cached file
+    source.mapping =
+        std::shared_ptr<const uint8_t>(source.file, source.file->GetData());
+    source.size = source.file->GetSize();
+    source.position = 0;
+    source.advised_end = 0;
+
+    Advance(source, 0);
+    return true;
+}
+
+// Moves the read position of a mapped source and keeps the kernel readahead
+// MMAP_READAHEAD_SIZE bytes in front of it
+void GPFileSrc::Advance(Source& source, size_t count)
+{
+    source.position += count;
+
+    if (source.advised_end >= source.size ||
+        source.position + MMAP_READAHEAD_SIZE / 2 < source.advised_end) {
+        return;
+    }
+
+    const uint64_t page_mask = ~(static_cast<uint64_t>(getpagesize()) - 1);
+    uint64_t begin = std::max(source.advised_end, source.position) & page_mask;
+    uint64_t end =
+        std::min<uint64_t>(source.position + MMAP_READAHEAD_SIZE, source.size);
+    madvise(const_cast<uint8_t*>(source.mapping.get()) + begin, end - begin,
+            MADV_WILLNEED);
+    source.advised_end = end;
+}
+
+// Returns the playlist entry played after the current one, or -1 at the end
+// of the playlist; called with mutex_ held.
+int GPFileSrc::NextPlaylistIndex() const
+{
+    if (playlist_index_ + 1 < playlist_.size()) {
+        return playlist_index_ + 1;
+    }
+    if (loop_ && (loop_count_ == 0 || loops_done_ + 1 < loop_count_)) {
+        return 0;
+    }
+    return -1;
+}
+
+// Opens the next file of the playlist in the background while the current
+// one plays; called with mutex_ held.
+void GPFileSrc::Prefetch()
+{
+    int next = NextPlaylistIndex();
+    if (next < 0 || (next_source_.valid() && prefetch_index_ == next)) {
+        return;
+    }
+
+    prefetch_index_ = next;
+    next_source_ = std::async(std::launch::async, &GPFileSrc::OpenSource,
+                              playlist_[next], use_mmap_);
+}
+
+// Continues with the prefetched file at the end of the current one. The
+// consumer sees one continuous stream, so the decoder session stays open;
+// a change of stream parameters is handled by the decoder's resolution
+// change event. Called with mutex_ held.
+bool GPFileSrc::SwitchToNext()
+{
+    // Files that fail to open are skipped, but only once per pass
+    for (size_t attempt = 0; attempt < playlist_.size(); attempt++) {
+        int next = NextPlaylistIndex();
+        if (next < 0) {
+            return false;
+        }
+
+        Prefetch();
+        source_ = next_source_.get();
+        if (next == 0) {
+            loops_done_++;
+        }
+        playlist_index_ = next;
+        mapped_ = source_ && source_->mapping;
+        indexed_ = false;
+
+        if (source_) {
+            file_switches_++;
+            SPDLOG_TRACE("{} continues with {}", GetInfo(), playlist_[next]);
+            Prefetch();
+            return true;
+        }
+        SPDLOG_ERROR("{}: skipping {}", GetInfo(), playlist_[next]);
+    }
+    return false;
+}
+
+bool GPFileSrc::BuildIndex(GPVideoCodec codec)
+{
+    std::string filepath;
+    std::shared_ptr<GPMappedFile> file;
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        if (!source_) {
+            return false;
+        }
+        filepath = source_->path;
+        file = source_->file;
+    }
+
+    struct stat st;
+    if (stat(filepath.c_str(), &st) < 0) {
+        SPDLOG_ERROR("Failed to stat {}: {}", filepath, strerror(errno));
+        return false;
+    }
+
+    uint64_t file_size = st.st_size;
+    int64_t mtime = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+
+    if (LoadIndex(filepath, codec, file_size, mtime)) {
+        return true;
+    }
+
+    std::vector<GPKeyframeIndexEntry> keyframes;
+    uint64_t frame_count = 0;
+    auto on_access_unit = [&](const GPAccessUnit& au) {
+        if (au.keyframe) {
+            keyframes.push_back({au.offset, au.index});
+        }
+        frame_count = au.index + 1;
+    };
+
+    if (file) {
+        // Every reader of a mapped file shares its access unit table
+        for (const GPAccessUnit& au : file->GetAccessUnits(codec)) {
+            on_access_unit(au);
+        }
+    }
+    else {
+        // Scan through a separate stream so the read position is kept
+        std::ifstream stream(filepath,
+                             std::ifstream::in | std::ifstream::binary);
+        if (!stream.is_open()) {
+            SPDLOG_ERROR("Failed to open {} for indexing", filepath);
+            return false;
+        }
+
+        GPAccessUnitParser parser(codec);
+        uint64_t offset = 0;
+        std::vector<char> chunk(INDEX_READ_CHUNK_SIZE);
+        for (;;) {
+            std::streamsize bytes_read =
+                stream.read(chunk.data(), chunk.size()).gcount();
+            if (bytes_read <= 0) {
+                break;
+            }
+            parser.Parse(reinterpret_cast<uint8_t*>(chunk.data()), bytes_read,
+                         offset, on_access_unit);
+            offset += bytes_read;
+        }
+        parser.Finish(offset, on_access_unit);
+    }
+
+    if (keyframes.empty()) {
+        SPDLOG_WARN("No keyframe found in {}", filepath);
+        return false;
+    }
+
+    SPDLOG_INFO("Indexed {}: {} frames, {} keyframes", filepath, frame_count,
+                keyframes.size());
+
+    SaveIndex(filepath, codec, file_size, mtime, frame_count, keyframes);
+    SetIndex(filepath, frame_count, std::move(keyframes));
+    return true;
+}
+
+void GPFileSrc::SetIndex(const std::string& filepath,
+                         uint64_t frame_count,
+                         std::vector<GPKeyframeIndexEntry>&& keyframes)
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+
+    // The playlist may have moved on while the index was built
+    if (!source_ || source_->path != filepath) {
+        return;
+    }
+    keyframes_ = std::move(keyframes);
+    frame_count_ = frame_count;
+    indexed_ = true;
+}
+
+bool GPFileSrc::SeekToFrame(uint64_t frame, uint64_t* keyframe)
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+
+    if (!indexed_) {
+        SPDLOG_ERROR("{} has no keyframe index", GetInfo());
+        return false;
+    }
+
+    // A file may open with frames that refer to a keyframe it lacks; there
+    // is nothing to decode them from
+    if (frame < keyframes_.front().frame) {
+        SPDLOG_ERROR("{}: frame {} comes before the first keyframe {}",
+                     GetInfo(), frame, keyframes_.front().frame);
+        return false;
+    }
+
+    // Last keyframe whose frame number is not after the target
+    auto it = std::upper_bound(
+        keyframes_.begin(), keyframes_.end(), frame,
+        [](uint64_t f, const GPKeyframeIndexEntry& e) { return f < e.frame; });
+    --it;
+
+    if (source_->mapping) {
+        source_->position = it->offset;
+        source_->advised_end = 0;
+        Advance(*source_, 0);
+    }
+    else {
+        source_->stream->Seek(it->offset);
+    }
+
+    if (keyframe) {
+        *keyframe = it->frame;
+    }
+
+    parser_reset_ = true;
+
+    SPDLOG_TRACE("Seek {} to frame {}, keyframe {} at {}", source_->path,
+                 frame, it->frame, it->offset);
+    return true;
+}
+
+double GPFileSrc::GetFrameRate(GPVideoCodec codec)
+{
+    std::string filepath;
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        if (!source_) {
+            return 0;
+        }
+        filepath = source_->path;
+    }
+
+    // Through a separate stream so the read position is kept
+    std::ifstream stream(filepath, std::ifstream::in | std::ifstream::binary);
+    std::vector<char> head(FRAME_RATE_PROBE_SIZE);
+    std::streamsize length = stream.read(head.data(), head.size()).gcount();
+    if (length <= 0) {
+        return 0;
+    }
+    return GPlayer::GetFrameRate(
+        codec, reinterpret_cast<const uint8_t*>(head.data()), length);
+}
+
+void GPFileSrc::SetPacing(GPPacingMode mode, double fps)
+{
+    std::lock_guard<std::mutex> guard(pacing_mutex_);
+
+    if (mode == GPPacingMode::RealTime && fps <= 0) {
+        SPDLOG_ERROR("{}: invalid frame rate {} for real-time pacing",
+                     GetInfo(), fps);
+        return;
+    }
+
+    pacing_mode_ = mode;
+    frame_period_ = std::chrono::nanoseconds(
+        fps > 0 ? static_cast<int64_t>(1e9 / fps) : 0);
+    pacing_stats_ = GPPacingStats();
+}
+
+GPPacingStats GPFileSrc::GetPacingStats()
+{
+    std::lock_guard<std::mutex> guard(pacing_mutex_);
+
+    GPPacingStats stats = pacing_stats_;
+    if (stats.seconds > 0) {
+        stats.fps = stats.frames / stats.seconds;
+        stats.bitrate = stats.bytes * 8 / stats.seconds;
+    }
+    return stats;
+}
+
+std::streamsize GPFileSrc::ReadAccessUnit(GPVideoCodec codec,
+                                          uint8_t* buffer,
+                                          size_t capacity)
+{
+    std::lock_guard<std::mutex> guard(access_unit_mutex_);
+
+    if (parser_reset_.exchange(false) || (parser_ && parser_codec_ != codec)) {
+        // Restart the timeline at the new position
+        {
+            std::lock_guard<std::mutex> pacing_guard(pacing_mutex_);
+            pacing_anchor_ = std::chrono::steady_clock::now();
+            anchor_frames_ = pacing_stats_.frames;
+        }
+        parser_.reset();
+        pending_.clear();
+        pending_offset_ = 0;
+        parsed_offset_ = 0;
+        access_units_.clear();
+        parser_finished_ = false;
+    }
+
+    if (!parser_) {
+        // Mapped files are read through their shared access unit table;
+        // the stream parser takes over for good once a file is not mapped
+        std::streamsize length;
+        if (ReadMappedAccessUnit(codec, buffer, capacity, &length)) {
+            if (length > 0) {
+                Pace(length);
+            }
+            else if (length == 0 && pacing_mode_ != GPPacingMode::None) {
+                ReportPacing();
+            }
+            return length;
+        }
+        parser_ = std::make_unique<GPAccessUnitParser>(codec);
+        parser_codec_ = codec;
+    }
+
+    auto on_access_unit = [this](const GPAccessUnit& access_unit) {
+        access_units_.push_back(access_unit);
+    };
+    while (access_units_.empty() && !parser_finished_) {
+        size_t length = pending_.size();
+        pending_.resize(length + ACCESS_UNIT_READ_SIZE);
+        std::streamsize count = Read(
+            reinterpret_cast<char*>(pending_.data() + length),
+            ACCESS_UNIT_READ_SIZE);
+        pending_.resize(length + std::max<std::streamsize>(count, 0));
+
+        if (count <= 0) {
+            parser_->Finish(parsed_offset_, on_access_unit);
+            parser_finished_ = true;
+            break;
+        }
+        parser_->Parse(pending_.data() + length, count, parsed_offset_,
+                       on_access_unit);
+        parsed_offset_ += count;
+    }
+
+    if (access_units_.empty()) {
+        if (pacing_mode_ != GPPacingMode::None) {
+            ReportPacing();
+        }
+        return 0;
+    }
+
+    GPAccessUnit access_unit = access_units_.front();
+    access_units_.pop_front();
+    if (access_unit.size > capacity) {
+        SPDLOG_ERROR("Access unit {} of {} bytes exceeds the {} byte buffer",
+                     access_unit.index, access_unit.size, capacity);
+        return -1;
+    }
+
+    memcpy(buffer, pending_.data() + (access_unit.offset - pending_offset_),
+           access_unit.size);
+
+    // Drop the bytes in front of the next access unit once in a while
+    // rather than move the buffer for each one
+    uint64_t consumed = access_unit.offset + access_unit.size - pending_offset_;
+    if (consumed >= ACCESS_UNIT_READ_SIZE) {
+        pending_.erase(pending_.begin(), pending_.begin() + consumed);
+        pending_offset_ += consumed;
+    }
+
+    Pace(access_unit.size);
+    return access_unit.size;
+}
+
+// Returns false when the current file is not mapped
+bool GPFileSrc::ReadMappedAccessUnit(GPVideoCodec codec,
+                                     uint8_t* buffer,
+                                     size_t capacity,
+                                     std::streamsize* length)
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+
+    for (;;) {
+        if (!source_ && !SwitchToNext()) {
+            *length = 0;
+            return true;
+        }
+        if (!source_->file) {
+            return false;
+        }
+
+        // The first access unit starting at the read position
+        GPAccessUnit access_unit;
+        if (!source_->file->FindAccessUnit(codec, source_->position,
+                                           &access_unit)) {
+            source_->position = source_->size;
+            if (!SwitchToNext()) {
+                *length = 0;
+                return true;
+            }
+            continue;
+        }
+
+        if (access_unit.size > capacity) {
+            SPDLOG_ERROR(
+                "Access unit {} of {} bytes exceeds the {} byte buffer",
+                access_unit.index, access_unit.size, capacity);
+            *length = -1;
+            return true;
+        }
+
+        memcpy(buffer, source_->mapping.get() + access_unit.offset,
+               access_unit.size);
+        Advance(*source_,
+                access_unit.offset + access_unit.size - source_->position);
+        *length = access_unit.size;
+        return true;
+    }
+}
+
+std::streamsize GPFileSrc::ReadNalUnit(uint8_t* buffer, size_t capacity)
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+
+    for (;;) {
+        if (!source_ && !SwitchToNext()) {
+            return 0;
+        }
+        if (!source_->file) {
+            SPDLOG_ERROR("{} is not mapped", source_->path);
+            return 0;
+        }
+
+        // A NAL unit runs from its start code up to the next one
+        uint64_t begin, end;
+        if (!source_->file->FindNalUnit(source_->position, &begin, &end)) {
+            // Trailing bytes without a NAL unit
+            source_->position = source_->size;
+            if (!SwitchToNext()) {
+                return 0;
+            }
+            continue;
+        }
+
+        uint64_t length = end - begin;
+        if (length > capacity) {
+            SPDLOG_ERROR("NAL unit larger than the {} byte input buffer",
+                         capacity);
+            return -1;
+        }
+
+        memcpy(buffer, source_->mapping.get() + begin, length);
+        Advance(*source_, end - source_->position);
+        return length;
+    }
+}
+
+void GPFileSrc::Pace(uint64_t bytes)
+{
+    GPPacingMode mode = pacing_mode_;
+    if (mode == GPPacingMode::None) {
+        return;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(pacing_mutex_);
+
+    GPPacingStats& stats = pacing_stats_;
+    if (stats.frames == 0) {
+        pacing_start_ = now;
+        pacing_anchor_ = now;
+        last_report_ = now;
+        anchor_frames_ = 0;
+    }
+
+    if (mode == GPPacingMode::RealTime) {
+        auto release =
+            pacing_anchor_ + frame_period_ * (stats.frames - anchor_frames_);
+        if (now < release) {
+            lock.unlock();
+            std::this_thread::sleep_until(release);
+            lock.lock();
+            now = std::chrono::steady_clock::now();
+        }
+        else {
+            auto lateness = now - release;
+            if (lateness > frame_period_) {
+                stats.late_frames++;
+                stats.max_lateness = std::max(
+                    stats.max_lateness,
+                    std::chrono::duration<double>(lateness).count());
+            }
+            // Behind after a stall, e.g. a blocked consumer; catching up would
+            // release a burst
+            if (lateness > PACING_RESYNC_TIME) {
+                pacing_anchor_ = now;
+                anchor_frames_ = stats.frames;
+            }
+        }
+    }
+
+    stats.frames++;
+    stats.bytes += bytes;
+    stats.seconds = std::chrono::duration<double>(now - pacing_start_).count();
+
+    if (now - last_report_ >= PACING_REPORT_INTERVAL) {
+        last_report_ = now;
+        lock.unlock();
+        ReportPacing();
+    }
+}
+
+void GPFileSrc::ReportPacing()
+{
+    GPPacingStats stats = GetPacingStats();
+    SPDLOG_INFO(
+        "{}: {} frames in {:.1f} s, {:.1f} fps, {:.2f} Mbit/s, {} late "
+        "(max {:.1f} ms)",
+        GetInfo(), stats.frames, stats.seconds, stats.fps,
+        stats.bitrate / 1e6, stats.late_frames, stats.max_lateness * 1e3);
+}
+
+static std::string GetIndexPath(const std::string& filepath)
+{
+    return filepath + INDEX_FILE_SUFFIX;
+}
+
+bool GPFileSrc::LoadIndex(const std::string& filepath,
+                          GPVideoCodec codec,
+                          uint64_t file_size,
+                          int64_t mtime)
+{
+    std::string path = GetIndexPath(filepath);
+    std::ifstream file(path, std::ifstream::in | std::ifstream::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    GPKeyframeIndexHeader header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+        return false;
+    }
+
+    if (memcmp(header.magic, kIndexMagic, sizeof(kIndexMagic)) != 0 ||
+        header.version != INDEX_FILE_VERSION ||
+        header.codec != static_cast<uint32_t>(codec) ||
+        header.file_size != file_size || header.mtime != mtime ||
+        header.entry_count == 0) {
+        SPDLOG_TRACE("Stale keyframe index {}", path);
+        return false;
+    }
+
+    std::vector<GPKeyframeIndexEntry> keyframes(header.entry_count);
+    if (!file.read(reinterpret_cast<char*>(keyframes.data()),
+                   keyframes.size() * sizeof(GPKeyframeIndexEntry))) {
+        SPDLOG_WARN("Truncated keyframe index {}", path);
+        return false;
+    }
+
+    SetIndex(filepath, header.frame_count, std::move(keyframes));
+
+    SPDLOG_TRACE("Loaded keyframe index {}", path);
+    return true;
+}
+
+void GPFileSrc::SaveIndex(const std::string& filepath,
+                          GPVideoCodec codec,
+                          uint64_t file_size,
+                          int64_t mtime,
+                          uint64_t frame_count,
+                          const std::vector<GPKeyframeIndexEntry>& keyframes)
+{
+    GPKeyframeIndexHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, kIndexMagic, sizeof(kIndexMagic));
+    header.version = INDEX_FILE_VERSION;
+    header.codec = static_cast<uint32_t>(codec);
+    header.file_size = file_size;
+    header.mtime = mtime;
+    header.frame_count = frame_count;
+    header.entry_count = keyframes.size();
+
+    // Write to a temporary file and rename it, so a concurrent reader never
+    // sees a partial index
+    std::string path = GetIndexPath(filepath);
+    std::string temp_path = path + ".tmp";
+    {
+        std::ofstream file(temp_path, std::ofstream::out |
+                                          std::ofstream::binary |
+                                          std::ofstream::trunc);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(keyframes.data()),
+                   keyframes.size() * sizeof(GPKeyframeIndexEntry));
+        if (!file.good()) {
+            SPDLOG_WARN("Failed to write keyframe index {}", temp_path);
+            file.close();
+            std::remove(temp_path.c_str());
+            return;
+        }
+    }
+
+    if (std::rename(temp_path.c_str(), path.c_str()) < 0) {
+        SPDLOG_WARN("Failed to rename {} to {}", temp_path, path);
+        std::remove(temp_path.c_str());
+    }
 }
 
 }  // namespace GPlayer
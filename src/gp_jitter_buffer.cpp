@@ -0,0 +1,252 @@
+#include <algorithm>
+#include <cstdlib>
+
+#include "gp_jitter_buffer.h"
+
+namespace GPlayer {
+
+// How long the lowest transit time of a window stands for the network's
+// fixed delay before the next window's takes over
+#define TRANSIT_WINDOW_US 2000000
+// Per new frame, the target delay moves this fraction of the way down to
+// the one the jitter asks for
+#define TARGET_DECAY 64
+
+GPJitterBuffer::GPJitterBuffer(const GPJitterBufferOptions& options)
+    : options_(options)
+{
+    // Sequence numbers modulo the slot count stay unique across the 16 bit
+    // wrap only for a power of two
+    size_t capacity = 16;
+    while (capacity < options_.capacity && capacity < 0x4000) {
+        capacity <<= 1;
+    }
+    slots_.resize(capacity);
+    target_delay_us_ = options_.min_delay_us;
+}
+
+void GPJitterBuffer::Push(std::vector<uint8_t>& packet,
+                          int64_t now_us,
+                          const Callback& callback)
+{
+    GPRtpHeader header;
+    const uint8_t* payload;
+    size_t payload_length;
+    if (!ParseRtpPacket(packet.data(), packet.size(), header, payload,
+                        payload_length)) {
+        stats_.discarded++;
+        return;
+    }
+
+    if (!started_ || header.ssrc != ssrc_) {
+        Restart(header);
+    }
+
+    int capacity = slots_.size();
+    int distance = int16_t(header.sequence - next_sequence_);
+    if (distance < -capacity || distance >= 2 * capacity) {
+        // Too far either way to be the same run of sequence numbers
+        Restart(header);
+        distance = 0;
+    }
+    if (distance < 0 && !has_released_) {
+        // Overtaken by a later packet before anything left; the stream
+        // starts here instead
+        next_sequence_ = header.sequence;
+        distance = 0;
+    }
+    if (distance < 0) {
+        stats_.late++;
+        return;
+    }
+    // Full: the oldest packets leave before their time
+    while (distance >= capacity) {
+        Slot& slot = GetSlot(next_sequence_);
+        if (slot.used) {
+            Release(slot, now_us, callback);
+        }
+        else {
+            stats_.lost++;
+        }
+        next_sequence_++;
+        distance--;
+    }
+
+    Slot& slot = GetSlot(header.sequence);
+    if (slot.used) {
+        stats_.duplicates++;
+        return;
+    }
+
+    extended_timestamp_ += int32_t(header.timestamp - last_timestamp_);
+    last_timestamp_ = header.timestamp;
+    int64_t rtp_time_us =
+        extended_timestamp_ * 1000000 / RTP_VIDEO_CLOCK_RATE;
+
+    std::swap(slot.packet, packet);
+    slot.rtp_time_us = rtp_time_us;
+    slot.arrival_us = now_us;
+    slot.used = true;
+    held_++;
+    stats_.packets++;
+
+    UpdateTiming(rtp_time_us, now_us);
+}
+
+void GPJitterBuffer::Pop(int64_t now_us, const Callback& callback)
+{
+    while (held_ > 0) {
+        Slot& slot = GetSlot(next_sequence_);
+        if (slot.used) {
+            if (GetDeadline(slot) > now_us) {
+                break;
+            }
+            Release(slot, now_us, callback);
+            next_sequence_++;
+            continue;
+        }
+
+        // A gap is given up on once the packet behind it is due
+        uint16_t sequence;
+        Slot* next = FindNext(&sequence);
+        if (GetDeadline(*next) > now_us) {
+            break;
+        }
+        stats_.lost += uint16_t(sequence - next_sequence_);
+        next_sequence_ = sequence;
+    }
+}
+
+void GPJitterBuffer::Flush(const Callback& callback)
+{
+    while (held_ > 0) {
+        Slot& slot = GetSlot(next_sequence_);
+        if (slot.used) {
+            Release(slot, slot.arrival_us, callback);
+        }
+        else {
+            stats_.lost++;
+        }
+        next_sequence_++;
+    }
+}
+
+int64_t GPJitterBuffer::GetNextDeadline()
+{
+    if (held_ == 0) {
+        return -1;
+    }
+    uint16_t sequence;
+    return GetDeadline(*FindNext(&sequence));
+}
+
+GPJitterStats GPJitterBuffer::GetStats() const
+{
+    GPJitterStats stats = stats_;
+    stats.jitter_us = int64_t(jitter_us_);
+    stats.target_delay_us = int64_t(target_delay_us_);
+    stats.average_delay_us = released_ > 0 ? total_delay_us_ / released_ : 0;
+    return stats;
+}
+
+GPJitterBuffer::Slot* GPJitterBuffer::FindNext(uint16_t* sequence)
+{
+    for (uint16_t i = 0; i < slots_.size(); i++) {
+        Slot& slot = GetSlot(next_sequence_ + i);
+        if (slot.used) {
+            *sequence = next_sequence_ + i;
+            return &slot;
+        }
+    }
+    return nullptr;
+}
+
+int64_t GPJitterBuffer::GetDeadline(const Slot& slot) const
+{
+    // A packet later than its RTP time still waits the target delay, which
+    // is what a packet missing in front of it gets to turn up
+    return std::max(slot.rtp_time_us + base_transit_us_, slot.arrival_us) +
+           int64_t(target_delay_us_);
+}
+
+void GPJitterBuffer::Release(Slot& slot,
+                             int64_t now_us,
+                             const Callback& callback)
+{
+    callback(slot.packet.data(), slot.packet.size());
+    has_released_ = true;
+    slot.used = false;
+    held_--;
+
+    int64_t delay = std::max<int64_t>(0, now_us - slot.arrival_us);
+    total_delay_us_ += delay;
+    released_++;
+    stats_.max_delay_us = std::max(stats_.max_delay_us, delay);
+}
+
+// Drops what is held from the previous run of the stream and starts over
+// with header as its first packet
+void GPJitterBuffer::Restart(const GPRtpHeader& header)
+{
+    if (held_ > 0) {
+        for (Slot& slot : slots_) {
+            slot.used = false;
+        }
+        stats_.discarded += held_;
+        held_ = 0;
+    }
+
+    started_ = true;
+    ssrc_ = header.ssrc;
+    next_sequence_ = header.sequence;
+    has_released_ = false;
+    last_timestamp_ = header.timestamp;
+    extended_timestamp_ = 0;
+    has_arrival_ = false;
+}
+
+void GPJitterBuffer::UpdateTiming(int64_t rtp_time_us, int64_t now_us)
+{
+    int64_t transit = now_us - rtp_time_us;
+    if (!has_arrival_) {
+        has_arrival_ = true;
+        base_transit_us_ = transit;
+        window_transit_us_ = transit;
+        window_start_us_ = now_us;
+        last_arrival_us_ = now_us;
+        last_rtp_time_us_ = rtp_time_us;
+        return;
+    }
+
+    base_transit_us_ = std::min(base_transit_us_, transit);
+    window_transit_us_ = std::min(window_transit_us_, transit);
+    if (now_us - window_start_us_ >= TRANSIT_WINDOW_US) {
+        base_transit_us_ = window_transit_us_;
+        window_transit_us_ = transit;
+        window_start_us_ = now_us;
+    }
+
+    // RFC 3550 6.4.1 interarrival jitter, taken between the first packets
+    // of successive frames: the packets of one frame share a timestamp and
+    // leave in a burst, which says nothing about the network
+    if (rtp_time_us <= last_rtp_time_us_) {
+        return;
+    }
+    int64_t difference =
+        (now_us - last_arrival_us_) - (rtp_time_us - last_rtp_time_us_);
+    jitter_us_ += (std::abs(difference) - jitter_us_) / 16;
+    last_arrival_us_ = now_us;
+    last_rtp_time_us_ = rtp_time_us;
+
+    double wanted = std::clamp(jitter_us_ * options_.jitter_factor,
+                               double(options_.min_delay_us),
+                               double(options_.max_delay_us));
+    if (wanted > target_delay_us_) {
+        target_delay_us_ = wanted;
+    }
+    else {
+        target_delay_us_ -= (target_delay_us_ - wanted) / TARGET_DECAY;
+    }
+}
+
+}  // namespace GPlayer
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <iostream>
 #include <unordered_map>
 
@@ -7,9 +8,15 @@
 
 namespace GPlayer {
 
-GPMediaServer::GPMediaServer(uint16_t port)
-    : net::server_interface<PlayerMsg>(port)
+GPMediaServer::GPMediaServer(uint16_t port,
+                             const net::server_options& options,
+                             const GPMediaStreamOptions& stream_options)
+    : net::server_interface<PlayerMsg>(port, options),
+      port_(port),
+      stream_options_(stream_options)
 {
+    SetProperties("GPMediaServer", "GPMediaServer", BeaderType::MediaServer,
+                  false);
 }
 
 GPMediaServer::~GPMediaServer() {}
@@ -19,13 +26,164 @@ std::string GPMediaServer::GetInfo() const
     return "GPMediaServer";
 }
 
+void GPMediaServer::Process(GPData* data)
+{
+    GPBuffer* buffer = *data;
+    if (buffer == nullptr || buffer->GetLength() == 0) {
+        return;
+    }
+
+    net::drop_class drop =
+        ClassifyFrame(buffer->GetData(), buffer->GetLength());
+    bool keyframe = drop == net::drop_class::keyframe;
+
+    std::lock_guard<std::mutex> lock(stream_mutex_);
+    sStreamFrame frame;
+    frame.pts = buffer->GetPts();
+    frame.keyframe = keyframe;
+    frame.sequence = sequence_++;
+    // Built once and shared by the cache and every subscriber
+    net::message_builder<PlayerMsg> builder(
+        PlayerMsg::Stream_Frame, sizeof(frame) + buffer->GetLength());
+    builder << frame;
+    builder.Append(buffer->GetData(), buffer->GetLength());
+    shared_message msg =
+        std::make_shared<const net::message<PlayerMsg>>(builder.Build());
+
+    stream_stats_.frames++;
+    if (keyframe) {
+        stream_stats_.keyframes++;
+        gop_cache_.clear();
+        gop_cache_bytes_ = 0;
+        gop_cached_ = true;
+    }
+    if (gop_cached_) {
+        if (gop_cache_.size() + 1 > stream_options_.max_cache_frames ||
+            gop_cache_bytes_ + msg->size() > stream_options_.max_cache_bytes) {
+            gop_cache_.clear();
+            gop_cache_bytes_ = 0;
+            gop_cached_ = false;
+        }
+        else {
+            gop_cache_.push_back({msg, drop});
+            gop_cache_bytes_ += msg->size();
+        }
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i < subscribers_.size(); i++) {
+        Subscriber& subscriber = subscribers_[i];
+        if (!subscriber.client->IsConnected()) {
+            continue;
+        }
+        if (keyframe) {
+            subscriber.waiting_for_keyframe = false;
+        }
+        if (!subscriber.waiting_for_keyframe) {
+            subscriber.client->Send(msg, drop);
+        }
+        if (kept != i) {
+            subscribers_[kept] = std::move(subscriber);
+        }
+        kept++;
+    }
+    subscribers_.resize(kept);
+}
+
+GPMediaStreamStats GPMediaServer::GetStreamStats()
+{
+    std::lock_guard<std::mutex> lock(stream_mutex_);
+    GPMediaStreamStats stats = stream_stats_;
+    stats.subscribers = subscribers_.size();
+    stats.cached_frames = gop_cache_.size();
+    stats.cached_bytes = gop_cache_bytes_;
+    return stats;
+}
+
+// A keyframe starts a GOP; any other frame is disposable when none of its
+// slices is used for reference, as with nal_ref_idc 0 in H.264 or the
+// sub-layer non-reference types of H.265
+net::drop_class GPMediaServer::ClassifyFrame(const uint8_t* data,
+                                             size_t length) const
+{
+    GPVideoCodec codec = stream_options_.codec;
+    if (HasKeyframeNalu(codec, data, length)) {
+        return net::drop_class::keyframe;
+    }
+
+    bool has_slice = false;
+    size_t pos = FindStartCode(data, length);
+    while (pos + 5 <= length) {
+        const uint8_t* nalu = data + pos + 3;
+        size_t left = length - pos - 3;
+        int type = GetNaluType(codec, nalu);
+        if (IsVclNalu(codec, type)) {
+            has_slice = true;
+            bool reference = codec == GPVideoCodec::H264
+                                 ? (nalu[0] & 0x60) != 0
+                                 : type > 14 || type % 2 == 1;
+            if (reference) {
+                return net::drop_class::reference;
+            }
+        }
+        pos += 3 + FindStartCode(nalu, left);
+    }
+    return has_slice ? net::drop_class::disposable
+                     : net::drop_class::reference;
+}
+
+void GPMediaServer::Subscribe(
+    std::shared_ptr<net::connection<PlayerMsg>> client)
+{
+    std::lock_guard<std::mutex> lock(stream_mutex_);
+    for (const auto& subscriber : subscribers_) {
+        if (subscriber.client == client) {
+            return;
+        }
+    }
+
+    bool cached = gop_cached_ && !gop_cache_.empty();
+    stream_stats_.joins++;
+    if (!cached) {
+        stream_stats_.cache_misses++;
+    }
+
+    sStreamStart start;
+    start.codec = static_cast<uint32_t>(stream_options_.codec);
+    start.cached_frames = cached ? gop_cache_.size() : 0;
+    net::message_builder<PlayerMsg> builder(PlayerMsg::Stream_Start,
+                                            sizeof(start));
+    builder << start;
+    client->Send(builder.Build());
+
+    // The joiner catches up from the last keyframe, then goes on live
+    if (cached) {
+        for (const auto& frame : gop_cache_) {
+            client->Send(frame.msg, frame.drop);
+        }
+    }
+    subscribers_.push_back({std::move(client), !cached});
+}
+
+void GPMediaServer::Unsubscribe(
+    const std::shared_ptr<net::connection<PlayerMsg>>& client)
+{
+    std::lock_guard<std::mutex> lock(stream_mutex_);
+    subscribers_.erase(
+        std::remove_if(subscribers_.begin(), subscribers_.end(),
+                       [&client](const Subscriber& subscriber) {
+                           return subscriber.client == client;
+                       }),
+        subscribers_.end());
+}
+
 int GPMediaServer::Proc()
 {
-    GPMediaServer server(port_);
-    server.Start();
+    ApplyThreadPolicy("GPMediaServer");
+    Start();
 
     while (1) {
-        server.Update(-1, true);
+        Update(-1, true);
     }
     return 0;
 }
@@ -41,13 +199,16 @@ void GPMediaServer::OnClientValidated(
 {
     net::message<PlayerMsg> msg;
     msg.header.id = PlayerMsg::Client_Accepted;
-    client->Send(msg);
+    client->Send(std::move(msg));
 }
 
 void GPMediaServer::OnClientDisconnect(
     std::shared_ptr<net::connection<PlayerMsg>> client)
 {
     if (client) {
+        Unsubscribe(client);
+
+        std::lock_guard<std::mutex> guard(roster_mutex_);
         if (player_roster_.find(client->GetID()) == player_roster_.end()) {
         }
         else {
@@ -64,15 +225,19 @@ void GPMediaServer::OnMessage(
     std::shared_ptr<net::connection<PlayerMsg>> client,
     net::message<PlayerMsg>& msg)
 {
-    if (!garbage_ids_.empty()) {
-        for (auto pid : garbage_ids_) {
-            net::message<PlayerMsg> m;
-            m.header.id = PlayerMsg::Game_RemovePlayer;
+    std::vector<uint32_t> garbage_ids;
+    {
+        std::lock_guard<std::mutex> guard(roster_mutex_);
+        garbage_ids.swap(garbage_ids_);
+    }
+    if (!garbage_ids.empty()) {
+        for (auto pid : garbage_ids) {
+            net::message_builder<PlayerMsg> m(PlayerMsg::Game_RemovePlayer,
+                                              sizeof(pid));
             m << pid;
             std::cout << "Removing " << pid << "\n";
-            MessageAllClients(m);
+            MessageAllClients(m.Build());
         }
-        garbage_ids_.clear();
     }
 
     switch (msg.header.id) {
@@ -107,7 +272,17 @@ void GPMediaServer::OnMessage(
         }
 
         case PlayerMsg::Game_UpdatePlayer: {
-            MessageAllClients(msg, client);
+            MessageAllClients(std::move(msg), client);
+            break;
+        }
+
+        case PlayerMsg::Stream_Subscribe: {
+            Subscribe(client);
+            break;
+        }
+
+        case PlayerMsg::Stream_Unsubscribe: {
+            Unsubscribe(client);
             break;
         }
     }
@@ -0,0 +1,258 @@
+#include <pthread.h>
+#include <algorithm>
+
+#include "gp_bitstream.h"
+#include "gp_filesrc.h"
+#include "gp_log.h"
+#include "gp_mjpeg_demuxer.h"
+#include "gp_nvjpeg_decoder.h"
+
+namespace GPlayer {
+
+#define MJPEG_READ_CHUNK_SIZE (256 * 1024)
+// Bytes of marker segments a left over frame takes in at a time
+#define MJPEG_JOIN_STEP 4096
+
+GPMjpegDemuxer::GPMjpegDemuxer(size_t max_frame_size)
+    : max_frame_size_(max_frame_size)
+{
+    SetProperties("GPMjpegDemuxer", "GPMjpegDemuxer", BeaderType::MjpegDemuxer,
+                  true);
+}
+
+GPMjpegDemuxer::~GPMjpegDemuxer() {}
+
+std::string GPMjpegDemuxer::GetInfo() const
+{
+    return "GPMjpegDemuxer";
+}
+
+// Frames pushed in through Process() need no thread of their own
+bool GPMjpegDemuxer::HasProc()
+{
+    return FindParent(BeaderType::FileSrc) != nullptr;
+}
+
+int GPMjpegDemuxer::Proc()
+{
+    auto file_src =
+        std::dynamic_pointer_cast<GPFileSrc>(FindParent(BeaderType::FileSrc));
+    if (!file_src) {
+        return 0;
+    }
+
+    ApplyThreadPolicy("GPMjpegDemuxer");
+
+    std::vector<uint8_t> chunk;
+    if (!file_src->IsMapped()) {
+        chunk.resize(MJPEG_READ_CHUNK_SIZE);
+    }
+
+    for (;;) {
+        std::shared_ptr<GPBuffer> buffer;
+        if (file_src->IsMapped()) {
+            // Demux straight from the mapped file
+            buffer = file_src->ReadView(MJPEG_READ_CHUNK_SIZE);
+        }
+        else {
+            std::streamsize bytes_read = file_src->Read(
+                reinterpret_cast<char*>(chunk.data()), chunk.size());
+            if (bytes_read > 0) {
+                buffer = std::make_shared<GPBuffer>(chunk.data(), bytes_read);
+            }
+        }
+        if (!buffer) {
+            break;
+        }
+
+        GPData data(buffer.get());
+        Process(&data);
+    }
+
+    SPDLOG_INFO("{} reached the end of {}: {} frames, {} bytes skipped",
+                GetInfo(), file_src->GetInfo(), frame_count_, dropped_bytes_);
+    return 0;
+}
+
+void GPMjpegDemuxer::Process(GPData* data)
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    GPBuffer* buffer = *data;
+    uint8_t* bytes = buffer->GetData();
+    size_t length = buffer->GetLength();
+
+    // Finish the frame left over from the last call, taking in no more of
+    // the new bytes than it needs
+    size_t offset = 0;
+    while (!pending_.empty() && offset < length) {
+        size_t step = GetJoinLength(bytes + offset, length - offset);
+        pending_.insert(pending_.end(), bytes + offset, bytes + offset + step);
+        offset += step;
+        size_t consumed = Demux(pending_.data(), pending_.size());
+        pending_.erase(pending_.begin(), pending_.begin() + consumed);
+    }
+    if (offset == length) {
+        return;
+    }
+
+    // The rest is demuxed in place; only an unfinished frame is copied
+    size_t consumed = Demux(bytes + offset, length - offset);
+    pending_.assign(bytes + offset + consumed, bytes + length);
+}
+
+// How many of the length bytes at data pending_ takes in before it is
+// demuxed again. In the entropy-coded data that is up to the next EOI;
+// before it, the marker segments are taken in small steps.
+size_t GPMjpegDemuxer::GetJoinLength(const uint8_t* data, size_t length)
+{
+    if (scan_offset_ == 0) {
+        return std::min<size_t>(length, MJPEG_JOIN_STEP);
+    }
+
+    // An EOI split between the calls
+    if (pending_.back() == JPEG_MARKER_PREFIX && data[0] == JPEG_MARKER_EOI) {
+        return 1;
+    }
+    size_t start = scan_offset_ > pending_.size()
+                       ? scan_offset_ - pending_.size()
+                       : 0;
+    if (start >= length) {
+        return length;
+    }
+    size_t eoi =
+        start + FindJpegMarker(data + start, length - start, JPEG_MARKER_EOI);
+    return eoi == length ? length : eoi + 2;
+}
+
+// Pushes the complete frames in data and returns how many bytes were used
+// up; the rest is the start of a frame still to come.
+size_t GPMjpegDemuxer::Demux(uint8_t* data, size_t length)
+{
+    size_t begin = 0;
+
+    while (begin < length) {
+        uint8_t* rest = data + begin;
+        size_t rest_length = length - begin;
+
+        // Anything in front of SOI is padding or a multipart boundary and
+        // its part headers.
+        size_t soi = FindJpegMarker(rest, rest_length, JPEG_MARKER_SOI);
+        if (soi == rest_length) {
+            // Keep a trailing 0xFF, it may be the first half of the next SOI
+            size_t keep = rest[rest_length - 1] == JPEG_MARKER_PREFIX ? 1 : 0;
+            dropped_bytes_ += rest_length - keep;
+            begin += rest_length - keep;
+            scan_offset_ = 0;
+            break;
+        }
+
+        if (soi > 0) {
+            dropped_bytes_ += soi;
+            begin += soi;
+            scan_offset_ = 0;
+            continue;
+        }
+
+        size_t frame_end = FindFrameEnd(rest, rest_length);
+        if (frame_end == 0) {
+            if (rest_length > max_frame_size_) {
+                SPDLOG_WARN("No EOI within {} bytes, skipping the frame",
+                            max_frame_size_);
+                dropped_bytes_ += 2;
+                begin += 2;
+                scan_offset_ = 0;
+                continue;
+            }
+            break;
+        }
+
+        PushFrame(rest, frame_end);
+        begin += frame_end;
+        scan_offset_ = 0;
+    }
+
+    return begin;
+}
+
+// Returns the length of the JPEG frame starting with the SOI at data, or 0
+// if it is not complete yet. Marker segments are skipped by their length
+// fields so an EOI inside an embedded EXIF thumbnail does not cut the frame
+// short, and the entropy-coded data after SOS is vector-scanned for EOI.
+// scan_offset_ remembers how far the entropy data has been searched between
+// calls.
+size_t GPMjpegDemuxer::FindFrameEnd(const uint8_t* data, size_t length)
+{
+    if (scan_offset_ == 0) {
+        size_t pos = 2;
+        for (;;) {
+            if (pos + 2 > length) {
+                return 0;
+            }
+            if (data[pos] != JPEG_MARKER_PREFIX) {
+                // Not a marker segment; fall back to a plain EOI search
+                break;
+            }
+
+            uint8_t marker = data[pos + 1];
+            if (marker == JPEG_MARKER_PREFIX) {
+                // Fill byte
+                pos++;
+                continue;
+            }
+            if (marker == JPEG_MARKER_EOI) {
+                return pos + 2;
+            }
+            if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) {
+                // Standalone markers (TEM, RSTn) have no length field
+                pos += 2;
+                continue;
+            }
+
+            if (pos + 4 > length) {
+                return 0;
+            }
+            pos += 2 + ((data[pos + 2] << 8) | data[pos + 3]);
+            if (marker == JPEG_MARKER_SOS) {
+                break;
+            }
+        }
+        scan_offset_ = pos;
+    }
+
+    if (scan_offset_ >= length) {
+        return 0;
+    }
+
+    size_t eoi = scan_offset_ + FindJpegMarker(data + scan_offset_,
+                                               length - scan_offset_,
+                                               JPEG_MARKER_EOI);
+    if (eoi == length) {
+        // Resume at the last byte, it may be the 0xFF of a split EOI
+        scan_offset_ = length - 1;
+        return 0;
+    }
+
+    return eoi + 2;
+}
+
+void GPMjpegDemuxer::PushFrame(uint8_t* data, size_t length)
+{
+    frame_count_++;
+
+    auto decoders = GetChildren(BeaderType::NvJpegDecoder);
+    if (decoders.empty()) {
+        SPDLOG_TRACE("No found MJPEG decoder in {}.", GetInfo());
+        return;
+    }
+
+    GPBuffer buffer(data, length);
+    GPData frame(&buffer);
+    for (auto& decoder : decoders) {
+        auto jpeg_decoder = std::dynamic_pointer_cast<GPNvJpegDecoder>(decoder);
+        if (jpeg_decoder) {
+            jpeg_decoder->Process(&frame);
+        }
+    }
+}
+
+}  // namespace GPlayer
@@ -1,15 +1,26 @@
 #include "NvJpegDecoder.h"
+#include "nvbuf_utils.h"
 
+#include "gp_display_egl.h"
+#include "gp_log.h"
 #include "gp_nvjpeg_decoder.h"
 
 namespace GPlayer {
 
 GPNvJpegDecoder::GPNvJpegDecoder()
 {
-    SetProperties("", "", BeaderType::NvJpegDecoder);
+    SetProperties("GPNvJpegDecoder", "GPNvJpegDecoder",
+                  BeaderType::NvJpegDecoder);
     jpegdec_ = NvJPEGDecoder::createJPEGDecoder("jpegdec");
 }
 
+GPNvJpegDecoder::~GPNvJpegDecoder()
+{
+    if (render_dmabuf_fd_ != -1) {
+        NvBufferDestroy(render_dmabuf_fd_);
+    }
+}
+
 int GPNvJpegDecoder::decodeToFd(int& fd,
                                 unsigned char* buffer,
                                 uint32_t bytesused,
@@ -20,4 +31,75 @@ int GPNvJpegDecoder::decodeToFd(int& fd,
     return jpegdec_->decodeToFd(fd, buffer, bytesused, pixfmt, width, height);
 }
 
-}  // namespace GPlayer
\ No newline at end of file
+// Decodes one complete JPEG frame (as split by GPMjpegDemuxer), converts it
+// to a pitch-linear YUV420 buffer and renders it on every linked display.
+void GPNvJpegDecoder::Process(GPData* data)
+{
+    GPBuffer* buffer = *data;
+    NvBufferTransformParams transParams;
+    int fd = 0;
+    uint32_t width, height, pixfmt;  // out parameters
+
+    if (decodeToFd(fd, buffer->GetData(), buffer->GetLength(), pixfmt, width,
+                   height) < 0) {
+        SPDLOG_ERROR("Cannot decode JPEG frame of {} bytes",
+                     buffer->GetLength());
+        return;
+    }
+
+    auto displays = GetChildren(BeaderType::EGLDisplaySink);
+    if (displays.empty()) {
+        return;
+    }
+
+    if (!prepare_render_buffer(width, height)) {
+        return;
+    }
+
+    memset(&transParams, 0, sizeof(transParams));
+    transParams.transform_flag = NVBUFFER_TRANSFORM_FILTER;
+    transParams.transform_filter = NvBufferTransform_Filter_Smart;
+    if (-1 == NvBufferTransform(fd, render_dmabuf_fd_, &transParams)) {
+        SPDLOG_ERROR("Failed to convert the buffer");
+        return;
+    }
+
+    for (auto& beader : displays) {
+        auto display = std::dynamic_pointer_cast<GPDisplayEGLSink>(beader);
+        if (display) {
+            display->Display(render_dmabuf_fd_);
+        }
+    }
+}
+
+bool GPNvJpegDecoder::prepare_render_buffer(uint32_t width, uint32_t height)
+{
+    NvBufferCreateParams input_params = {0};
+
+    if (render_dmabuf_fd_ != -1 && render_width_ == width &&
+        render_height_ == height) {
+        return true;
+    }
+
+    if (render_dmabuf_fd_ != -1) {
+        NvBufferDestroy(render_dmabuf_fd_);
+        render_dmabuf_fd_ = -1;
+    }
+
+    input_params.payloadType = NvBufferPayload_SurfArray;
+    input_params.width = width;
+    input_params.height = height;
+    input_params.layout = NvBufferLayout_Pitch;
+    input_params.colorFormat = NvBufferColorFormat_YUV420;
+    input_params.nvbuf_tag = NvBufferTag_NONE;
+    if (-1 == NvBufferCreateEx(&render_dmabuf_fd_, &input_params)) {
+        render_dmabuf_fd_ = -1;
+        ERROR_RETURN("Failed to create NvBuffer");
+    }
+
+    render_width_ = width;
+    render_height_ = height;
+    return true;
+}
+
+}  // namespace GPlayer
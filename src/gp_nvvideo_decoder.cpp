@@ -3,6 +3,7 @@
 #include <nvbuf_utils.h>
 #include <algorithm>
 #include <condition_variable>
+#include <cstdint>
 #include <iostream>
 #include <memory>
 #include <sstream>
@@ -11,6 +12,7 @@
 #include "NvApplicationProfiler.h"
 #include "NvUtils.h"
 
+#include "gp_bitstream.h"
 #include "gp_log.h"
 #include "gplayer.h"
 
@@ -31,6 +33,8 @@ namespace GPlayer {
 
 const uint32_t MICROSECOND_UNIT = 1000000;
 const uint32_t CHUNK_SIZE = 4000000L;
+// Bytes of the input ring searched for a start code at a time
+const size_t NALU_SCAN_SIZE = 4096;
 
 #define IS_NAL_UNIT_START(buffer_ptr) \
     (!buffer_ptr[0] && !buffer_ptr[1] && !buffer_ptr[2] && (buffer_ptr[3] == 1))
@@ -96,78 +100,337 @@ void GPNvVideoDecoder::Process(GPData* data)
     buffer_condition_.notify_one();
 }
 
+uint8_t* GPNvVideoDecoder::Reserve(size_t* length)
+{
+    std::lock_guard<std::mutex> guard(buffer_lock_);
+    return buffer_.reserve(length);
+}
+
+void GPNvVideoDecoder::Commit(size_t length)
+{
+    {
+        std::lock_guard<std::mutex> guard(buffer_lock_);
+        buffer_.commit(length);
+    }
+    buffer_condition_.notify_one();
+}
+
+bool GPNvVideoDecoder::Seek(uint64_t frame)
+{
+    auto file_src =
+        std::dynamic_pointer_cast<GPFileSrc>(FindParent(BeaderType::FileSrc));
+    if (!file_src) {
+        SPDLOG_ERROR("{} can only seek a file source", GetInfo());
+        return false;
+    }
+
+    if (!file_src->HasIndex()) {
+        GPVideoCodec codec = ctx_->decoder_pixfmt == V4L2_PIX_FMT_H265
+                                 ? GPVideoCodec::H265
+                                 : GPVideoCodec::H264;
+        if (!file_src->BuildIndex(codec)) {
+            return false;
+        }
+    }
+
+    if (frame >= file_src->GetFrameCount()) {
+        SPDLOG_ERROR("Seek target {} is beyond the last frame {}", frame,
+                     file_src->GetFrameCount());
+        return false;
+    }
+
+    // Applied by the decoder thread before it reads the next input chunk
+    seek_target_ = frame;
+    seek_pending_ = true;
+    return true;
+}
+
+// Elementary streams carry no timestamps; the time is taken at the frame
+// rate given in the stream's parameter sets
+bool GPNvVideoDecoder::SeekTime(double seconds)
+{
+    if (seconds < 0) {
+        return false;
+    }
+
+    auto file_src =
+        std::dynamic_pointer_cast<GPFileSrc>(FindParent(BeaderType::FileSrc));
+    if (!file_src) {
+        SPDLOG_ERROR("{} can only seek a file source", GetInfo());
+        return false;
+    }
+
+    GPVideoCodec codec = ctx_->decoder_pixfmt == V4L2_PIX_FMT_H265
+                             ? GPVideoCodec::H265
+                             : GPVideoCodec::H264;
+    double fps = file_src->GetFrameRate(codec);
+    if (fps <= 0) {
+        SPDLOG_ERROR("{} cannot seek by time: the stream has no frame rate",
+                     GetInfo());
+        return false;
+    }
+    return Seek(static_cast<uint64_t>(seconds * fps + 0.5));
+}
+
+// Repositions the file source and flushes the output plane. Streaming the
+// output plane off returns every queued bitstream buffer, so all of them are
+// handed out again through plane_buffer_index.
+bool GPNvVideoDecoder::apply_pending_seek(int& plane_buffer_index)
+{
+    if (!seek_pending_.exchange(false)) {
+        return false;
+    }
+
+    auto file_src = file_src_.lock();
+    uint64_t target = seek_target_;
+    uint64_t keyframe = 0;
+    if (!file_src || !file_src->SeekToFrame(target, &keyframe)) {
+        return false;
+    }
+
+    ctx_->dec->output_plane.setStreamStatus(false);
+    {
+        std::lock_guard<std::mutex> guard(seek_lock_);
+        seek_epoch_++;
+        seek_discard_frames_ = target - keyframe;
+        // Set by the first stamped buffer after the flush
+        seek_timestamp_ = UINT64_MAX;
+    }
+    ctx_->dec->output_plane.setStreamStatus(true);
+    plane_buffer_index = 0;
+
+    SPDLOG_INFO("{} seek to frame {}, decoding from keyframe {}", GetInfo(),
+                target, keyframe);
+    return true;
+}
+
+static uint64_t ToMicroseconds(const struct timeval& timestamp)
+{
+    return uint64_t(timestamp.tv_sec) * MICROSECOND_UNIT + timestamp.tv_usec;
+}
+
+// After a seek, output buffers carry the seek epoch as their timestamp; the
+// decoder copies it to the decoded frame so frames decoded before the flush
+// can be told apart on the capture plane. A stream that copies its own
+// timestamps, which only grow, keeps them: the first one queued after the
+// flush is where the frames of the seek begin.
+void GPNvVideoDecoder::stamp_seek_epoch(struct v4l2_buffer& v4l2_buf)
+{
+    std::lock_guard<std::mutex> guard(seek_lock_);
+    if (seek_epoch_ == 0) {
+        return;
+    }
+
+    if (v4l2_buf.flags & V4L2_BUF_FLAG_TIMESTAMP_COPY) {
+        if (seek_timestamp_ == UINT64_MAX) {
+            seek_timestamp_ = ToMicroseconds(v4l2_buf.timestamp);
+        }
+        return;
+    }
+    // NAL units other than slices do not make frames of their own
+    if (copies_timestamps()) {
+        return;
+    }
+
+    v4l2_buf.flags |= V4L2_BUF_FLAG_TIMESTAMP_COPY;
+    v4l2_buf.timestamp.tv_sec = seek_epoch_;
+    v4l2_buf.timestamp.tv_usec = 0;
+}
+
+bool GPNvVideoDecoder::drop_frame_after_seek(
+    const struct v4l2_buffer& v4l2_buf)
+{
+    std::lock_guard<std::mutex> guard(seek_lock_);
+
+    if (seek_epoch_ == 0) {
+        return false;
+    }
+    if (copies_timestamps()) {
+        if (ToMicroseconds(v4l2_buf.timestamp) < seek_timestamp_) {
+            return true;
+        }
+    }
+    else if (static_cast<uint32_t>(v4l2_buf.timestamp.tv_sec) < seek_epoch_) {
+        return true;
+    }
+    if (seek_discard_frames_ > 0) {
+        seek_discard_frames_--;
+        return true;
+    }
+    return false;
+}
+
+// Slices in NAL unit mode carry timestamps of the stream's own
+bool GPNvVideoDecoder::copies_timestamps() const
+{
+    return ctx_->copy_timestamp && ctx_->input_nalu;
+}
+
 int GPNvVideoDecoder::read_decoder_input_nalu(NvBuffer* buffer)
 {
     // std::lock_guard<std::mutex> lk(buffer_lock_);
     // Length is the size of the buffer in bytes
     char* buffer_ptr = (char*)buffer->planes[0].data;
-    int h265_nal_unit_type;
-    uint8_t stream_buffer[4];
-    bool nalu_found = false;
 
-    if (buffer_.size() == 0) {
-        SPDLOG_TRACE("No buffers in the {}", GetInfo());
+    if (auto file_src = file_src_.lock()) {
+        if (file_src->GetPacingMode() != GPPacingMode::None &&
+            (ctx_->decoder_pixfmt == V4L2_PIX_FMT_H264 ||
+             ctx_->decoder_pixfmt == V4L2_PIX_FMT_H265)) {
+            return read_file_input_access_unit(buffer, file_src.get());
+        }
+        if (file_src->IsMapped()) {
+            return read_file_input_nalu(buffer, file_src.get());
+        }
+    }
+
+    if (!has_decoder_input_nalu()) {
+        SPDLOG_TRACE("No whole NAL unit in the {}", GetInfo());
         buffer->planes[0].bytesused = 0;
         return 0;
     }
 
-    // Find the first NAL unit in the buffer
+    size_t length =
+        std::min<size_t>(input_nalu_length_, buffer->planes[0].length);
+    if (length < input_nalu_length_) {
+        SPDLOG_ERROR("NAL unit of {} bytes cut to the {} byte input buffer",
+                     input_nalu_length_, length);
+    }
+    buffer_.get(reinterpret_cast<uint8_t*>(buffer_ptr), length);
+    buffer_.drop(input_nalu_length_ - length);
+    input_nalu_length_ = 0;
+    buffer->planes[0].bytesused = length;
 
-    while (buffer_.snap(stream_buffer, 4) == 4) {
-        nalu_found = IS_NAL_UNIT_START(stream_buffer) ||
-                     IS_NAL_UNIT_START1(stream_buffer);
-        if (nalu_found) {
-            break;
-        }
-        buffer_.drop();
+    if (length > 4 && ctx_->copy_timestamp) {
+        update_copyts_flag(reinterpret_cast<uint8_t*>(buffer_ptr) + 4);
     }
+    return length;
+}
 
-    // Reached end of buffer but could not find NAL unit
-    if (!nalu_found) {
-        SPDLOG_ERROR(
-            "Could not read nal unit from file. EOF or file corrupted");
-        return -1;
+// NAL units come out of the input ring, rather than from a file source or
+// in raw chunks
+bool GPNvVideoDecoder::reads_ring_nalus()
+{
+    return file_src_.expired() && ctx_->input_nalu &&
+           (ctx_->decoder_pixfmt == V4L2_PIX_FMT_H264 ||
+            ctx_->decoder_pixfmt == V4L2_PIX_FMT_H265 ||
+            ctx_->decoder_pixfmt == V4L2_PIX_FMT_MPEG2 ||
+            ctx_->decoder_pixfmt == V4L2_PIX_FMT_MPEG4);
+}
+
+// Whether the ring starts with a whole NAL unit, ended by the start code of
+// the next one. A live stream mostly ends mid-NAL: nothing is taken until
+// the rest of it has arrived, and the search resumes where it stopped.
+// Called with buffer_lock_ held.
+bool GPNvVideoDecoder::has_decoder_input_nalu()
+{
+    uint8_t window[NALU_SCAN_SIZE];
+
+    if (input_nalu_length_ > 0) {
+        return true;
     }
 
-    buffer_.get(reinterpret_cast<uint8_t*>(buffer_ptr), 4);
-    buffer_ptr += 4;
-    buffer->planes[0].bytesused = 4;
+    // Skip to the first start code
+    if (input_scanned_ == 0) {
+        for (;;) {
+            if (buffer_.snap(window, 4) < 4) {
+                return false;
+            }
+            if (IS_NAL_UNIT_START(window) || IS_NAL_UNIT_START1(window)) {
+                break;
+            }
+            buffer_.drop();
+        }
+        input_scanned_ = 4;
+    }
 
-    if (buffer_.snap(stream_buffer, 1) && ctx_->copy_timestamp) {
-        if (ctx_->decoder_pixfmt == V4L2_PIX_FMT_H264) {
-            if ((IS_H264_NAL_CODED_SLICE(stream_buffer)) ||
-                (IS_H264_NAL_CODED_SLICE_IDR(stream_buffer)))
-                ctx_->flag_copyts = true;
-            else
-                ctx_->flag_copyts = false;
+    for (;;) {
+        size_t length = buffer_.snap(window, sizeof(window), input_scanned_);
+        if (length < 4) {
+            break;
         }
-        else if (ctx_->decoder_pixfmt == V4L2_PIX_FMT_H265) {
-            h265_nal_unit_type = GET_H265_NAL_UNIT_TYPE(stream_buffer);
-            if ((h265_nal_unit_type >= HEVC_NUT_TRAIL_N &&
-                 h265_nal_unit_type <= HEVC_NUT_RASL_R) ||
-                (h265_nal_unit_type >= HEVC_NUT_BLA_W_LP &&
-                 h265_nal_unit_type <= HEVC_NUT_CRA_NUT))
-                ctx_->flag_copyts = true;
-            else
-                ctx_->flag_copyts = false;
+        for (size_t i = 0; i + 4 <= length; i++) {
+            const uint8_t* bytes = window + i;
+            if (IS_NAL_UNIT_START(bytes) || IS_NAL_UNIT_START1(bytes)) {
+                input_nalu_length_ = input_scanned_ + i;
+                input_scanned_ = 0;
+                return true;
+            }
         }
+        input_scanned_ += length - 3;
     }
 
-    // Copy bytes till the next NAL unit is found
-    while (buffer_.snap(stream_buffer, 4) == 4) {
-        if (IS_NAL_UNIT_START(stream_buffer) ||
-            IS_NAL_UNIT_START1(stream_buffer)) {
-            return buffer->planes[0].bytesused;
-        }
-        *buffer_ptr = stream_buffer[0];
-        buffer_ptr++;
-        buffer_.drop();
-        buffer->planes[0].bytesused++;
+    // A unit that fills the whole ring would never see its end
+    if (buffer_.full()) {
+        SPDLOG_ERROR("NAL unit longer than the {} byte input ring",
+                     buffer_.capacity());
+        input_nalu_length_ = buffer_.size();
+        input_scanned_ = 0;
+        return true;
+    }
+    return false;
+}
+
+// Copies the next NAL unit of a mapped file straight into the output plane
+// buffer; the start codes come from the table shared by every reader of the
+// file.
+int GPNvVideoDecoder::read_file_input_nalu(NvBuffer* buffer,
+                                           GPFileSrc* file_src)
+{
+    std::streamsize length = file_src->ReadNalUnit(buffer->planes[0].data,
+                                                   buffer->planes[0].length);
+    if (length < 0) {
+        buffer->planes[0].bytesused = 0;
+        return -1;
     }
 
-    // Reached end of buffer but could not find NAL unit
-    SPDLOG_ERROR("Could not read nal unit from file. EOF or file corrupted");
-    return -1;
+    // The NAL unit header follows the 3-byte start code
+    if (ctx_->copy_timestamp && length > 3) {
+        update_copyts_flag(buffer->planes[0].data + 3);
+    }
+    buffer->planes[0].bytesused = length;
+    return length;
+}
+
+// Feeds one whole access unit per output plane buffer, so a paced source
+// controls when each frame reaches the decoder
+int GPNvVideoDecoder::read_file_input_access_unit(NvBuffer* buffer,
+                                                  GPFileSrc* file_src)
+{
+    GPVideoCodec codec = ctx_->decoder_pixfmt == V4L2_PIX_FMT_H265
+                             ? GPVideoCodec::H265
+                             : GPVideoCodec::H264;
+    std::streamsize length = file_src->ReadAccessUnit(
+        codec, buffer->planes[0].data, buffer->planes[0].length);
+    if (length < 0) {
+        buffer->planes[0].bytesused = 0;
+        return -1;
+    }
+
+    // Every access unit carries a picture
+    ctx_->flag_copyts = true;
+    buffer->planes[0].bytesused = length;
+    return length;
+}
+
+void GPNvVideoDecoder::update_copyts_flag(const uint8_t* nalu)
+{
+    if (ctx_->decoder_pixfmt == V4L2_PIX_FMT_H264) {
+        if ((IS_H264_NAL_CODED_SLICE(nalu)) ||
+            (IS_H264_NAL_CODED_SLICE_IDR(nalu)))
+            ctx_->flag_copyts = true;
+        else
+            ctx_->flag_copyts = false;
+    }
+    else if (ctx_->decoder_pixfmt == V4L2_PIX_FMT_H265) {
+        int h265_nal_unit_type = GET_H265_NAL_UNIT_TYPE(nalu);
+        if ((h265_nal_unit_type >= HEVC_NUT_TRAIL_N &&
+             h265_nal_unit_type <= HEVC_NUT_RASL_R) ||
+            (h265_nal_unit_type >= HEVC_NUT_BLA_W_LP &&
+             h265_nal_unit_type <= HEVC_NUT_CRA_NUT))
+            ctx_->flag_copyts = true;
+        else
+            ctx_->flag_copyts = false;
+    }
 }
 
 int GPNvVideoDecoder::read_decoder_input_chunk(NvBuffer* buffer)
@@ -189,13 +452,14 @@ int GPNvVideoDecoder::read_decoder_input_chunk(NvBuffer* buffer)
 #endif
 
     if (auto file_src = file_src_.lock()) {
-        std::basic_istream<char>& stream = file_src->Read(
-            reinterpret_cast<char*>(buffer->planes[0].data), bytes_to_read);
-        bytes_read = stream.gcount();
-        if (bytes_read == 0) {
-            // stream.clear();
-            // stream.seekg(0, stream.beg);
+        if (file_src->GetPacingMode() != GPPacingMode::None &&
+            (ctx_->decoder_pixfmt == V4L2_PIX_FMT_H264 ||
+             ctx_->decoder_pixfmt == V4L2_PIX_FMT_H265)) {
+            return read_file_input_access_unit(buffer, file_src.get());
         }
+        // Short at the end of each file of a playlist, 0 only at its end
+        bytes_read = file_src->Read(
+            reinterpret_cast<char*>(buffer->planes[0].data), bytes_to_read);
     }
     buffer->planes[0].bytesused = bytes_read;
     return bytes_read;
@@ -742,7 +1006,7 @@ void* GPNvVideoDecoder::decoder_pollthread_fcn()
     VideoDecodeContext_T* ctx = ctx_;
     v4l2_ctrl_video_device_poll devicepoll;
 
-    pthread_setname_np(pthread_self(), "DecoderDevicePoll");
+    ApplyThreadPolicy("DecDevicePoll");
     SPDLOG_INFO("Starting Device Poll Thread ");
 
     memset(&devicepoll, 0, sizeof(v4l2_ctrl_video_device_poll));
@@ -784,7 +1048,7 @@ void* GPNvVideoDecoder::dec_capture_loop_fcn()
     struct v4l2_event ev;
     int ret;
 
-    pthread_setname_np(pthread_self(), "DecCapPlane");
+    ApplyThreadPolicy("DecCapPlane");
 
     SPDLOG_TRACE("Starting decoder capture loop thread");
 
@@ -846,6 +1110,19 @@ void* GPNvVideoDecoder::dec_capture_loop_fcn()
                 break;
             }
 
+            if (drop_frame_after_seek(v4l2_buf)) {
+                if (ctx->capture_plane_mem_type == V4L2_MEMORY_DMABUF)
+                    v4l2_buf.m.planes[0].m.fd = ctx->dmabuff_fd[v4l2_buf.index];
+                if (dec->capture_plane.qBuffer(v4l2_buf, NULL) < 0) {
+                    Abort();
+                    SPDLOG_ERROR(
+                        "Error while queueing buffer at decoder capture "
+                        "plane");
+                    break;
+                }
+                continue;
+            }
+
             if (ctx->enable_metadata) {
                 v4l2_ctrl_videodec_outputbuf_metadata dec_metadata;
 
@@ -1073,8 +1350,10 @@ bool GPNvVideoDecoder::decoder_proc_nonblocking(bool eos)
 
         if (!file_src) {
             std::unique_lock<std::mutex> lock(buffer_lock_);
-            buffer_condition_.wait(lock,
-                                   [this]() { return buffer_.size() > 0; });
+            buffer_condition_.wait(lock, [this]() {
+                return reads_ring_nalus() ? has_decoder_input_nalu()
+                                          : buffer_.size() > 0;
+            });
             SPDLOG_CRITICAL("bbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbb:{}",
                             buffer_.size());
         }
@@ -1107,11 +1386,20 @@ bool GPNvVideoDecoder::decoder_proc_nonblocking(bool eos)
             std::lock_guard<std::mutex> lock(buffer_lock_);
             NvBuffer* output_buffer = NULL;
 
+            if (file_src) {
+                apply_pending_seek(plane_buffer_index);
+            }
+
             if (!file_src) {
                 if (buffer_.size() == 0) {
                     SPDLOG_TRACE("Input buffer empty.");
                     break;
                 }
+                // The tail of a unit stays in the ring without taking up an
+                // output plane buffer
+                if (reads_ring_nalus() && !has_decoder_input_nalu()) {
+                    break;
+                }
             }
 
             if (plane_buffer_index < max_plane_buffer) {
@@ -1184,6 +1472,7 @@ bool GPNvVideoDecoder::decoder_proc_nonblocking(bool eos)
                 v4l2_output_buf.timestamp.tv_usec =
                     ctx_->timestamp % (MICROSECOND_UNIT);
             }
+            stamp_seek_epoch(v4l2_output_buf);
 
             ret = ctx_->dec->output_plane.qBuffer(v4l2_output_buf, NULL);
             if (ret < 0) {
@@ -1245,6 +1534,21 @@ bool GPNvVideoDecoder::decoder_proc_nonblocking(bool eos)
                 break;
             }
 
+            if (drop_frame_after_seek(v4l2_capture_buf)) {
+                if (ctx_->capture_plane_mem_type == V4L2_MEMORY_DMABUF)
+                    v4l2_capture_buf.m.planes[0].m.fd =
+                        ctx_->dmabuff_fd[v4l2_capture_buf.index];
+                if (ctx_->dec->capture_plane.qBuffer(v4l2_capture_buf, NULL) <
+                    0) {
+                    Abort();
+                    SPDLOG_ERROR(
+                        "Error while queueing buffer at decoder capture "
+                        "plane");
+                    break;
+                }
+                continue;
+            }
+
             if (ctx_->enable_metadata) {
                 v4l2_ctrl_videodec_outputbuf_metadata dec_metadata;
 
@@ -1378,6 +1682,8 @@ bool GPNvVideoDecoder::decoder_proc_blocking(bool eos)
         memset(planes, 0, sizeof(planes));
         v4l2_output_buf.m.planes = planes;
 
+        apply_pending_seek(plane_buffer_index);
+
         // std::lock_guard<std::mutex> lock(buffer_lock_);
 
         // if (!file_src) {
@@ -1387,6 +1693,15 @@ bool GPNvVideoDecoder::decoder_proc_blocking(bool eos)
         //     }
         // }
 
+        // A live stream: an output plane buffer is only taken once a whole
+        // unit is in the ring
+        bool from_ring = reads_ring_nalus();
+        if (from_ring) {
+            std::unique_lock<std::mutex> lock(buffer_lock_);
+            buffer_condition_.wait(
+                lock, [this]() { return has_decoder_input_nalu(); });
+        }
+
         if (plane_buffer_index < max_plane_buffer) {
             v4l2_output_buf.index = plane_buffer_index;
             output_buffer =
@@ -1422,6 +1737,11 @@ bool GPNvVideoDecoder::decoder_proc_blocking(bool eos)
             (ctx_->decoder_pixfmt == V4L2_PIX_FMT_MPEG2) ||
             (ctx_->decoder_pixfmt == V4L2_PIX_FMT_MPEG4)) {
             if (ctx_->input_nalu) {
+                std::unique_lock<std::mutex> lock(buffer_lock_,
+                                                  std::defer_lock);
+                if (from_ring) {
+                    lock.lock();
+                }
                 ret = read_decoder_input_nalu(output_buffer);
             }
             else {
@@ -1452,6 +1772,7 @@ bool GPNvVideoDecoder::decoder_proc_blocking(bool eos)
             v4l2_output_buf.timestamp.tv_usec =
                 ctx_->timestamp % (MICROSECOND_UNIT);
         }
+        stamp_seek_epoch(v4l2_output_buf);
 
         ret = ctx_->dec->output_plane.qBuffer(v4l2_output_buf, NULL);
         if (ret < 0) {
@@ -1481,7 +1802,7 @@ int GPNvVideoDecoder::Proc()
             std::dynamic_pointer_cast<GPDisplayEGLSink>(display));
     }
 
-    pthread_setname_np(pthread_self(), "GPNvVideoDecoderProc");
+    ApplyThreadPolicy("DecOutPlane");
 
     if (ctx_->blocking_mode) {
         SPDLOG_INFO("Creating decoder in blocking mode");
@@ -19,7 +19,10 @@
 
 #include <nvbuf_utils.h>
 
+#include "gp_media_server.h"
 #include "gp_nvvideo_encoder.h"
+#include "gp_rtp_payloader.h"
+#include "gp_threadpool.h"
 
 namespace GPlayer {
 
@@ -38,6 +41,8 @@ namespace GPlayer {
 
 #define IS_DIGIT(c) (c >= '0' && c <= '9')
 #define MICROSECOND_UNIT 1000000
+// Rows per chunk when a frame is copied into the encoder on the thread pool
+#define READ_FRAME_ROWS 32
 
 // Initialise CRC Rec and creates CRC Table based on the polynomial.
 Crc* InitCrc(unsigned int CrcPolynomial)
@@ -107,7 +112,8 @@ using namespace std;
 GPNvVideoEncoder::GPNvVideoEncoder(
     const shared_ptr<VideoEncodeContext_T> context)
 {
-    SetProperties("", "", BeaderType::NvVideoEncoder);
+    SetProperties("GPNvVideoEncoder", "GPNvVideoEncoder",
+                  BeaderType::NvVideoEncoder);
     ctx_ = context;
 }
 
@@ -124,7 +130,7 @@ void GPNvVideoEncoder::Process(GPData* data)
 
     frames_.emplace_back(data);
 
-    sem_post(&ctx_->pollthread_sema);
+    pollthread_sema_.release();
 }
 
 void GPNvVideoEncoder::Abort()
@@ -143,7 +149,12 @@ bool GPNvVideoEncoder::encoder_capture_plane_dq_callback(
     GPNvVideoEncoder* videoEncoder = static_cast<GPNvVideoEncoder*>(arg);
     VideoEncodeContext_T* ctx = videoEncoder->ctx_.get();
     NvVideoEncoder* enc = ctx->enc;
-    pthread_setname_np(pthread_self(), "EncCapPlane");
+    // Called for every buffer on the plane's dequeue thread
+    static thread_local bool placed = false;
+    if (!placed) {
+        videoEncoder->ApplyThreadPolicy("EncCapPlane");
+        placed = true;
+    }
     uint32_t frame_num = ctx->enc->capture_plane.getTotalDequeuedBuffers() - 1;
     uint32_t ReconRef_Y_CRC = 0;
     uint32_t ReconRef_U_CRC = 0;
@@ -181,13 +192,32 @@ bool GPNvVideoEncoder::encoder_capture_plane_dq_callback(
                      buffer->planes[0].bytesused);
 
     // videoEncoder->write_encoder_output_frame(ctx->out_file, buffer);
+    GPBuffer gpbuffer(buffer->planes[0].data, buffer->planes[0].bytesused);
+    // The capture timestamp only means something when the output buffers
+    // carried one to copy; otherwise the PTS stays unset and the payloader
+    // stamps the frame with the wall clock
+    if (ctx->copy_timestamp) {
+        gpbuffer.SetPts(int64_t(v4l2_buf->timestamp.tv_sec) *
+                            MICROSECOND_UNIT +
+                        v4l2_buf->timestamp.tv_usec);
+    }
+    GPData data(&gpbuffer);
     GPFileSink* handler = dynamic_cast<GPFileSink*>(
         videoEncoder->GetChild(BeaderType::FileSink).get());
     if (handler) {
-        GPBuffer gpbuffer(buffer->planes[0].data, buffer->planes[0].bytesused);
-        GPData data(&gpbuffer);
         handler->Process(&data);
     }
+    // Every capture buffer holds one access unit
+    GPRtpPayloader* payloader = dynamic_cast<GPRtpPayloader*>(
+        videoEncoder->GetChild(BeaderType::RtpPayloader).get());
+    if (payloader) {
+        payloader->Process(&data);
+    }
+    GPMediaServer* server = dynamic_cast<GPMediaServer*>(
+        videoEncoder->GetChild(BeaderType::MediaServer).get());
+    if (server) {
+        server->Process(&data);
+    }
 
     num_encoded_frames++;
 
@@ -630,6 +660,7 @@ void* GPNvVideoEncoder::encoder_pollthread_fcn(void* arg)
     VideoEncodeContext_T* ctx = videoEncoder->ctx_.get();
     v4l2_ctrl_video_device_poll devicepoll;
 
+    videoEncoder->ApplyThreadPolicy("EncPollThread");
     cout << "Starting Device Poll Thread " << endl;
 
     memset(&devicepoll, 0, sizeof(v4l2_ctrl_video_device_poll));
@@ -640,7 +671,7 @@ void* GPNvVideoEncoder::encoder_pollthread_fcn(void* arg)
     // When the Poll returns, signal the encoder thread to continue.
 
     while (!ctx->got_error && !ctx->enc->isInError()) {
-        sem_wait(&ctx->pollthread_sema);
+        videoEncoder->pollthread_sema_.acquire();
 
         if (ctx->got_eos) {
             cout << "Got eos, exiting poll thread \n";
@@ -654,7 +685,7 @@ void* GPNvVideoEncoder::encoder_pollthread_fcn(void* arg)
 
         // We can check the devicepoll.resp_events bitmask to see which events
         // are set.
-        sem_post(&ctx->encoderthread_sema);
+        videoEncoder->encoderthread_sema_.release();
     }
     return NULL;
 }
@@ -680,8 +711,8 @@ int GPNvVideoEncoder::encoder_proc_nonblocking(bool eos)
 
         // Since buffers have been queued, issue a post to start polling and
         // then wait here
-        sem_post(&ctx->pollthread_sema);
-        sem_wait(&ctx->encoderthread_sema);
+        pollthread_sema_.release();
+        encoderthread_sema_.acquire();
 
         // Already end of file, no more queue-dequeu for output plane
         if (eos)
@@ -1077,7 +1108,7 @@ int GPNvVideoEncoder::Proc()
 
     LoadConfiguration();
 
-    pthread_setname_np(pthread_self(), "EncOutPlane");
+    ApplyThreadPolicy("EncOutPlane");
 
     if (ctx->runtime_params_str) {
         get_next_runtime_param_change_frame();
@@ -1396,11 +1427,8 @@ int GPNvVideoEncoder::Proc()
         ctx->enc->capture_plane.startDQThread(ctx);
     }
     else {
-        sem_init(&ctx->pollthread_sema, 0, 0);
-        sem_init(&ctx->encoderthread_sema, 0, 0);
         pthread_create(&ctx->enc_pollthread, NULL, encoder_pollthread_fcn,
-                       NULL);
-        pthread_setname_np(ctx->enc_pollthread, "EncPollThread");
+                       this);
         SPDLOG_INFO("Created the PollThread and Encoder Thread\n");
     }
 
@@ -1688,37 +1716,52 @@ cleanup:
     free(ctx->GDR_out_file_path);
     delete ctx->runtime_params_str;
 
-    if (!ctx->blocking_mode) {
-        sem_destroy(&ctx->pollthread_sema);
-        sem_destroy(&ctx->encoderthread_sema);
-    }
     return -error;
 }
 
 int GPNvVideoEncoder::ReadFrame(NvBuffer& buffer)
 {
-    uint32_t i, j;
-    char* data;
+    GPData* frame = nullptr;
+    {
+        std::lock_guard<std::mutex> guard(frames_mutex_);
+        if (!frames_.empty()) {
+            frame = frames_.front();
+            frames_.erase(frames_.begin());
+        }
+    }
+
+    // The frame holds the planes one after another with packed rows; the
+    // rows are copied to their stride on the thread pool
+    const uint8_t* source = nullptr;
+    size_t available = 0;
+    if (frame) {
+        GPBuffer* frame_buffer = *frame;
+        source = frame_buffer->GetData();
+        available = frame_buffer->GetLength();
+    }
 
-    for (i = 0; i < buffer.n_planes; i++) {
+    for (uint32_t i = 0; i < buffer.n_planes; i++) {
         NvBuffer::NvBufferPlane& plane = buffer.planes[i];
-        std::streamsize bytes_to_read =
-            plane.fmt.bytesperpixel * plane.fmt.width;
-        data = (char*)plane.data;
+        size_t row_bytes = plane.fmt.bytesperpixel * plane.fmt.width;
+        size_t stride = plane.fmt.stride;
+        uint8_t* data = plane.data;
         plane.bytesused = 0;
-        for (j = 0; j < plane.fmt.height; j++) {
-            std::lock_guard<std::mutex> guard(frames_mutex_);
-            if (!frames_.empty()) {
-                GPData* gd = frames_.front();
-                GPBuffer* buffer = *gd;
-                if (buffer->GetLength() < bytes_to_read) {
-                    return -1;
-                }
-                std::memcpy(data, buffer->GetData(), bytes_to_read);
-                frames_.pop_back();
+        if (source) {
+            size_t plane_bytes = row_bytes * plane.fmt.height;
+            if (available < plane_bytes) {
+                return -1;
             }
-
-            data += plane.fmt.stride;
+            GPThreadPool::GetInstance().ParallelFor(
+                0, plane.fmt.height,
+                [=](size_t first, size_t last) {
+                    for (size_t row = first; row < last; row++) {
+                        std::memcpy(data + row * stride,
+                                    source + row * row_bytes, row_bytes);
+                    }
+                },
+                READ_FRAME_ROWS);
+            source += plane_bytes;
+            available -= plane_bytes;
         }
         plane.bytesused = plane.fmt.stride * plane.fmt.height;
     }
@@ -1,3 +1,4 @@
+#include <fstream>
 #include <thread>
 
 #include "gp_log.h"
@@ -106,4 +107,62 @@ bool GPPipeline::GetMessage(GPMessage* msg)
     return false;
 }
 
+bool GPPipeline::LoadThreadPolicies(const std::string& filename)
+{
+    using json = nlohmann::json;
+
+    std::ifstream i(filename);
+    json j = json::parse(i, nullptr, false);
+    if (j.is_discarded() || !j.is_object()) {
+        SPDLOG_ERROR("Failed to parse thread policies from {}", filename);
+        return false;
+    }
+
+    for (auto& item : j.items()) {
+        GPThreadPolicy policy;
+        if (!GPThreadPolicy::FromJson(item.value(), policy)) {
+            SPDLOG_ERROR("Invalid thread policy for {} in {}", item.key(),
+                         filename);
+            return false;
+        }
+        SetThreadPolicy(item.key(), policy);
+    }
+    return true;
+}
+
+void GPPipeline::SetThreadPolicy(const std::string& key,
+                                 const GPThreadPolicy& policy)
+{
+    std::lock_guard<std::mutex> guard(thread_mutex_);
+    thread_policies_[key] = policy;
+}
+
+bool GPPipeline::FindThreadPolicy(const IBeader& beader,
+                                  const std::string& thread_name,
+                                  GPThreadPolicy& policy)
+{
+    std::lock_guard<std::mutex> guard(thread_mutex_);
+    auto it = thread_policies_.find(beader.GetName() + "/" + thread_name);
+    if (it == thread_policies_.end()) {
+        it = thread_policies_.find(beader.GetName());
+    }
+    if (it == thread_policies_.end()) {
+        return false;
+    }
+    policy = it->second;
+    return true;
+}
+
+void GPPipeline::AddThreadPlacement(const GPThreadPlacement& placement)
+{
+    std::lock_guard<std::mutex> guard(thread_mutex_);
+    thread_placements_.emplace_back(placement);
+}
+
+std::vector<GPThreadPlacement> GPPipeline::GetThreadPlacements()
+{
+    std::lock_guard<std::mutex> guard(thread_mutex_);
+    return thread_placements_;
+}
+
 }  // namespace GPlayer
@@ -0,0 +1,172 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+#include "gp_log.h"
+#include "gp_preroll_sink.h"
+
+namespace GPlayer {
+
+GPPreRollSink::GPPreRollSink(const GPPreRollOptions& options)
+    : options_(options), ring_(options.ring_size)
+{
+    SetProperties("GPPreRollSink", "GPPreRollSink", BeaderType::FileSink,
+                  true);
+}
+
+GPPreRollSink::~GPPreRollSink()
+{
+    if (recording_) {
+        StopEvent();
+    }
+    if (closing_.valid()) {
+        closing_.wait();
+    }
+}
+
+std::string GPPreRollSink::GetInfo() const
+{
+    return "GPPreRollSink: " + options_.directory + "/" + options_.prefix;
+}
+
+void GPPreRollSink::Trigger()
+{
+    trigger_time_ = std::chrono::steady_clock::now().time_since_epoch().count();
+    triggered_ = true;
+}
+
+void GPPreRollSink::Process(GPData* data)
+{
+    GPBuffer* buffer = *data;
+    auto now = std::chrono::steady_clock::now();
+
+    if (triggered_.exchange(false)) {
+        auto trigger_time = std::chrono::steady_clock::time_point(
+            std::chrono::steady_clock::duration(trigger_time_.load()));
+        post_roll_end_ =
+            trigger_time + std::chrono::seconds(options_.post_roll);
+        if (!recording_) {
+            StartEvent();
+        }
+    }
+    else if (recording_ && now >= post_roll_end_) {
+        StopEvent();
+    }
+
+    if (recording_) {
+        writer_->Write(buffer->GetData(), buffer->GetLength());
+    }
+    Store(buffer->GetData(), buffer->GetLength(),
+          IsKeyframe(options_.codec, buffer->GetData(), buffer->GetLength()),
+          now);
+}
+
+void GPPreRollSink::Store(const uint8_t* data,
+                          size_t length,
+                          bool keyframe,
+                          std::chrono::steady_clock::time_point now)
+{
+    if (length == 0) {
+        return;
+    }
+    if (length > ring_.size()) {
+        if (dropped_frames_++ == 0) {
+            SPDLOG_WARN("{}: {} byte frame does not fit into the ring",
+                        GetInfo(), length);
+        }
+        // The frames after it cannot be decoded without it
+        frames_.clear();
+        return;
+    }
+
+    // Make room, then drop the frames in front of the oldest keyframe left
+    while (!frames_.empty() &&
+           ring_end_ + length - frames_.front().position > ring_.size()) {
+        frames_.pop_front();
+    }
+    while (!frames_.empty() && !frames_.front().keyframe) {
+        frames_.pop_front();
+    }
+    if (frames_.empty() && !keyframe) {
+        return;
+    }
+
+    size_t offset = ring_end_ % ring_.size();
+    size_t first = std::min(length, ring_.size() - offset);
+    memcpy(ring_.data() + offset, data, first);
+    memcpy(ring_.data(), data + first, length - first);
+    frames_.push_back({ring_end_, length, now, keyframe});
+    ring_end_ += length;
+
+    // Keep whole GOPs: the ring starts at the last keyframe that is at least
+    // pre_roll old
+    auto limit = now - std::chrono::seconds(options_.pre_roll);
+    for (;;) {
+        auto next = std::find_if(frames_.begin() + 1, frames_.end(),
+                                 [](const Frame& f) { return f.keyframe; });
+        if (next == frames_.end() || next->time > limit) {
+            break;
+        }
+        frames_.erase(frames_.begin(), next);
+    }
+}
+
+void GPPreRollSink::StartEvent()
+{
+    auto now = std::chrono::system_clock::now();
+    time_t seconds = std::chrono::system_clock::to_time_t(now);
+    int milliseconds =
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            now.time_since_epoch())
+            .count() %
+        1000;
+
+    struct tm local;
+    localtime_r(&seconds, &local);
+    char stamp[32];
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &local);
+    char suffix[8];
+    snprintf(suffix, sizeof(suffix), "-%03d", milliseconds);
+
+    std::string path = options_.directory + "/" + options_.prefix + "-" +
+                       stamp + suffix + options_.extension;
+    writer_ = std::make_unique<GPAsyncFileWriter>(options_.writer);
+    if (!writer_->Open(path)) {
+        writer_.reset();
+        return;
+    }
+
+    // The pre-roll goes out through the writer's staging buffers, the ring
+    // itself is not held up
+    for (const Frame& frame : frames_) {
+        size_t offset = frame.position % ring_.size();
+        size_t first = std::min(frame.length, ring_.size() - offset);
+        writer_->Write(ring_.data() + offset, first);
+        writer_->Write(ring_.data(), frame.length - first);
+    }
+
+    recording_ = true;
+    event_count_++;
+
+    SPDLOG_INFO("{}: event recording to {}, {} frames of pre-roll", GetInfo(),
+                path, frames_.size());
+}
+
+void GPPreRollSink::StopEvent()
+{
+    recording_ = false;
+
+    // Closing waits for the writes in flight, keep that off the producer
+    if (closing_.valid()) {
+        closing_.wait();
+    }
+    std::shared_ptr<GPAsyncFileWriter> writer = std::move(writer_);
+    closing_ = std::async(std::launch::async, [writer]() {
+        writer->Close();
+        SPDLOG_TRACE("Closed event recording, {} bytes",
+                     writer->GetBytesWritten());
+    });
+}
+
+}  // namespace GPlayer
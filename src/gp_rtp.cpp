@@ -0,0 +1,563 @@
+#include <algorithm>
+#include <random>
+
+#include "gp_rtp.h"
+
+namespace GPlayer {
+
+#define RTP_VERSION 2
+
+#define H264_NALU_STAP_A 24
+#define H264_NALU_FU_A 28
+#define H265_NALU_AP 48
+#define H265_NALU_FU 49
+
+#define FU_START 0x80
+#define FU_END 0x40
+
+static const uint8_t kStartCode[] = {0, 0, 0, 1};
+
+static inline uint16_t ReadU16(const uint8_t* p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+static inline uint32_t ReadU32(const uint8_t* p)
+{
+    return (uint32_t(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static inline void WriteU16(uint8_t* p, uint16_t value)
+{
+    p[0] = value >> 8;
+    p[1] = value & 0xFF;
+}
+
+static inline void WriteU32(uint8_t* p, uint32_t value)
+{
+    p[0] = value >> 24;
+    p[1] = (value >> 16) & 0xFF;
+    p[2] = (value >> 8) & 0xFF;
+    p[3] = value & 0xFF;
+}
+
+bool ParseRtpPacket(const uint8_t* packet,
+                    size_t length,
+                    GPRtpHeader& header,
+                    const uint8_t*& payload,
+                    size_t& payload_length)
+{
+    if (length < RTP_HEADER_SIZE || (packet[0] >> 6) != RTP_VERSION) {
+        return false;
+    }
+
+    header.marker = packet[1] & 0x80;
+    header.payload_type = packet[1] & 0x7F;
+    header.sequence = ReadU16(packet + 2);
+    header.timestamp = ReadU32(packet + 4);
+    header.ssrc = ReadU32(packet + 8);
+
+    size_t offset = RTP_HEADER_SIZE + (packet[0] & 0x0F) * 4;
+    if (packet[0] & 0x10) {
+        if (offset + 4 > length) {
+            return false;
+        }
+        offset += 4 + ReadU16(packet + offset + 2) * 4;
+    }
+    size_t end = length;
+    if (packet[0] & 0x20) {
+        end -= std::min<size_t>(packet[length - 1], length);
+    }
+    if (offset >= end) {
+        return false;
+    }
+
+    payload = packet + offset;
+    payload_length = end - offset;
+    return true;
+}
+
+GPRtpPacketizer::GPRtpPacketizer(GPVideoCodec codec,
+                                 uint8_t payload_type,
+                                 size_t mtu,
+                                 uint32_t ssrc)
+    : codec_(codec),
+      payload_type_(payload_type),
+      max_payload_(mtu - RTP_HEADER_SIZE),
+      header_size_(codec == GPVideoCodec::H264 ? 1 : 2)
+{
+    std::random_device random;
+    ssrc_ = ssrc != 0 ? ssrc : random();
+    sequence_ = random();
+    timestamp_base_ = random();
+}
+
+void GPRtpPacketizer::Packetize(const uint8_t* data,
+                                size_t length,
+                                int64_t pts,
+                                GPRtpPackets& packets)
+{
+    timestamp_ =
+        timestamp_base_ + uint32_t(pts * RTP_VIDEO_CLOCK_RATE / 1000000);
+
+    SplitNalus(data, length);
+
+    // An aggregation packet starts with its own NAL unit header and every
+    // NAL unit in it with a two byte size; a NAL unit that ends up alone is
+    // sent as it is
+    for (size_t i = 0; i < nalus_.size(); i++) {
+        const Nalu& nalu = nalus_[i];
+        bool last = i + 1 == nalus_.size();
+
+        if (nalu.length > max_payload_) {
+            FlushAggregate(false, packets);
+            Fragment(nalu, last, packets);
+            continue;
+        }
+
+        size_t size = 2 + nalu.length;
+        if (aggregate_size_ + size > max_payload_) {
+            FlushAggregate(false, packets);
+        }
+        if (aggregate_.empty()) {
+            aggregate_size_ = header_size_;
+        }
+        aggregate_.push_back(nalu);
+        aggregate_size_ += size;
+    }
+    FlushAggregate(true, packets);
+}
+
+// NAL units run from after a start code to the next one; a trailing zero
+// belongs to the four byte start code that follows. A buffer without any
+// start code is taken as one NAL unit.
+void GPRtpPacketizer::SplitNalus(const uint8_t* data, size_t length)
+{
+    nalus_.clear();
+
+    size_t begin = FindStartCode(data, length);
+    if (begin == length) {
+        if (length > header_size_) {
+            nalus_.push_back({data, length});
+        }
+        return;
+    }
+
+    while (begin < length) {
+        begin += 3;
+        size_t end = begin + FindStartCode(data + begin, length - begin);
+        size_t next = end;
+        while (end > begin && data[end - 1] == 0) {
+            end--;
+        }
+        if (end - begin > header_size_) {
+            nalus_.push_back({data + begin, end - begin});
+        }
+        begin = next;
+    }
+}
+
+void GPRtpPacketizer::FlushAggregate(bool marker, GPRtpPackets& packets)
+{
+    if (aggregate_.empty()) {
+        return;
+    }
+
+    if (aggregate_.size() == 1) {
+        const Nalu& nalu = aggregate_[0];
+        uint8_t* payload = AppendPacket(nalu.length, marker, packets);
+        std::copy(nalu.data, nalu.data + nalu.length, payload);
+    }
+    else {
+        uint8_t* payload = AppendPacket(aggregate_size_, marker, packets);
+        if (codec_ == GPVideoCodec::H264) {
+            // F is set if any NAL unit has it, NRI is the highest one
+            uint8_t forbidden = 0;
+            uint8_t nri = 0;
+            for (const Nalu& nalu : aggregate_) {
+                forbidden |= nalu.data[0] & 0x80;
+                nri = std::max<uint8_t>(nri, nalu.data[0] & 0x60);
+            }
+            payload[0] = forbidden | nri | H264_NALU_STAP_A;
+        }
+        else {
+            // The lowest LayerId and TID of the aggregated NAL units
+            uint8_t layer = 0x3F;
+            uint8_t tid = 0x07;
+            for (const Nalu& nalu : aggregate_) {
+                uint8_t nalu_layer =
+                    ((nalu.data[0] & 0x01) << 5) | (nalu.data[1] >> 3);
+                layer = std::min(layer, nalu_layer);
+                tid = std::min<uint8_t>(tid, nalu.data[1] & 0x07);
+            }
+            payload[0] = (H265_NALU_AP << 1) | (layer >> 5);
+            payload[1] = ((layer & 0x1F) << 3) | tid;
+        }
+
+        uint8_t* p = payload + header_size_;
+        for (const Nalu& nalu : aggregate_) {
+            WriteU16(p, nalu.length);
+            p = std::copy(nalu.data, nalu.data + nalu.length, p + 2);
+        }
+    }
+
+    aggregate_.clear();
+    aggregate_size_ = 0;
+}
+
+void GPRtpPacketizer::Fragment(const Nalu& nalu,
+                               bool marker,
+                               GPRtpPackets& packets)
+{
+    // The NAL unit header moves into the FU header, leaving its type in
+    // the last byte
+    size_t fu_header_size = header_size_ + 1;
+    size_t chunk_size = max_payload_ - fu_header_size;
+    int type = GetNaluType(codec_, nalu.data);
+
+    const uint8_t* data = nalu.data + header_size_;
+    size_t left = nalu.length - header_size_;
+    bool start = true;
+    while (left > 0) {
+        size_t chunk = std::min(chunk_size, left);
+        bool end = chunk == left;
+
+        uint8_t* payload =
+            AppendPacket(fu_header_size + chunk, marker && end, packets);
+        uint8_t flags = (start ? FU_START : 0) | (end ? FU_END : 0);
+        if (codec_ == GPVideoCodec::H264) {
+            payload[0] = (nalu.data[0] & 0xE0) | H264_NALU_FU_A;
+            payload[1] = flags | type;
+        }
+        else {
+            payload[0] = (nalu.data[0] & 0x81) | (H265_NALU_FU << 1);
+            payload[1] = nalu.data[1];
+            payload[2] = flags | type;
+        }
+        std::copy(data, data + chunk, payload + fu_header_size);
+
+        data += chunk;
+        left -= chunk;
+        start = false;
+    }
+}
+
+uint8_t* GPRtpPacketizer::AppendPacket(size_t payload_length,
+                                       bool marker,
+                                       GPRtpPackets& packets)
+{
+    uint8_t* packet = packets.Append(RTP_HEADER_SIZE + payload_length);
+    packet[0] = RTP_VERSION << 6;
+    packet[1] = (marker ? 0x80 : 0) | payload_type_;
+    WriteU16(packet + 2, sequence_++);
+    WriteU32(packet + 4, timestamp_);
+    WriteU32(packet + 8, ssrc_);
+    return packet + RTP_HEADER_SIZE;
+}
+
+// Sequence numbers this far from the expected one do not continue the run
+#define RTP_SEQUENCE_JUMP 0x4000
+
+// Slots are indexed by sequence number modulo their count, which only stays
+// unique across the 16 bit wrap for a power of two
+static size_t RoundUpToPowerOfTwo(size_t value, size_t limit)
+{
+    size_t result = 1;
+    while (result < value && result < limit) {
+        result <<= 1;
+    }
+    return result;
+}
+
+GPRtpDepacketizer::GPRtpDepacketizer(GPVideoCodec codec, size_t reorder_depth)
+    : codec_(codec), slots_(RoundUpToPowerOfTwo(reorder_depth, 4096))
+{
+}
+
+void GPRtpDepacketizer::Push(const uint8_t* packet,
+                             size_t length,
+                             const Callback& callback)
+{
+    GPRtpHeader header;
+    const uint8_t* payload;
+    size_t payload_length;
+    if (!ParseRtpPacket(packet, length, header, payload, payload_length)) {
+        stats_.discarded++;
+        return;
+    }
+
+    // A restarted sender comes back with a new SSRC
+    if (started_ && header.ssrc != ssrc_) {
+        Reset(callback);
+    }
+    if (!started_) {
+        started_ = true;
+        ssrc_ = header.ssrc;
+        next_sequence_ = header.sequence;
+    }
+
+    // A jump of a quarter of the sequence space either way is a long loss
+    // or a sender that moved its sequence numbers on; the stream carries on
+    // from here. Shorter gaps are given up on packet by packet below, also
+    // for a shallow window fed in order.
+    int distance = int16_t(header.sequence - next_sequence_);
+    int depth = slots_.size();
+    if (distance < -RTP_SEQUENCE_JUMP || distance >= RTP_SEQUENCE_JUMP) {
+        Resync(header.sequence, distance, callback);
+        distance = 0;
+    }
+
+    if (distance < 0) {
+        stats_.discarded++;
+        return;
+    }
+    while (distance >= depth) {
+        Advance(callback);
+        distance--;
+    }
+
+    stats_.packets++;
+    stats_.bytes += length;
+
+    if (distance == 0) {
+        Depacketize(packet, length, callback);
+        next_sequence_++;
+        while (held_ > 0 && GetSlot(next_sequence_).used) {
+            Advance(callback);
+        }
+        return;
+    }
+
+    Slot& slot = GetSlot(header.sequence);
+    if (slot.used) {
+        stats_.packets--;
+        stats_.bytes -= length;
+        stats_.discarded++;
+        return;
+    }
+    slot.packet.assign(packet, packet + length);
+    slot.used = true;
+    held_++;
+    stats_.reordered++;
+}
+
+void GPRtpDepacketizer::Flush(const Callback& callback)
+{
+    while (held_ > 0) {
+        Advance(callback);
+    }
+    EmitAccessUnit(callback);
+}
+
+// Passes on the packet expected next, or gives up on it if it is missing
+void GPRtpDepacketizer::Advance(const Callback& callback)
+{
+    Slot& slot = GetSlot(next_sequence_);
+    if (slot.used) {
+        Depacketize(slot.packet.data(), slot.packet.size(), callback);
+        slot.used = false;
+        held_--;
+    }
+    else {
+        stats_.lost++;
+        damaged_ = true;
+        in_fragment_ = false;
+    }
+    next_sequence_++;
+}
+
+// Gives up on the packets between next_sequence_ and sequence, passing on
+// the ones held, and goes on from sequence. The access unit in progress
+// lost packets and is dropped; the timestamps stay unwrapped, it is still
+// the same stream.
+void GPRtpDepacketizer::Resync(uint16_t sequence,
+                               int distance,
+                               const Callback& callback)
+{
+    while (held_ > 0) {
+        Advance(callback);
+        distance--;
+    }
+    if (distance > 0) {
+        stats_.lost += distance;
+    }
+    damaged_ = true;
+    in_fragment_ = false;
+    next_sequence_ = sequence;
+}
+
+void GPRtpDepacketizer::Reset(const Callback& callback)
+{
+    Flush(callback);
+    started_ = false;
+    has_timestamp_ = false;
+}
+
+void GPRtpDepacketizer::Depacketize(const uint8_t* packet,
+                                    size_t length,
+                                    const Callback& callback)
+{
+    GPRtpHeader header;
+    const uint8_t* payload;
+    size_t payload_length;
+    ParseRtpPacket(packet, length, header, payload, payload_length);
+
+    if (in_access_unit_ && header.timestamp != timestamp_) {
+        // The marker packet of the previous access unit went missing
+        EmitAccessUnit(callback);
+    }
+    in_access_unit_ = true;
+    timestamp_ = header.timestamp;
+
+    if (codec_ == GPVideoCodec::H264) {
+        DepacketizeH264(payload, payload_length);
+    }
+    else {
+        DepacketizeH265(payload, payload_length);
+    }
+
+    if (header.marker) {
+        EmitAccessUnit(callback);
+    }
+}
+
+void GPRtpDepacketizer::DepacketizeH264(const uint8_t* payload, size_t length)
+{
+    int type = payload[0] & 0x1F;
+    if (type == H264_NALU_STAP_A) {
+        AppendAggregate(payload, length, 1);
+    }
+    else if (type == H264_NALU_FU_A) {
+        if (length < 2) {
+            damaged_ = true;
+            return;
+        }
+        uint8_t fu_header = payload[1];
+        if (fu_header & FU_START) {
+            uint8_t nalu_header = (payload[0] & 0xE0) | (fu_header & 0x1F);
+            access_unit_.insert(access_unit_.end(), kStartCode,
+                                kStartCode + sizeof(kStartCode));
+            access_unit_.push_back(nalu_header);
+            in_fragment_ = true;
+        }
+        else if (!in_fragment_) {
+            // The start of the NAL unit was lost
+            damaged_ = true;
+            return;
+        }
+        access_unit_.insert(access_unit_.end(), payload + 2, payload + length);
+        if (fu_header & FU_END) {
+            in_fragment_ = false;
+        }
+    }
+    else if (type >= 1 && type <= 23) {
+        AppendNalu(payload, length);
+    }
+    else {
+        // STAP-B, MTAP and FU-B belong to the interleaved mode
+        damaged_ = true;
+    }
+}
+
+void GPRtpDepacketizer::DepacketizeH265(const uint8_t* payload, size_t length)
+{
+    if (length < 2) {
+        damaged_ = true;
+        return;
+    }
+
+    int type = (payload[0] >> 1) & 0x3F;
+    if (type == H265_NALU_AP) {
+        AppendAggregate(payload, length, 2);
+    }
+    else if (type == H265_NALU_FU) {
+        if (length < 3) {
+            damaged_ = true;
+            return;
+        }
+        uint8_t fu_header = payload[2];
+        if (fu_header & FU_START) {
+            access_unit_.insert(access_unit_.end(), kStartCode,
+                                kStartCode + sizeof(kStartCode));
+            access_unit_.push_back((payload[0] & 0x81) |
+                                   ((fu_header & 0x3F) << 1));
+            access_unit_.push_back(payload[1]);
+            in_fragment_ = true;
+        }
+        else if (!in_fragment_) {
+            damaged_ = true;
+            return;
+        }
+        access_unit_.insert(access_unit_.end(), payload + 3, payload + length);
+        if (fu_header & FU_END) {
+            in_fragment_ = false;
+        }
+    }
+    else if (type < H265_NALU_AP) {
+        AppendNalu(payload, length);
+    }
+    else {
+        // PACI and reserved types
+        damaged_ = true;
+    }
+}
+
+// STAP-A and AP: a NAL unit header, then NAL units each behind a two byte
+// size; without sprop-max-don-diff there are no DON fields
+void GPRtpDepacketizer::AppendAggregate(const uint8_t* data,
+                                        size_t length,
+                                        size_t skip)
+{
+    size_t pos = skip;
+    while (pos + 2 <= length) {
+        size_t size = ReadU16(data + pos);
+        pos += 2;
+        if (size == 0 || pos + size > length) {
+            damaged_ = true;
+            return;
+        }
+        AppendNalu(data + pos, size);
+        pos += size;
+    }
+}
+
+void GPRtpDepacketizer::AppendNalu(const uint8_t* data, size_t length)
+{
+    access_unit_.insert(access_unit_.end(), kStartCode,
+                        kStartCode + sizeof(kStartCode));
+    access_unit_.insert(access_unit_.end(), data, data + length);
+}
+
+void GPRtpDepacketizer::EmitAccessUnit(const Callback& callback)
+{
+    if (in_access_unit_) {
+        if (!has_timestamp_) {
+            has_timestamp_ = true;
+            extended_timestamp_ = timestamp_;
+            first_timestamp_ = timestamp_;
+        }
+        else {
+            extended_timestamp_ += int32_t(timestamp_ - last_timestamp_);
+        }
+        last_timestamp_ = timestamp_;
+
+        if (damaged_ || in_fragment_ || access_unit_.empty()) {
+            stats_.broken_access_units++;
+        }
+        else {
+            int64_t pts = (extended_timestamp_ - first_timestamp_) * 1000000 /
+                          RTP_VIDEO_CLOCK_RATE;
+            stats_.access_units++;
+            callback(access_unit_.data(), access_unit_.size(), pts,
+                     HasKeyframeNalu(codec_, access_unit_.data(),
+                                     access_unit_.size()));
+        }
+    }
+
+    access_unit_.clear();
+    in_access_unit_ = false;
+    damaged_ = false;
+    in_fragment_ = false;
+}
+
+}  // namespace GPlayer
@@ -0,0 +1,170 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cerrno>
+#include <vector>
+
+#include "gp_filesink.h"
+#include "gp_log.h"
+#include "gp_nvvideo_decoder.h"
+#include "gp_rtp_depayloader.h"
+#include "gp_socket.h"
+
+namespace GPlayer {
+
+// Larger than any RTP packet over UDP
+#define RTP_RECEIVE_SIZE 65536
+// How often Proc() looks at the stop flag while the stream is idle
+#define RTP_RECEIVE_TIMEOUT_MS 100
+
+GPRtpDepayloader::GPRtpDepayloader(const GPRtpOptions& options)
+    : options_(options),
+      depacketizer_(options.codec, options.reorder_depth),
+      on_access_unit_([this](const uint8_t* data, size_t length, int64_t pts,
+                             bool keyframe) {
+          OnAccessUnit(data, length, pts, keyframe);
+      })
+{
+    SetProperties("GPRtpDepayloader", "GPRtpDepayloader",
+                  BeaderType::RtpDepayloader, false);
+
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(options_.port);
+    if (inet_pton(AF_INET, options_.host.c_str(), &address.sin_addr) != 1) {
+        SPDLOG_ERROR("Invalid RTP address {}", options_.host);
+        return;
+    }
+
+    socket_ = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (socket_ < 0) {
+        SPDLOG_ERROR("Cannot create RTP socket: {}", strerror(errno));
+        return;
+    }
+    // Holds the packets that arrive while an access unit is passed on
+    SetReceiveBufferSize(socket_, options_.socket_buffer_size, "RTP");
+    struct timeval timeout = {0, RTP_RECEIVE_TIMEOUT_MS * 1000};
+    setsockopt(socket_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    if (bind(socket_, reinterpret_cast<struct sockaddr*>(&address),
+             sizeof(address)) < 0) {
+        SPDLOG_ERROR("Cannot bind RTP socket to {}:{}: {}", options_.host,
+                     options_.port, strerror(errno));
+        close(socket_);
+        socket_ = -1;
+    }
+}
+
+GPRtpDepayloader::~GPRtpDepayloader()
+{
+    if (socket_ >= 0) {
+        close(socket_);
+    }
+}
+
+std::string GPRtpDepayloader::GetInfo() const
+{
+    return "GPRtpDepayloader: " + options_.host + ":" +
+           std::to_string(options_.port);
+}
+
+int GPRtpDepayloader::Proc()
+{
+    ApplyThreadPolicy("RtpDepayloader");
+
+    if (socket_ < 0) {
+        return -1;
+    }
+
+    std::vector<uint8_t> packet(RTP_RECEIVE_SIZE);
+    while (!stop_) {
+        ssize_t length = recv(socket_, packet.data(), packet.size(), 0);
+        if (length < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                continue;
+            }
+            SPDLOG_ERROR("Cannot receive RTP packet: {}", strerror(errno));
+            return -1;
+        }
+
+        std::lock_guard<std::mutex> lock(depacketizer_mutex_);
+        depacketizer_.Push(packet.data(), length, on_access_unit_);
+        UpdateStats();
+    }
+
+    std::lock_guard<std::mutex> lock(depacketizer_mutex_);
+    depacketizer_.Flush(on_access_unit_);
+    UpdateStats();
+    return 0;
+}
+
+void GPRtpDepayloader::Process(GPData* data)
+{
+    GPBuffer* buffer = *data;
+    if (buffer == nullptr) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(depacketizer_mutex_);
+    depacketizer_.Push(buffer->GetData(), buffer->GetLength(),
+                       on_access_unit_);
+    UpdateStats();
+}
+
+void GPRtpDepayloader::SetAccessUnitCallback(
+    const AccessUnitCallback& callback)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    callback_ = callback;
+}
+
+GPRtpStats GPRtpDepayloader::GetStats()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void GPRtpDepayloader::UpdateStats()
+{
+    GPRtpStats stats = depacketizer_.GetStats();
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_ = stats;
+}
+
+void GPRtpDepayloader::OnAccessUnit(const uint8_t* data,
+                                    size_t length,
+                                    int64_t pts,
+                                    bool keyframe)
+{
+    // Runs under depacketizer_mutex_; the stats read meanwhile include
+    // the packets of this access unit
+    UpdateStats();
+    AccessUnitCallback callback;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        callback = callback_;
+    }
+
+    GPBuffer buffer(const_cast<uint8_t*>(data), length);
+    buffer.SetPts(pts);
+    if (callback) {
+        callback(buffer, keyframe);
+    }
+
+    GPData frame(&buffer);
+    for (auto& beader : GetChildren(BeaderType::NvVideoDecoder)) {
+        auto decoder = std::dynamic_pointer_cast<GPNvVideoDecoder>(beader);
+        if (decoder) {
+            decoder->Process(&frame);
+        }
+    }
+    for (auto& beader : GetChildren(BeaderType::FileSink)) {
+        auto sink = std::dynamic_pointer_cast<GPFileSink>(beader);
+        if (sink) {
+            sink->Process(&frame);
+        }
+    }
+}
+
+}  // namespace GPlayer
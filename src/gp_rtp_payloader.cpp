@@ -0,0 +1,130 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+
+#include "gp_log.h"
+#include "gp_rtp_payloader.h"
+
+namespace GPlayer {
+
+// Packets handed to the kernel by one sendmmsg() call
+#define RTP_SEND_BATCH 64
+
+GPRtpPayloader::GPRtpPayloader(const GPRtpOptions& options)
+    : options_(options),
+      packetizer_(options.codec, options.payload_type, options.mtu),
+      messages_(RTP_SEND_BATCH),
+      iovecs_(RTP_SEND_BATCH),
+      start_time_(std::chrono::steady_clock::now())
+{
+    SetProperties("GPRtpPayloader", "GPRtpPayloader",
+                  BeaderType::RtpPayloader, true);
+
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(options_.port);
+    if (inet_pton(AF_INET, options_.host.c_str(), &address.sin_addr) != 1) {
+        SPDLOG_ERROR("Invalid RTP destination {}", options_.host);
+        return;
+    }
+
+    socket_ = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (socket_ < 0) {
+        SPDLOG_ERROR("Cannot create RTP socket: {}", strerror(errno));
+        return;
+    }
+    // A keyframe leaves as a burst of a few hundred packets
+    if (setsockopt(socket_, SOL_SOCKET, SO_SNDBUF, &options_.socket_buffer_size,
+                   sizeof(options_.socket_buffer_size)) < 0) {
+        SPDLOG_WARN("Cannot set RTP send buffer to {} bytes: {}",
+                    options_.socket_buffer_size, strerror(errno));
+    }
+    if (connect(socket_, reinterpret_cast<struct sockaddr*>(&address),
+                sizeof(address)) < 0) {
+        SPDLOG_ERROR("Cannot connect RTP socket to {}:{}: {}", options_.host,
+                     options_.port, strerror(errno));
+        close(socket_);
+        socket_ = -1;
+    }
+}
+
+GPRtpPayloader::~GPRtpPayloader()
+{
+    if (socket_ >= 0) {
+        close(socket_);
+    }
+}
+
+std::string GPRtpPayloader::GetInfo() const
+{
+    return "GPRtpPayloader: " + options_.host + ":" +
+           std::to_string(options_.port);
+}
+
+void GPRtpPayloader::Process(GPData* data)
+{
+    GPBuffer* buffer = *data;
+    if (socket_ < 0 || buffer == nullptr || buffer->GetLength() == 0) {
+        return;
+    }
+
+    int64_t pts = buffer->GetPts();
+    if (pts < 0) {
+        pts = std::chrono::duration_cast<std::chrono::microseconds>(
+                  std::chrono::steady_clock::now() - start_time_)
+                  .count();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    packets_.Clear();
+    packetizer_.Packetize(buffer->GetData(), buffer->GetLength(), pts,
+                          packets_);
+    stats_.access_units++;
+    Send();
+}
+
+void GPRtpPayloader::Send()
+{
+    size_t count = packets_.GetCount();
+    size_t sent = 0;
+    while (sent < count) {
+        size_t batch = std::min<size_t>(count - sent, RTP_SEND_BATCH);
+        for (size_t i = 0; i < batch; i++) {
+            iovecs_[i].iov_base = const_cast<uint8_t*>(
+                packets_.GetPacket(sent + i));
+            iovecs_[i].iov_len = packets_.GetLength(sent + i);
+            messages_[i].msg_hdr = {};
+            messages_[i].msg_hdr.msg_iov = &iovecs_[i];
+            messages_[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        int result = sendmmsg(socket_, messages_.data(), batch, 0);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // Most often ECONNREFUSED while nobody listens; the packet is
+            // skipped and the rest of the access unit still goes out
+            stats_.send_errors++;
+            SPDLOG_TRACE("Cannot send RTP packet: {}", strerror(errno));
+            sent++;
+            continue;
+        }
+        for (int i = 0; i < result; i++) {
+            stats_.bytes += iovecs_[i].iov_len;
+        }
+        stats_.packets += result;
+        sent += result;
+    }
+}
+
+GPRtpPayloaderStats GPRtpPayloader::GetStats()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+}  // namespace GPlayer
@@ -0,0 +1,217 @@
+#include <pthread.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+#include "gp_log.h"
+#include "gp_segment_sink.h"
+
+namespace GPlayer {
+
+GPSegmentSink::GPSegmentSink(const GPSegmentOptions& options)
+    : options_(options)
+{
+    SetProperties("GPSegmentSink", "GPSegmentSink", BeaderType::FileSink,
+                  true);
+
+    current_ = OpenSegment();
+    housekeeping_ = std::thread(&GPSegmentSink::HousekeepingProc, this);
+}
+
+GPSegmentSink::~GPSegmentSink()
+{
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        stop_ = true;
+    }
+    condition_.notify_all();
+    housekeeping_.join();
+
+    if (current_) {
+        current_->writer->Close();
+        if (!segment_started_) {
+            unlink(current_->path.c_str());
+        }
+    }
+    if (next_) {
+        next_->writer->Close();
+        unlink(next_->path.c_str());
+    }
+}
+
+std::string GPSegmentSink::GetInfo() const
+{
+    return "GPSegmentSink: " + options_.directory + "/" + options_.prefix;
+}
+
+void GPSegmentSink::Process(GPData* data)
+{
+    GPBuffer* buffer = *data;
+
+    if (segment_started_ && IsSegmentFull() &&
+        (!options_.keyframe_aligned ||
+         IsKeyframe(options_.codec, buffer->GetData(),
+                    buffer->GetLength()))) {
+        Rotate();
+    }
+
+    if (!current_) {
+        // The first segment could not be opened in the constructor
+        {
+            std::lock_guard<std::mutex> guard(mutex_);
+            current_ = std::move(next_);
+        }
+        condition_.notify_one();
+        if (!current_) {
+            return;
+        }
+    }
+    if (!segment_started_) {
+        StartSegment();
+    }
+
+    current_->writer->Write(buffer->GetData(), buffer->GetLength());
+    segment_bytes_ += buffer->GetLength();
+}
+
+bool GPSegmentSink::IsSegmentFull() const
+{
+    if (options_.max_size > 0 && segment_bytes_ >= options_.max_size) {
+        return true;
+    }
+    if (options_.max_duration > 0 &&
+        std::chrono::steady_clock::now() - segment_start_ >=
+            std::chrono::seconds(options_.max_duration)) {
+        return true;
+    }
+    return false;
+}
+
+// Names the current segment after the wall clock time of its first frame
+void GPSegmentSink::StartSegment()
+{
+    auto now = std::chrono::system_clock::now();
+    time_t seconds = std::chrono::system_clock::to_time_t(now);
+    int milliseconds =
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            now.time_since_epoch())
+            .count() %
+        1000;
+
+    struct tm local;
+    localtime_r(&seconds, &local);
+    char stamp[32];
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &local);
+    char suffix[8];
+    snprintf(suffix, sizeof(suffix), "-%03d", milliseconds);
+
+    std::string path = options_.directory + "/" + options_.prefix + "-" +
+                       stamp + suffix + options_.extension;
+    PushTask({nullptr, current_->path, path});
+    current_->path = path;
+
+    segment_start_ = std::chrono::steady_clock::now();
+    segment_bytes_ = 0;
+    segment_started_ = true;
+    segment_count_++;
+}
+
+void GPSegmentSink::Rotate()
+{
+    std::unique_ptr<Segment> next;
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        next = std::move(next_);
+    }
+
+    if (!next) {
+        // Keep writing to the current segment and try again at the next
+        // opportunity rather than wait for storage
+        if (late_rotations_++ == 0) {
+            SPDLOG_WARN("{}: next segment not ready, postponing rotation",
+                        GetInfo());
+        }
+        return;
+    }
+
+    PushTask({std::move(current_), "", ""});
+    current_ = std::move(next);
+    segment_started_ = false;
+}
+
+void GPSegmentSink::PushTask(Task&& task)
+{
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        tasks_.push_back(std::move(task));
+    }
+    condition_.notify_one();
+}
+
+std::unique_ptr<GPSegmentSink::Segment> GPSegmentSink::OpenSegment()
+{
+    auto segment = std::make_unique<Segment>();
+    segment->path = options_.directory + "/." + options_.prefix + "-" +
+                    std::to_string(placeholder_count_++) + ".partial";
+    segment->writer = std::make_unique<GPAsyncFileWriter>(options_.writer);
+
+    if (!segment->writer->Open(segment->path)) {
+        return nullptr;
+    }
+    if (options_.preallocate_size > 0) {
+        segment->writer->Preallocate(options_.preallocate_size);
+    }
+    return segment;
+}
+
+void GPSegmentSink::HousekeepingProc()
+{
+    ApplyThreadPolicy("GPSegmentSink");
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        condition_.wait(
+            lock, [this]() { return stop_ || !tasks_.empty() || !next_; });
+
+        if (!tasks_.empty()) {
+            Task task = std::move(tasks_.front());
+            tasks_.pop_front();
+            lock.unlock();
+
+            if (!task.rename_from.empty() &&
+                std::rename(task.rename_from.c_str(),
+                            task.rename_to.c_str()) < 0) {
+                SPDLOG_ERROR("Failed to rename {} to {}: {}", task.rename_from,
+                             task.rename_to, strerror(errno));
+            }
+            if (task.close) {
+                task.close->writer->Close();
+                SPDLOG_TRACE("Closed segment {}, {} bytes", task.close->path,
+                             task.close->writer->GetBytesWritten());
+            }
+
+            lock.lock();
+            continue;
+        }
+
+        if (stop_) {
+            break;
+        }
+
+        lock.unlock();
+        auto segment = OpenSegment();
+        lock.lock();
+        if (!segment) {
+            // Retry later, e.g. once the disk is back
+            condition_.wait_for(lock, std::chrono::seconds(1), [this]() {
+                return stop_ || !tasks_.empty();
+            });
+            continue;
+        }
+        next_ = std::move(segment);
+    }
+}
+
+}  // namespace GPlayer
@@ -0,0 +1,52 @@
+#include <string.h>
+#include <sys/socket.h>
+#include <cerrno>
+
+#include "gp_log.h"
+#include "gp_socket.h"
+
+namespace GPlayer {
+
+void SetReceiveBufferSize(int socket, int size, const std::string& name)
+{
+    if (setsockopt(socket, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size)) < 0) {
+        SPDLOG_WARN("Cannot set {} receive buffer to {} bytes: {}", name,
+                    size, strerror(errno));
+        return;
+    }
+    int granted = 0;
+    socklen_t length = sizeof(granted);
+    getsockopt(socket, SOL_SOCKET, SO_RCVBUF, &granted, &length);
+    // The kernel reports twice what it accounts for payload
+    if (granted / 2 < size) {
+        SPDLOG_WARN("{} receive buffer is {} bytes, raise net.core.rmem_max "
+                    "for {}",
+                    name, granted / 2, size);
+    }
+}
+
+ssize_t GPLengthPrefix::Receive(int socket)
+{
+    ssize_t received = recv(socket, bytes_ + size_, sizeof(bytes_) - size_, 0);
+    if (received > 0) {
+        size_ += received;
+    }
+    return received;
+}
+
+bool GPLengthPrefix::Take(size_t max_frame_size,
+                          const std::string& name,
+                          size_t* frame_size)
+{
+    size_ = 0;
+    *frame_size = (uint32_t(bytes_[0]) << 24) | (bytes_[1] << 16) |
+                  (bytes_[2] << 8) | bytes_[3];
+    if (*frame_size > max_frame_size) {
+        SPDLOG_ERROR("{}: frame of {} bytes, over the limit of {}", name,
+                     *frame_size, max_frame_size);
+        return false;
+    }
+    return true;
+}
+
+}  // namespace GPlayer
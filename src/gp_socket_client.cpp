@@ -1,84 +1,260 @@
-
-#include <asio.hpp>
+#include <netdb.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <thread>
 
 #include "gp_log.h"
+#include "gp_nvvideo_decoder.h"
 #include "gp_socket_client.h"
 
 namespace GPlayer {
 
-GPSocketClient::GPSocketClient(int port) : port_(port)
+// Bounds a connect() to a host that does not answer
+#define CONNECT_TIMEOUT_MS 2000
+// How often Proc() looks at the stop flag while the stream is idle
+#define RECEIVE_TIMEOUT_MS 100
+#define RETRY_SLEEP_STEP std::chrono::milliseconds(100)
+#define BITRATE_WINDOW std::chrono::seconds(1)
+
+GPSocketClient::GPSocketClient(const GPSocketClientOptions& options)
+    : options_(options)
 {
     SetProperties("GPSocketClient", "GPSocketClient",
-                  BeaderType::SocketServerSrc, true);
+                  BeaderType::SocketClientSrc, false);
+}
+
+GPSocketClient::GPSocketClient(const std::string& host,
+                               uint16_t port,
+                               GPStreamFraming framing)
+    : GPSocketClient([&]() {
+          GPSocketClientOptions options;
+          options.host = host;
+          options.port = port;
+          options.framing = framing;
+          return options;
+      }())
+{
 }
 
 GPSocketClient::~GPSocketClient()
 {
-    inputfile_->close();
-    delete inputfile_;
+    Disconnect();
 }
 
 std::string GPSocketClient::GetInfo() const
 {
-    return "GPSocketClient: " + filepath_;
+    return "GPSocketClient: " + options_.host + ":" +
+           std::to_string(options_.port);
 }
 
-void GPSocketClient::Process(GPData* data)
+int GPSocketClient::Proc()
 {
-    GPBuffer* buffer = *data;
-    inputfile_->read(reinterpret_cast<char*>(buffer->GetData()),
-                     buffer->GetLength());
+    ApplyThreadPolicy("GPSocketClient");
+
+    auto decoder = std::dynamic_pointer_cast<GPNvVideoDecoder>(
+        GetChild(BeaderType::NvVideoDecoder));
+    if (!decoder) {
+        SPDLOG_ERROR("No decoder is linked to {}", GetInfo());
+        return -1;
+    }
+
+    std::chrono::milliseconds retry = options_.min_retry;
+    bool was_connected = false;
+    while (!stop_) {
+        if (!Connect()) {
+            {
+                std::lock_guard<std::mutex> lock(stats_mutex_);
+                stats_.connect_failures++;
+            }
+            SPDLOG_WARN("{}: retrying in {} ms", GetInfo(), retry.count());
+            auto until = std::chrono::steady_clock::now() + retry;
+            while (!stop_ && std::chrono::steady_clock::now() < until) {
+                std::this_thread::sleep_for(RETRY_SLEEP_STEP);
+            }
+            retry = std::min(retry * 2, options_.max_retry);
+            continue;
+        }
+
+        retry = options_.min_retry;
+        {
+            std::lock_guard<std::mutex> lock(stats_mutex_);
+            stats_.connected = true;
+            stats_.connects++;
+            if (was_connected) {
+                stats_.reconnects++;
+            }
+            window_bytes_ = 0;
+            window_start_ = std::chrono::steady_clock::now();
+        }
+        was_connected = true;
+        // The part of an access unit received before a connection was lost
+        // stays with the decoder; the next one starts on a fresh frame
+        prefix_.Reset();
+        frame_left_ = 0;
+
+        while (!stop_ && Receive(decoder.get())) {
+        }
+
+        Disconnect();
+        {
+            std::lock_guard<std::mutex> lock(stats_mutex_);
+            stats_.connected = false;
+            stats_.bitrate = 0;
+        }
+        if (!stop_) {
+            SPDLOG_WARN("{}: connection lost", GetInfo());
+        }
+    }
+    return 0;
 }
 
-std::basic_istream<char>& GPSocketClient::Read(char* buffer,
-                                               std::streamsize count)
+GPSocketClientStats GPSocketClient::GetStats()
 {
-    return inputfile_->read(buffer, count);
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    return stats_;
 }
 
-using asio::ip::tcp;
-
-void process_client(std::shared_ptr<tcp::socket> client)
+bool GPSocketClient::Connect()
 {
-    time_t now = time(0);
-    std::shared_ptr<std::string> message(new std::string(ctime(&now)));
+    struct addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo* addresses = nullptr;
+    int error = getaddrinfo(options_.host.c_str(),
+                            std::to_string(options_.port).c_str(), &hints,
+                            &addresses);
+    if (error != 0) {
+        SPDLOG_WARN("Cannot resolve {}: {}", options_.host,
+                    gai_strerror(error));
+        return false;
+    }
+
+    int fd = -1;
+    int connect_errno = 0;
+    for (struct addrinfo* address = addresses; address != nullptr;
+         address = address->ai_next) {
+        fd = socket(address->ai_family, address->ai_socktype | SOCK_CLOEXEC,
+                    address->ai_protocol);
+        if (fd < 0) {
+            connect_errno = errno;
+            continue;
+        }
+        // Set before connecting, so the window scale covers it
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &options_.socket_buffer_size,
+                   sizeof(options_.socket_buffer_size));
+        // On Linux the send timeout also bounds connect()
+        struct timeval timeout = {CONNECT_TIMEOUT_MS / 1000,
+                                  CONNECT_TIMEOUT_MS % 1000 * 1000};
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        if (connect(fd, address->ai_addr, address->ai_addrlen) == 0) {
+            break;
+        }
+        connect_errno = errno;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(addresses);
 
-    auto callback = [=](const asio::error_code& err, size_t size) {
-        if (size == message->length())
-            SPDLOG_TRACE("write completed");
-    };
+    if (fd < 0) {
+        SPDLOG_WARN("Cannot connect to {}:{}: {}", options_.host,
+                    options_.port, strerror(connect_errno));
+        return false;
+    }
 
-    client->async_send(asio::buffer(*message), callback);
+    struct timeval timeout = {0, RECEIVE_TIMEOUT_MS * 1000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    socket_ = fd;
+    SPDLOG_INFO("Connected to {}:{}", options_.host, options_.port);
+    return true;
 }
 
-typedef std::function<void(const asio::error_code&)> accept_callback;
+void GPSocketClient::Disconnect()
+{
+    if (socket_ >= 0) {
+        close(socket_);
+        socket_ = -1;
+    }
+}
 
-void start_accept(tcp::acceptor& server)
+bool GPSocketClient::Receive(GPNvVideoDecoder* decoder)
 {
-    std::shared_ptr<tcp::socket> client(new tcp::socket(server.get_executor()));
-    accept_callback callback = [&server,
-                                client](const asio::error_code& error) {
-        if (!error)
-            process_client(client);
+    bool framed = options_.framing == GPStreamFraming::Length;
+    if (framed && frame_left_ == 0) {
+        return ReceiveLengthPrefix();
+    }
 
-        start_accept(server);
-    };
+    size_t length;
+    uint8_t* data = decoder->Reserve(&length);
+    if (length == 0) {
+        // The decoder is behind; TCP flow control holds the sender back
+        // meanwhile
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        return true;
+    }
+    if (framed) {
+        length = std::min(length, frame_left_);
+    }
 
-    server.async_accept(*client, callback);
+    ssize_t received = recv(socket_, data, length, 0);
+    if (received > 0) {
+        decoder->Commit(received);
+        if (framed) {
+            frame_left_ -= received;
+        }
+        Account(received, framed && frame_left_ == 0);
+        return true;
+    }
+    if (received == 0) {
+        return false;
+    }
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+        return true;
+    }
+    SPDLOG_WARN("{}: cannot receive: {}", GetInfo(), strerror(errno));
+    return false;
 }
 
-int GPSocketClient::Proc()
+bool GPSocketClient::ReceiveLengthPrefix()
 {
-    try {
-        asio::io_service io_service;
-        tcp::acceptor acceptor(io_service, tcp::endpoint(tcp::v4(), port_));
-        start_accept(acceptor);
-        io_service.run();
+    ssize_t received = prefix_.Receive(socket_);
+    if (received == 0) {
+        return false;
     }
-    catch (std::exception& e) {
-        SPDLOG_CRITICAL(e.what());
+    if (received < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            return true;
+        }
+        SPDLOG_WARN("{}: cannot receive: {}", GetInfo(), strerror(errno));
+        return false;
+    }
+
+    Account(received, false);
+    if (!prefix_.IsComplete()) {
+        return true;
+    }
+    // Out of step with the stream; a new connection starts on a frame
+    return prefix_.Take(options_.max_frame_size, GetInfo(), &frame_left_);
+}
+
+void GPSocketClient::Account(size_t bytes, bool frame_end)
+{
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    stats_.bytes += bytes;
+    if (frame_end) {
+        stats_.frames++;
+    }
+
+    window_bytes_ += bytes;
+    auto now = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed = now - window_start_;
+    if (now - window_start_ >= BITRATE_WINDOW) {
+        stats_.bitrate = window_bytes_ * 8 / elapsed.count();
+        window_bytes_ = 0;
+        window_start_ = now;
     }
-    return 0;
 }
 
 }  // namespace GPlayer
@@ -1,196 +1,634 @@
-
-#include <asio.hpp>
-#include <ctime>
-#include <iostream>
-#include <string>
-
+#include <arpa/inet.h>
+#include <netinet/udp.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+
+#include "gp_log.h"
+#include "gp_nvvideo_decoder.h"
 #include "gp_socket_server.h"
 
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+
 namespace GPlayer {
 
-GPSocketServer::GPSocketServer(int port) : port_(port)
+// epoll tags of the server's own sockets; streams are numbered after them
+#define WAKEUP_TAG 0
+#define LISTENER_TAG 1
+#define UDP_TAG 2
+#define FIRST_STREAM_ID 16
+
+// Longest epoll_wait() sleeps; idle UDP streams are looked for this often
+#define SERVER_WAIT_MS 100
+// How soon a stream whose decoder was full is tried again
+#define STALLED_WAIT_MS 1
+#define LISTEN_BACKLOG 128
+#define MAX_DATAGRAM_SIZE 2048
+#define MAX_GRO_SIZE 65535
+
+static std::string ToString(const struct sockaddr_in& address)
+{
+    char host[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &address.sin_addr, host, sizeof(host));
+    return std::string(host) + ":" + std::to_string(ntohs(address.sin_port));
+}
+
+GPSocketServer::GPSocketServer(const GPSocketServerOptions& options)
+    : options_(options),
+      datagram_size_(MAX_DATAGRAM_SIZE),
+      next_id_(FIRST_STREAM_ID)
 {
     SetProperties("GPSocketServer", "GPSocketServer",
-                  BeaderType::SocketServerSrc, true);
+                  BeaderType::SocketServerSrc, false);
+
+    if (!Open()) {
+        for (int* fd : {&epoll_, &listener_, &udp_, &wakeup_}) {
+            if (*fd >= 0) {
+                close(*fd);
+                *fd = -1;
+            }
+        }
+        return;
+    }
+
+    size_t batch = options_.batch_size;
+    datagrams_.resize(batch, std::vector<uint8_t>(datagram_size_));
+    messages_.resize(batch);
+    iovecs_.resize(batch);
+    sources_.resize(batch);
+    controls_.resize(batch, std::vector<uint8_t>(CMSG_SPACE(sizeof(int))));
 }
 
 GPSocketServer::~GPSocketServer()
 {
-    inputfile_->close();
-    delete inputfile_;
+    for (auto& [id, stream] : streams_) {
+        if (stream->socket >= 0) {
+            close(stream->socket);
+        }
+    }
+    for (int fd : {epoll_, listener_, udp_, wakeup_}) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
 }
 
 std::string GPSocketServer::GetInfo() const
 {
-    return "GPSocketServer: " + filepath_;
+    return "GPSocketServer: " + options_.address + ":" +
+           std::to_string(options_.port);
 }
 
-void GPSocketServer::Process(GPData* data)
+bool GPSocketServer::Open()
 {
-    GPBuffer* buffer = *data;
-    inputfile_->read(reinterpret_cast<char*>(buffer->GetData()),
-                     buffer->GetLength());
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(options_.port);
+    if (inet_pton(AF_INET, options_.address.c_str(), &address.sin_addr) !=
+        1) {
+        SPDLOG_ERROR("Invalid server address {}", options_.address);
+        return false;
+    }
+
+    epoll_ = epoll_create1(EPOLL_CLOEXEC);
+    wakeup_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epoll_ < 0 || wakeup_ < 0) {
+        SPDLOG_ERROR("Cannot create epoll instance: {}", strerror(errno));
+        return false;
+    }
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.u64 = WAKEUP_TAG;
+    epoll_ctl(epoll_, EPOLL_CTL_ADD, wakeup_, &event);
+
+    if (options_.tcp && !OpenTcp(address)) {
+        return false;
+    }
+    if (options_.udp && !OpenUdp(address)) {
+        return false;
+    }
+    return true;
 }
 
-std::basic_istream<char>& GPSocketServer::Read(char* buffer,
-                                               std::streamsize count)
+bool GPSocketServer::OpenTcp(const struct sockaddr_in& address)
 {
-    return inputfile_->read(buffer, count);
-}
+    listener_ =
+        socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listener_ < 0) {
+        SPDLOG_ERROR("Cannot create TCP socket: {}", strerror(errno));
+        return false;
+    }
+    int reuse = 1;
+    setsockopt(listener_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    // Inherited by the accepted sockets, before the window scale is agreed
+    setsockopt(listener_, SOL_SOCKET, SO_RCVBUF, &options_.socket_buffer_size,
+               sizeof(options_.socket_buffer_size));
+    if (bind(listener_, reinterpret_cast<const struct sockaddr*>(&address),
+             sizeof(address)) < 0 ||
+        listen(listener_, LISTEN_BACKLOG) < 0) {
+        SPDLOG_ERROR("Cannot listen on TCP {}:{}: {}", options_.address,
+                     options_.port, strerror(errno));
+        return false;
+    }
 
-using asio::ip::tcp;
-using asio::ip::udp;
+    struct epoll_event event = {};
+    event.events = EPOLLIN | EPOLLET;
+    event.data.u64 = LISTENER_TAG;
+    epoll_ctl(epoll_, EPOLL_CTL_ADD, listener_, &event);
+    return true;
+}
 
-std::string make_daytime_string()
+bool GPSocketServer::OpenUdp(const struct sockaddr_in& address)
 {
-    using namespace std;  // For time_t, time and ctime;
-    time_t now = time(0);
-    return ctime(&now);
+    udp_ = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (udp_ < 0) {
+        SPDLOG_ERROR("Cannot create UDP socket: {}", strerror(errno));
+        return false;
+    }
+
+    // Shared by all the UDP pushers
+    SetReceiveBufferSize(udp_, options_.socket_buffer_size, "UDP");
+
+    if (options_.gro) {
+        int enable = 1;
+        if (setsockopt(udp_, SOL_UDP, UDP_GRO, &enable, sizeof(enable)) == 0) {
+            datagram_size_ = MAX_GRO_SIZE;
+        }
+        else {
+            SPDLOG_WARN("UDP GRO is not available: {}", strerror(errno));
+        }
+    }
+
+    if (bind(udp_, reinterpret_cast<const struct sockaddr*>(&address),
+             sizeof(address)) < 0) {
+        SPDLOG_ERROR("Cannot bind UDP socket to {}:{}: {}", options_.address,
+                     options_.port, strerror(errno));
+        return false;
+    }
+
+    struct epoll_event event = {};
+    event.events = EPOLLIN | EPOLLET;
+    event.data.u64 = UDP_TAG;
+    epoll_ctl(epoll_, EPOLL_CTL_ADD, udp_, &event);
+    return true;
 }
 
-class tcp_connection : public std::enable_shared_from_this<tcp_connection> {
-public:
-    typedef std::shared_ptr<tcp_connection> pointer;
+int GPSocketServer::Proc()
+{
+    ApplyThreadPolicy("GPSocketServer");
 
-    static pointer create(asio::io_context& io_context)
-    {
-        return pointer(new tcp_connection(io_context));
+    if (epoll_ < 0) {
+        return -1;
     }
 
-    tcp::socket& socket() { return socket_; }
+    struct epoll_event events[64];
+    std::vector<uint64_t> closed;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stop_) {
+        bool stalled = std::any_of(
+            streams_.begin(), streams_.end(),
+            [](const auto& entry) { return entry.second->stalled; });
+
+        lock.unlock();
+        int count = epoll_wait(epoll_, events, 64,
+                               stalled ? STALLED_WAIT_MS : SERVER_WAIT_MS);
+        lock.lock();
+        if (count < 0 && errno != EINTR) {
+            SPDLOG_ERROR("Cannot wait for sockets: {}", strerror(errno));
+            return -1;
+        }
 
-    void start()
-    {
-        message_ = make_daytime_string();
+        for (int i = 0; i < count; i++) {
+            uint64_t tag = events[i].data.u64;
+            if (tag == LISTENER_TAG) {
+                Accept(lock);
+            }
+            else if (tag == UDP_TAG) {
+                ReceiveUdp(lock);
+            }
+            else if (tag != WAKEUP_TAG) {
+                auto it = streams_.find(tag);
+                if (it == streams_.end()) {
+                    continue;
+                }
+                if (events[i].events & (EPOLLRDHUP | EPOLLHUP)) {
+                    it->second->hung_up = true;
+                }
+                if (!ReceiveTcp(*it->second)) {
+                    closed.push_back(tag);
+                }
+            }
+        }
 
-        asio::async_write(
-            socket_, asio::buffer(message_),
-            std::bind(&tcp_connection::handle_write, shared_from_this()));
+        for (auto& [id, stream] : streams_) {
+            if (stream->stalled) {
+                stream->stalled = false;
+                if (!ReceiveTcp(*stream)) {
+                    closed.push_back(id);
+                }
+            }
+        }
+        for (uint64_t id : closed) {
+            CloseStream(id, lock);
+        }
+        closed.clear();
+        CloseIdleStreams(lock);
     }
 
-private:
-    tcp_connection(asio::io_context& io_context) : socket_(io_context) {}
+    std::vector<uint64_t> ids;
+    for (auto& [id, stream] : streams_) {
+        ids.push_back(id);
+    }
+    for (uint64_t id : ids) {
+        CloseStream(id, lock);
+    }
+    return 0;
+}
 
-    void handle_write() {}
+void GPSocketServer::Stop()
+{
+    stop_ = true;
+    uint64_t value = 1;
+    if (wakeup_ >= 0 && write(wakeup_, &value, sizeof(value)) < 0) {
+        SPDLOG_TRACE("Cannot wake up {}", GetInfo());
+    }
+}
 
-    tcp::socket socket_;
-    std::string message_;
-};
+void GPSocketServer::Accept(std::unique_lock<std::mutex>& lock)
+{
+    // Edge-triggered: every pending connection is taken now
+    for (;;) {
+        struct sockaddr_in peer = {};
+        socklen_t length = sizeof(peer);
+        int fd = accept4(listener_, reinterpret_cast<struct sockaddr*>(&peer),
+                         &length, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                SPDLOG_ERROR("Cannot accept TCP connection: {}",
+                             strerror(errno));
+            }
+            return;
+        }
 
-class tcp_server {
-public:
-    tcp_server(asio::io_context& io_context, int port)
-        : io_context_(io_context),
-          acceptor_(io_context, tcp::endpoint(tcp::v4(), port))
-    {
-        start_accept();
+        Stream* stream = AddStream(GPIngestProtocol::Tcp, peer, lock);
+        if (!stream) {
+            close(fd);
+            continue;
+        }
+        stream->socket = fd;
+
+        struct epoll_event event = {};
+        event.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+        event.data.u64 = stream->stats.stream.id;
+        epoll_ctl(epoll_, EPOLL_CTL_ADD, fd, &event);
+        // Data sent before the socket was added raises no edge
+        stream->stalled = true;
     }
+}
+
+bool GPSocketServer::ReceiveTcp(Stream& stream)
+{
+    bool framed = options_.framing == GPStreamFraming::Length;
+    // Edge-triggered: read until the socket is drained
+    for (;;) {
+        if (framed && stream.frame_left == 0) {
+            ssize_t received = stream.prefix.Receive(stream.socket);
+            if (received == 0) {
+                return false;
+            }
+            if (received < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    return true;
+                }
+                SPDLOG_WARN("Cannot receive from {}: {}",
+                            stream.stats.stream.peer, strerror(errno));
+                return false;
+            }
+            stream.stats.bytes += received;
+            stats_.bytes += received;
+            if (!stream.prefix.IsComplete()) {
+                return true;
+            }
+            if (!stream.prefix.Take(options_.max_frame_size,
+                                    stream.stats.stream.peer,
+                                    &stream.frame_left)) {
+                return false;
+            }
+            continue;
+        }
 
-private:
-    void start_accept()
-    {
-        tcp_connection::pointer new_connection =
-            tcp_connection::create(io_context_);
+        size_t length;
+        uint8_t* data = stream.decoder->Reserve(&length);
+        if (length == 0) {
+            // TCP flow control holds the pusher back meanwhile
+            stream.stalled = true;
+            return true;
+        }
+        if (framed) {
+            length = std::min(length, stream.frame_left);
+        }
 
-        acceptor_.async_accept(
-            new_connection->socket(),
-            std::bind(&tcp_server::handle_accept, this, new_connection,
-                      std::placeholders::_1));
+        ssize_t received = recv(stream.socket, data, length, 0);
+        if (received == 0) {
+            return false;
+        }
+        if (received < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return true;
+            }
+            SPDLOG_WARN("Cannot receive from {}: {}", stream.stats.stream.peer,
+                        strerror(errno));
+            return false;
+        }
+
+        stream.decoder->Commit(received);
+        stream.stats.bytes += received;
+        stats_.bytes += received;
+        if (framed) {
+            stream.frame_left -= received;
+            if (stream.frame_left == 0) {
+                stream.stats.frames++;
+            }
+        }
+        // A short read drained the socket; more data raises a new edge
+        if (size_t(received) < length && !stream.hung_up) {
+            return true;
+        }
     }
+}
+
+void GPSocketServer::ReceiveUdp(std::unique_lock<std::mutex>& lock)
+{
+    size_t batch = datagrams_.size();
+    // Edge-triggered: read until the socket is drained
+    for (;;) {
+        for (size_t i = 0; i < batch; i++) {
+            iovecs_[i].iov_base = datagrams_[i].data();
+            iovecs_[i].iov_len = datagrams_[i].size();
+            messages_[i].msg_hdr = {};
+            messages_[i].msg_hdr.msg_name = &sources_[i];
+            messages_[i].msg_hdr.msg_namelen = sizeof(sources_[i]);
+            messages_[i].msg_hdr.msg_iov = &iovecs_[i];
+            messages_[i].msg_hdr.msg_iovlen = 1;
+            messages_[i].msg_hdr.msg_control = controls_[i].data();
+            messages_[i].msg_hdr.msg_controllen = controls_[i].size();
+        }
 
-    void handle_accept(tcp_connection::pointer new_connection,
-                       const asio::error_code& error)
-    {
-        if (!error) {
-            new_connection->start();
+        int count =
+            recvmmsg(udp_, messages_.data(), batch, MSG_DONTWAIT, nullptr);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                SPDLOG_ERROR("Cannot receive UDP datagrams: {}",
+                             strerror(errno));
+            }
+            return;
         }
 
-        // new_connection->async_read_some();
+        for (int i = 0; i < count; i++) {
+            struct msghdr& header = messages_[i].msg_hdr;
+            size_t length = messages_[i].msg_len;
+            stats_.udp_datagrams++;
+            if (header.msg_flags & MSG_TRUNC) {
+                stats_.udp_dropped++;
+                continue;
+            }
 
-        start_accept();
+            // A GRO buffer holds datagrams of segment bytes back to back,
+            // the last one possibly shorter
+            size_t segment = length;
+            for (struct cmsghdr* control = CMSG_FIRSTHDR(&header);
+                 control != nullptr;
+                 control = CMSG_NXTHDR(&header, control)) {
+                if (control->cmsg_level == SOL_UDP &&
+                    control->cmsg_type == UDP_GRO) {
+                    int size;
+                    memcpy(&size, CMSG_DATA(control), sizeof(size));
+                    segment = std::max(size, 1);
+                }
+            }
+            for (size_t offset = 0; offset < length; offset += segment) {
+                PushDatagram(sources_[i], datagrams_[i].data() + offset,
+                             std::min(segment, length - offset), lock);
+            }
+        }
+
+        if (size_t(count) < batch) {
+            return;
+        }
     }
+}
 
-    asio::io_context& io_context_;
-    tcp::acceptor acceptor_;
-};
+void GPSocketServer::PushDatagram(const struct sockaddr_in& source,
+                                  const uint8_t* data,
+                                  size_t length,
+                                  std::unique_lock<std::mutex>& lock)
+{
+    stats_.udp_segments++;
+    uint64_t key = (uint64_t(ntohl(source.sin_addr.s_addr)) << 16) |
+                   ntohs(source.sin_port);
+
+    Stream* stream;
+    auto it = udp_sources_.find(key);
+    if (it != udp_sources_.end()) {
+        stream = streams_[it->second].get();
+    }
+    else {
+        // Every datagram of a source turned away would ask the factory
+        // again; it is dropped until the rejection expires
+        auto rejected = rejected_sources_.find(key);
+        if (rejected != rejected_sources_.end()) {
+            if (std::chrono::steady_clock::now() - rejected->second <
+                options_.udp_reject_timeout) {
+                stats_.udp_dropped++;
+                return;
+            }
+            rejected_sources_.erase(rejected);
+        }
 
-class udp_server {
-public:
-    udp_server(asio::io_context& io_context, int port)
-        : socket_(io_context, udp::endpoint(udp::v4(), port))
-    {
-        start_receive();
+        stream = AddStream(GPIngestProtocol::Udp, source, lock);
+        if (!stream) {
+            rejected_sources_[key] = std::chrono::steady_clock::now();
+            stats_.udp_dropped++;
+            return;
+        }
+        stream->source = key;
+        stream->depacketizer = std::make_unique<GPRtpDepacketizer>(
+            options_.codec, options_.reorder_depth);
+        udp_sources_[key] = stream->stats.stream.id;
     }
 
-private:
-    void start_receive()
-    {
-        socket_.async_receive_from(asio::buffer(recv_buffer_), remote_endpoint_,
-                                   std::bind(&udp_server::handle_receive, this,
-                                             std::placeholders::_1));
+    stream->last_datagram = std::chrono::steady_clock::now();
+    stream->stats.bytes += length;
+    stats_.bytes += length;
+
+    GPNvVideoDecoder* decoder = stream->decoder.get();
+    GPIngestStreamStats& stats = stream->stats;
+    stream->depacketizer->Push(
+        data, length,
+        [decoder, &stats](const uint8_t* data, size_t length, int64_t pts,
+                          bool keyframe) {
+            GPBuffer buffer(const_cast<uint8_t*>(data), length);
+            buffer.SetPts(pts);
+            GPData frame(&buffer);
+            decoder->Process(&frame);
+            stats.frames++;
+        });
+    stats.lost = stream->depacketizer->GetStats().lost;
+}
+
+GPSocketServer::Stream* GPSocketServer::AddStream(
+    GPIngestProtocol protocol,
+    const struct sockaddr_in& peer,
+    std::unique_lock<std::mutex>& lock)
+{
+    GPIngestStream info = {next_id_++, protocol, ToString(peer)};
+    const char* name = protocol == GPIngestProtocol::Tcp ? "TCP" : "UDP";
+    if (streams_.size() >= options_.max_streams) {
+        SPDLOG_WARN("Turn away {} pusher {}: {} streams already", name,
+                    info.peer, streams_.size());
+        stats_.rejected++;
+        return nullptr;
     }
 
-    void handle_receive(const asio::error_code& error)
-    {
-        if (!error) {
-            std::shared_ptr<std::string> message(
-                new std::string(make_daytime_string()));
+    std::shared_ptr<GPNvVideoDecoder> decoder;
+    if (factory_) {
+        lock.unlock();
+        decoder = factory_(info);
+        lock.lock();
+    }
+    if (!decoder) {
+        SPDLOG_WARN("Turn away {} pusher {}: no branch for it", name,
+                    info.peer);
+        stats_.rejected++;
+        return nullptr;
+    }
 
-            socket_.async_send_to(
-                asio::buffer(*message), remote_endpoint_,
-                std::bind(&udp_server::handle_send, this, message));
+    auto stream = std::make_unique<Stream>();
+    stream->stats.stream = info;
+    stream->decoder = decoder;
+    Stream* added = stream.get();
+    streams_[info.id] = std::move(stream);
+    if (protocol == GPIngestProtocol::Tcp) {
+        stats_.tcp_streams++;
+    }
+    else {
+        stats_.udp_streams++;
+    }
+    stats_.active_streams = streams_.size();
+    SPDLOG_INFO("{} stream {} from {}", name, info.id, info.peer);
+    return added;
+}
 
-            start_receive();
-        }
+void GPSocketServer::CloseStream(uint64_t id,
+                                 std::unique_lock<std::mutex>& lock)
+{
+    auto it = streams_.find(id);
+    if (it == streams_.end()) {
+        return;
     }
+    std::unique_ptr<Stream> stream = std::move(it->second);
+    streams_.erase(it);
+    stats_.active_streams = streams_.size();
 
-    void handle_send(std::shared_ptr<std::string> /*message*/) {}
+    if (stream->socket >= 0) {
+        // Closing the socket takes it out of the epoll set as well
+        close(stream->socket);
+    }
+    if (stream->depacketizer) {
+        udp_sources_.erase(stream->source);
+        GPNvVideoDecoder* decoder = stream->decoder.get();
+        stream->depacketizer->Flush(
+            [decoder](const uint8_t* data, size_t length, int64_t pts,
+                      bool keyframe) {
+                GPBuffer buffer(const_cast<uint8_t*>(data), length);
+                buffer.SetPts(pts);
+                GPData frame(&buffer);
+                decoder->Process(&frame);
+            });
+    }
+    SPDLOG_INFO("Stream {} from {} ended after {} bytes", id,
+                stream->stats.stream.peer, stream->stats.bytes);
 
-    udp::socket socket_;
-    udp::endpoint remote_endpoint_;
-    std::array<char, 1> recv_buffer_;
-};
+    if (closed_callback_) {
+        lock.unlock();
+        closed_callback_(stream->stats);
+        lock.lock();
+    }
+}
 
-int GPSocketServer::Proc()
+void GPSocketServer::CloseIdleStreams(std::unique_lock<std::mutex>& lock)
 {
-    try {
-        asio::io_context io_context;
-        tcp_server server1(io_context, port_);
-        udp_server server2(io_context, port_);
-        io_context.run();
+    auto now = std::chrono::steady_clock::now();
+    if (now - last_sweep_ < std::chrono::milliseconds(SERVER_WAIT_MS)) {
+        return;
     }
-    catch (std::exception& e) {
-        std::cerr << e.what() << std::endl;
+    last_sweep_ = now;
+
+    std::vector<uint64_t> idle;
+    for (auto& [id, stream] : streams_) {
+        if (stream->depacketizer &&
+            now - stream->last_datagram >= options_.udp_timeout) {
+            idle.push_back(id);
+        }
+    }
+    for (uint64_t id : idle) {
+        CloseStream(id, lock);
     }
 
-    return 0;
+    for (auto it = rejected_sources_.begin(); it != rejected_sources_.end();) {
+        if (now - it->second >= options_.udp_reject_timeout) {
+            it = rejected_sources_.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
 }
 
-}  // namespace GPlayer
+void GPSocketServer::SetBranchFactory(const BranchFactory& factory)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    factory_ = factory;
+}
 
-#include "asio/coroutine.hpp"
-#include "asio/yield.hpp"
+void GPSocketServer::SetStreamClosedCallback(
+    const StreamClosedCallback& callback)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_callback_ = callback;
+}
 
-struct session : asio::coroutine {
-    std::shared_ptr<asio::ip::tcp::socket> socket_;
-    std::shared_ptr<std::vector<char> > buffer_;
+GPSocketServerStats GPSocketServer::GetStats()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
 
-    session(std::shared_ptr<asio::ip::tcp::socket> socket)
-        : socket_(socket), buffer_(new std::vector<char>(1024))
-    {
+std::vector<GPIngestStreamStats> GPSocketServer::GetStreams()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<GPIngestStreamStats> streams;
+    for (auto& [id, stream] : streams_) {
+        streams.push_back(stream->stats);
     }
+    return streams;
+}
 
-    void operator()(asio::error_code ec = asio::error_code(), std::size_t n = 0)
-    {
-        if (!ec)
-            reenter(this)
-            {
-                for (;;) {
-                    yield socket_->async_read_some(asio::buffer(*buffer_),
-                                                   *this);
-                    yield asio::async_write(*socket_, asio::buffer(*buffer_, n),
-                                            *this);
-                }
-            }
-    }
-};
\ No newline at end of file
+}  // namespace GPlayer
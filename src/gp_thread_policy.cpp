@@ -0,0 +1,192 @@
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+
+#include "gp_log.h"
+#include "gp_thread_policy.h"
+
+namespace GPlayer {
+
+// Longest thread name the kernel keeps, without the terminating null
+#define THREAD_NAME_MAX 15
+
+static const char* GetSchedPolicyName(GPSchedPolicy scheduling)
+{
+    switch (scheduling) {
+        case GPSchedPolicy::Fifo:
+            return "fifo";
+        case GPSchedPolicy::RoundRobin:
+            return "rr";
+        default:
+            return "other";
+    }
+}
+
+static std::string JoinCores(const std::vector<int>& cores)
+{
+    std::string text;
+    for (int core : cores) {
+        if (!text.empty()) {
+            text += ",";
+        }
+        text += std::to_string(core);
+    }
+    return text;
+}
+
+bool GPThreadPolicy::FromJson(const nlohmann::json& json,
+                              GPThreadPolicy& policy)
+{
+    try {
+        if (json.contains("name")) {
+            policy.name = json["name"].get<std::string>();
+        }
+
+        if (json.contains("cores")) {
+            policy.cores = json["cores"].get<std::vector<int>>();
+        }
+
+        if (json.contains("scheduling")) {
+            std::string scheduling = json["scheduling"].get<std::string>();
+            if (scheduling == "fifo") {
+                policy.scheduling = GPSchedPolicy::Fifo;
+            }
+            else if (scheduling == "rr") {
+                policy.scheduling = GPSchedPolicy::RoundRobin;
+            }
+            else if (scheduling == "other") {
+                policy.scheduling = GPSchedPolicy::Other;
+            }
+            else {
+                SPDLOG_ERROR("Unknown scheduling policy '{}'", scheduling);
+                return false;
+            }
+        }
+
+        if (json.contains("priority")) {
+            policy.priority = json["priority"].get<int>();
+        }
+
+        if (json.contains("nice")) {
+            policy.nice = json["nice"].get<int>();
+        }
+    }
+    catch (nlohmann::json::exception& e) {
+        SPDLOG_ERROR("Invalid thread policy {}: {}", json.dump(), e.what());
+        return false;
+    }
+
+    if (policy.scheduling != GPSchedPolicy::Other &&
+        (policy.priority < 1 || policy.priority > 99)) {
+        SPDLOG_ERROR("Real-time priority {} is not within 1 to 99",
+                     policy.priority);
+        return false;
+    }
+    if (policy.nice < -20 || policy.nice > 19) {
+        SPDLOG_ERROR("Nice level {} is not within -20 to 19", policy.nice);
+        return false;
+    }
+    return true;
+}
+
+GPThreadPlacement GPThreadPolicy::Apply(const std::string& default_name) const
+{
+    std::string thread_name = name.empty() ? default_name : name;
+    // Longer names make pthread_setname_np() fail
+    if (thread_name.size() > THREAD_NAME_MAX) {
+        SPDLOG_WARN("Thread name {} is cut to {} characters", thread_name,
+                    THREAD_NAME_MAX);
+        thread_name.resize(THREAD_NAME_MAX);
+    }
+    pthread_setname_np(pthread_self(), thread_name.c_str());
+
+    if (!cores.empty()) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int core : cores) {
+            if (core >= 0 && core < CPU_SETSIZE) {
+                CPU_SET(core, &set);
+            }
+        }
+        int error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (error != 0) {
+            SPDLOG_WARN("Thread {}: cannot run on cores {}: {}", thread_name,
+                        JoinCores(cores), strerror(error));
+        }
+    }
+
+    if (scheduling != GPSchedPolicy::Other) {
+        struct sched_param param = {0};
+        param.sched_priority = priority;
+        int error = pthread_setschedparam(
+            pthread_self(),
+            scheduling == GPSchedPolicy::Fifo ? SCHED_FIFO : SCHED_RR, &param);
+        if (error != 0) {
+            SPDLOG_WARN("Thread {}: cannot use {} priority {}: {}",
+                        thread_name, GetSchedPolicyName(scheduling), priority,
+                        strerror(error));
+        }
+    }
+    else if (nice != 0) {
+        // On Linux the nice level belongs to the thread, not the process
+        pid_t tid = syscall(SYS_gettid);
+        if (setpriority(PRIO_PROCESS, tid, nice) < 0) {
+            SPDLOG_WARN("Thread {}: cannot set nice level {}: {}",
+                        thread_name, nice, strerror(errno));
+        }
+    }
+
+    return GPThreadPlacement::GetCurrent(thread_name);
+}
+
+GPThreadPlacement GPThreadPlacement::GetCurrent(const std::string& name)
+{
+    GPThreadPlacement placement;
+    placement.name = name;
+    placement.tid = syscall(SYS_gettid);
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (pthread_getaffinity_np(pthread_self(), sizeof(set), &set) == 0) {
+        for (int core = 0; core < CPU_SETSIZE; core++) {
+            if (CPU_ISSET(core, &set)) {
+                placement.cores.push_back(core);
+            }
+        }
+    }
+
+    int policy = SCHED_OTHER;
+    struct sched_param param = {0};
+    if (pthread_getschedparam(pthread_self(), &policy, &param) == 0) {
+        if (policy == SCHED_FIFO) {
+            placement.scheduling = GPSchedPolicy::Fifo;
+        }
+        else if (policy == SCHED_RR) {
+            placement.scheduling = GPSchedPolicy::RoundRobin;
+        }
+        placement.priority = param.sched_priority;
+    }
+
+    placement.nice = getpriority(PRIO_PROCESS, placement.tid);
+    return placement;
+}
+
+std::string GPThreadPlacement::ToString() const
+{
+    std::string text = beader.empty() ? name : beader + "/" + name;
+    text += " tid " + std::to_string(tid) + " cores " + JoinCores(cores) +
+            " " + GetSchedPolicyName(scheduling);
+    if (scheduling != GPSchedPolicy::Other) {
+        text += " priority " + std::to_string(priority);
+    }
+    else {
+        text += " nice " + std::to_string(nice);
+    }
+    return text;
+}
+
+}  // namespace GPlayer
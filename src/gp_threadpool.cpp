@@ -1,58 +1,377 @@
-
+#include <pthread.h>
+#include <time.h>
+#include <algorithm>
+#include <string>
 
 #include "gp_threadpool.h"
 
 namespace GPlayer {
 
-GPThreadPool::GPThreadPool()
-    : function_queue_(), accept_functions_(true), lock_(), thread_condition_()
+// The pool and worker index of the calling thread, if it is a worker
+static thread_local GPThreadPool* current_pool = nullptr;
+static thread_local size_t current_worker = 0;
+
+// A waiting Interactive task may go ahead of Realtime work after this long,
+// a Background task ahead of both
+static constexpr std::chrono::microseconds DEFAULT_STARVATION_LIMITS[] = {
+    std::chrono::microseconds::max(),
+    std::chrono::milliseconds(20),
+    std::chrono::milliseconds(100),
+};
+
+// A worker lets a starved task go first once in this many tasks it takes,
+// so a starved backlog drains alongside higher classes instead of ahead of
+// them
+#define STARVED_TASK_INTERVAL 8
+
+// Queue times are read from the coarse monotonic clock, which costs a few
+// nanoseconds against tens for steady_clock, at the resolution of a
+// scheduler tick. The starvation limits are far longer than a tick, and the
+// error of a delay averages out over many tasks. Both clocks are
+// CLOCK_MONOTONIC underneath, so the time points compare.
+static std::chrono::steady_clock::time_point CoarseNow()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+    return std::chrono::steady_clock::time_point(
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::seconds(now.tv_sec) +
+            std::chrono::nanoseconds(now.tv_nsec)));
+}
+
+GPThreadPool::GPThreadPool(size_t num_threads)
 {
-    int num_threads = std::thread::hardware_concurrency();
-    for (int i = 0; i < num_threads; i++) {
-        threads_.emplace_back(
-            std::thread(&GPThreadPool::InfiniteLoopFunc, this));
+    if (num_threads == 0) {
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (size_t i = 0; i < kTaskPriorityCount; i++) {
+        class_pending_[i] = 0;
+        starvation_limits_[i] = DEFAULT_STARVATION_LIMITS[i].count();
     }
+    for (size_t i = 0; i < num_threads; i++) {
+        workers_.emplace_back(std::make_unique<Worker>());
+    }
+    // Start only once every deque exists, workers steal from each other
+    for (size_t i = 0; i < num_threads; i++) {
+        workers_[i]->thread = std::thread(&GPThreadPool::WorkerProc, this, i);
+    }
+}
+
+GPThreadPool::~GPThreadPool()
+{
+    Done();
 }
 
-GPThreadPool::~GPThreadPool() {}
+GPThreadPool& GPThreadPool::GetInstance()
+{
+    static GPThreadPool pool;
+    return pool;
+}
 
-void GPThreadPool::Post(std::function<void()>& func)
+void GPThreadPool::Post(GPTask task, const GPTaskOptions& options)
 {
+    // Tasks still running during shutdown may post follow-up work; it goes
+    // to their own worker, which runs it before exiting
+    if (!task || (!accept_tasks_ && current_pool != this)) {
+        return;
+    }
+
+    size_t priority = static_cast<size_t>(options.priority);
+    size_t index = current_pool == this
+                       ? current_worker
+                       : next_worker_++ % workers_.size();
+    // Counted first, a worker may take the task right after the push
+    class_pending_[priority]++;
     {
-        std::unique_lock<std::mutex> lock(lock_);
-        function_queue_.push(func);
+        std::lock_guard<std::mutex> guard(workers_[index]->mutex);
+        workers_[index]->tasks[priority].push_back(
+            {std::move(task), CoarseNow(), options.deadline});
     }
 
-    thread_condition_.notify_one();
+    // A worker counts itself as sleeping before it checks for pending
+    // tasks, so either it sees the task or the task sees it
+    if (sleepers_ > 0) {
+        {
+            std::lock_guard<std::mutex> guard(sleep_mutex_);
+        }
+        sleep_condition_.notify_one();
+    }
 }
 
 void GPThreadPool::Done()
 {
-    {
-        std::unique_lock<std::mutex> lock(lock_);
-        accept_functions_ = false;
+    std::call_once(join_once_, [this]() {
+        {
+            std::lock_guard<std::mutex> guard(sleep_mutex_);
+            accept_tasks_ = false;
+        }
+        sleep_condition_.notify_all();
+
+        for (auto& worker : workers_) {
+            worker->thread.join();
+        }
+    });
+}
+
+// The chunks of one ParallelFor(). Helper tasks share ownership: one that
+// starts after the caller returned finds no chunks left and just exits.
+struct RangeJob {
+    void* body;
+    void (*invoke)(void* body, size_t first, size_t last);
+    size_t begin;
+    size_t end;
+    size_t grain;
+    size_t chunks;
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> done{0};
+    std::mutex mutex;
+    std::condition_variable finished;
+};
+
+static void RunChunks(RangeJob& job)
+{
+    size_t ran = 0;
+    for (;;) {
+        size_t chunk = job.next++;
+        if (chunk >= job.chunks) {
+            break;
+        }
+        size_t first = job.begin + chunk * job.grain;
+        job.invoke(job.body, first, std::min(job.end, first + job.grain));
+        ran++;
     }
 
-    thread_condition_.notify_all();
+    if (ran > 0 && job.done.fetch_add(ran) + ran == job.chunks) {
+        std::lock_guard<std::mutex> guard(job.mutex);
+        job.finished.notify_all();
+    }
 }
 
-void GPThreadPool::InfiniteLoopFunc()
+void GPThreadPool::ParallelRange(size_t begin,
+                                 size_t end,
+                                 size_t grain,
+                                 void* body,
+                                 void (*invoke)(void*, size_t, size_t))
 {
-    std::function<void()> func;
-    while (true) {
-        {
-            std::unique_lock<std::mutex> lock(lock_);
-            thread_condition_.wait(lock, [this]() {
-                return !function_queue_.empty() || !accept_functions_;
-            });
-            if (!accept_functions_ && function_queue_.empty()) {
-                return;
+    if (begin >= end) {
+        return;
+    }
+
+    size_t count = end - begin;
+    if (grain == 0) {
+        // A few chunks per thread evens out uneven rows without making the
+        // chunks so small that neighbours share cache lines
+        size_t chunks = (workers_.size() + 1) * 4;
+        grain = (count + chunks - 1) / chunks;
+    }
+    size_t chunks = (count + grain - 1) / grain;
+    if (chunks <= 1) {
+        invoke(body, begin, end);
+        return;
+    }
+
+    auto job = std::make_shared<RangeJob>();
+    job->body = body;
+    job->invoke = invoke;
+    job->begin = begin;
+    job->end = end;
+    job->grain = grain;
+    job->chunks = chunks;
+
+    // The caller is blocked on the frame, so are the helpers
+    size_t helpers = std::min(chunks - 1, workers_.size());
+    for (size_t i = 0; i < helpers; i++) {
+        Post([job]() { RunChunks(*job); }, GPTaskPriority::Realtime);
+    }
+    RunChunks(*job);
+
+    std::unique_lock<std::mutex> lock(job->mutex);
+    job->finished.wait(lock, [&job]() { return job->done == job->chunks; });
+}
+
+void GPThreadPool::SetStarvationLimit(GPTaskPriority priority,
+                                      std::chrono::microseconds limit)
+{
+    starvation_limits_[static_cast<size_t>(priority)] = limit.count();
+}
+
+GPThreadPoolStats GPThreadPool::GetStats(GPTaskPriority priority) const
+{
+    GPThreadPoolStats stats;
+    for (auto& worker : workers_) {
+        const Counters& counters =
+            worker->counters[static_cast<size_t>(priority)];
+        stats.tasks += counters.tasks;
+        stats.expired += counters.expired;
+        stats.total_delay += std::chrono::microseconds(counters.total_delay);
+        stats.max_delay = std::max(
+            stats.max_delay, std::chrono::microseconds(counters.max_delay));
+    }
+    return stats;
+}
+
+// The highest class with work, own tasks before stolen ones; every
+// STARVED_TASK_INTERVAL-th take a starved task instead, lowest class first
+// since it waited the longest allowance
+bool GPThreadPool::Take(size_t index, Entry& entry, size_t& priority)
+{
+    Worker& worker = *workers_[index];
+    if (worker.takes_since_starved + 1 >= STARVED_TASK_INTERVAL) {
+        auto now = CoarseNow();
+        for (size_t i = kTaskPriorityCount; i-- > 1;) {
+            if (class_pending_[i] > 0 && TakeStarved(index, i, now, entry)) {
+                worker.takes_since_starved = 0;
+                priority = i;
+                return true;
             }
-            func = function_queue_.front();
-            function_queue_.pop();
         }
-        func();
     }
+    for (size_t i = 0; i < kTaskPriorityCount; i++) {
+        if (class_pending_[i] > 0 &&
+            (Pop(index, i, entry) || Steal(index, i, entry))) {
+            worker.takes_since_starved++;
+            priority = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool GPThreadPool::TakeStarved(size_t index,
+                               size_t priority,
+                               std::chrono::steady_clock::time_point now,
+                               Entry& entry)
+{
+    auto limit = std::chrono::microseconds(starvation_limits_[priority]);
+    if (limit == std::chrono::microseconds::max()) {
+        return false;
+    }
+
+    for (size_t i = 0; i < workers_.size(); i++) {
+        Worker& worker = *workers_[(index + i) % workers_.size()];
+        std::unique_lock<std::mutex> lock(worker.mutex, std::try_to_lock);
+        if (!lock.owns_lock() || worker.tasks[priority].empty()) {
+            continue;
+        }
+        // The front is the oldest task of the deque
+        if (now - worker.tasks[priority].front().queued < limit) {
+            continue;
+        }
+        entry = std::move(worker.tasks[priority].front());
+        worker.tasks[priority].pop_front();
+        return true;
+    }
+    return false;
+}
+
+// Own tasks are taken newest first, while they are still in the cache
+bool GPThreadPool::Pop(size_t index, size_t priority, Entry& entry)
+{
+    Worker& worker = *workers_[index];
+    std::lock_guard<std::mutex> guard(worker.mutex);
+    if (worker.tasks[priority].empty()) {
+        return false;
+    }
+    entry = std::move(worker.tasks[priority].back());
+    worker.tasks[priority].pop_back();
+    return true;
+}
+
+// Other workers' tasks are taken oldest first
+bool GPThreadPool::Steal(size_t index, size_t priority, Entry& entry)
+{
+    for (size_t i = 1; i < workers_.size(); i++) {
+        Worker& victim = *workers_[(index + i) % workers_.size()];
+        std::unique_lock<std::mutex> lock(victim.mutex, std::try_to_lock);
+        if (!lock.owns_lock() || victim.tasks[priority].empty()) {
+            continue;
+        }
+        entry = std::move(victim.tasks[priority].front());
+        victim.tasks[priority].pop_front();
+        return true;
+    }
+    return false;
+}
+
+// Adds to a counter that only the calling worker writes
+template <typename T>
+static void AddOwned(std::atomic<T>& counter, T value)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + value,
+                  std::memory_order_relaxed);
+}
+
+void GPThreadPool::Run(Counters& counters, Entry& entry)
+{
+    auto now = CoarseNow();
+    // The coarse clock lags by up to a tick; a deadline is held to the
+    // precise one
+    if (entry.deadline != std::chrono::steady_clock::time_point::max() &&
+        std::chrono::steady_clock::now() > entry.deadline) {
+        // Destroying a packaged_task breaks its promise
+        AddOwned<uint64_t>(counters.expired, 1);
+        entry.task = GPTask();
+        return;
+    }
+
+    int64_t delay = std::chrono::duration_cast<std::chrono::microseconds>(
+                        now - entry.queued)
+                        .count();
+    AddOwned<uint64_t>(counters.tasks, 1);
+    AddOwned(counters.total_delay, delay);
+    if (delay > counters.max_delay.load(std::memory_order_relaxed)) {
+        counters.max_delay.store(delay, std::memory_order_relaxed);
+    }
+
+    entry.task();
+    entry.task = GPTask();
+}
+
+bool GPThreadPool::HasPending() const
+{
+    for (size_t i = 0; i < kTaskPriorityCount; i++) {
+        if (class_pending_[i] > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void GPThreadPool::WorkerProc(size_t index)
+{
+    std::string name = "GPThreadPool" + std::to_string(index);
+    pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+
+    current_pool = this;
+    current_worker = index;
+
+    for (;;) {
+        Entry entry;
+        size_t priority;
+        if (Take(index, entry, priority)) {
+            class_pending_[priority]--;
+            Run(workers_[index]->counters[priority], entry);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleep_mutex_);
+        if (HasPending()) {
+            // A task is being pushed or a steal lost a try_lock race
+            lock.unlock();
+            std::this_thread::yield();
+            continue;
+        }
+        if (!accept_tasks_) {
+            break;
+        }
+        sleepers_++;
+        sleep_condition_.wait(
+            lock, [this]() { return HasPending() || !accept_tasks_; });
+        sleepers_--;
+    }
+
+    current_pool = nullptr;
 }
 
-}  // namespace GPlayer
\ No newline at end of file
+}  // namespace GPlayer
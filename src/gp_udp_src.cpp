@@ -0,0 +1,228 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+
+#include "gp_log.h"
+#include "gp_nvvideo_decoder.h"
+#include "gp_socket.h"
+#include "gp_udp_src.h"
+
+namespace GPlayer {
+
+// Longest Proc() sleeps before it looks at the stop flag again
+#define UDP_RECEIVE_TIMEOUT_US 100000
+
+GPUdpSrc::GPUdpSrc(const GPUdpSrcOptions& options)
+    : options_(options),
+      packets_(options.batch_size),
+      messages_(options.batch_size),
+      iovecs_(options.batch_size),
+      jitter_buffer_(options.jitter),
+      depacketizer_(options.codec, 1),
+      on_packet_([this](const uint8_t* packet, size_t length) {
+          depacketizer_.Push(packet, length, on_access_unit_);
+      }),
+      on_access_unit_([this](const uint8_t* data, size_t length, int64_t pts,
+                             bool keyframe) {
+          OnAccessUnit(data, length, pts, keyframe);
+      })
+{
+    SetProperties("GPUdpSrc", "GPUdpSrc", BeaderType::UdpSrc, false);
+
+    if (!Open() && socket_ >= 0) {
+        close(socket_);
+        socket_ = -1;
+    }
+}
+
+GPUdpSrc::~GPUdpSrc()
+{
+    if (socket_ >= 0) {
+        close(socket_);
+    }
+}
+
+std::string GPUdpSrc::GetInfo() const
+{
+    return "GPUdpSrc: " + options_.address + ":" +
+           std::to_string(options_.port);
+}
+
+bool GPUdpSrc::Open()
+{
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(options_.port);
+    if (inet_pton(AF_INET, options_.address.c_str(), &address.sin_addr) !=
+        1) {
+        SPDLOG_ERROR("Invalid UDP address {}", options_.address);
+        return false;
+    }
+    bool multicast = IN_MULTICAST(ntohl(address.sin_addr.s_addr));
+
+    socket_ = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (socket_ < 0) {
+        SPDLOG_ERROR("Cannot create UDP socket: {}", strerror(errno));
+        return false;
+    }
+
+    // Covers a keyframe burst arriving while the thread passes on a frame
+    SetReceiveBufferSize(socket_, options_.socket_buffer_size, "UDP");
+
+    if (multicast) {
+        // Other receivers of the group on this host bind the same port
+        int reuse = 1;
+        setsockopt(socket_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    }
+    if (bind(socket_, reinterpret_cast<struct sockaddr*>(&address),
+             sizeof(address)) < 0) {
+        SPDLOG_ERROR("Cannot bind UDP socket to {}:{}: {}", options_.address,
+                     options_.port, strerror(errno));
+        return false;
+    }
+
+    if (multicast) {
+        struct ip_mreq request = {};
+        request.imr_multiaddr = address.sin_addr;
+        if (inet_pton(AF_INET, options_.interface.c_str(),
+                      &request.imr_interface) != 1) {
+            SPDLOG_ERROR("Invalid interface address {}", options_.interface);
+            return false;
+        }
+        if (setsockopt(socket_, IPPROTO_IP, IP_ADD_MEMBERSHIP, &request,
+                       sizeof(request)) < 0) {
+            SPDLOG_ERROR("Cannot join multicast group {} on {}: {}",
+                         options_.address, options_.interface,
+                         strerror(errno));
+            return false;
+        }
+    }
+    return true;
+}
+
+int GPUdpSrc::Proc()
+{
+    ApplyThreadPolicy("GPUdpSrc");
+
+    if (socket_ < 0) {
+        return -1;
+    }
+
+    struct pollfd poll_fd = {socket_, POLLIN, 0};
+    while (!stop_) {
+        int64_t timeout_us = UDP_RECEIVE_TIMEOUT_US;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            int64_t deadline = jitter_buffer_.GetNextDeadline();
+            if (deadline >= 0) {
+                timeout_us = std::clamp<int64_t>(deadline - Now(), 0,
+                                                 UDP_RECEIVE_TIMEOUT_US);
+            }
+        }
+
+        struct timespec timeout = {0, long(timeout_us * 1000)};
+        int ready = ppoll(&poll_fd, 1, &timeout, nullptr);
+        if (ready < 0 && errno != EINTR) {
+            SPDLOG_ERROR("Cannot poll UDP socket: {}", strerror(errno));
+            return -1;
+        }
+        if (ready > 0) {
+            Receive();
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        jitter_buffer_.Pop(Now(), on_packet_);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    jitter_buffer_.Flush(on_packet_);
+    depacketizer_.Flush(on_access_unit_);
+    return 0;
+}
+
+void GPUdpSrc::Receive()
+{
+    size_t batch = packets_.size();
+    for (size_t i = 0; i < batch; i++) {
+        // Keeps its capacity once it has been through the jitter buffer
+        packets_[i].resize(options_.max_packet_size);
+        iovecs_[i].iov_base = packets_[i].data();
+        iovecs_[i].iov_len = packets_[i].size();
+        messages_[i].msg_hdr = {};
+        messages_[i].msg_hdr.msg_iov = &iovecs_[i];
+        messages_[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    int count =
+        recvmmsg(socket_, messages_.data(), batch, MSG_DONTWAIT, nullptr);
+    if (count < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            SPDLOG_ERROR("Cannot receive UDP datagrams: {}", strerror(errno));
+        }
+        return;
+    }
+
+    int64_t now = Now();
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (int i = 0; i < count; i++) {
+        if (messages_[i].msg_hdr.msg_flags & MSG_TRUNC) {
+            SPDLOG_TRACE("Drop UDP datagram larger than {} bytes",
+                         options_.max_packet_size);
+            continue;
+        }
+        packets_[i].resize(messages_[i].msg_len);
+        jitter_buffer_.Push(packets_[i], now, on_packet_);
+    }
+}
+
+void GPUdpSrc::SetAccessUnitCallback(const AccessUnitCallback& callback)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    callback_ = callback;
+}
+
+GPJitterStats GPUdpSrc::GetJitterStats()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return jitter_buffer_.GetStats();
+}
+
+GPRtpStats GPUdpSrc::GetRtpStats()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return depacketizer_.GetStats();
+}
+
+void GPUdpSrc::OnAccessUnit(const uint8_t* data,
+                            size_t length,
+                            int64_t pts,
+                            bool keyframe)
+{
+    GPBuffer buffer(const_cast<uint8_t*>(data), length);
+    buffer.SetPts(pts);
+    if (callback_) {
+        callback_(buffer, keyframe);
+    }
+
+    GPData frame(&buffer);
+    for (auto& beader : GetChildren(BeaderType::NvVideoDecoder)) {
+        auto decoder = std::dynamic_pointer_cast<GPNvVideoDecoder>(beader);
+        if (decoder) {
+            decoder->Process(&frame);
+        }
+    }
+}
+
+int64_t GPUdpSrc::Now()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+}  // namespace GPlayer